@@ -0,0 +1,130 @@
+#ifndef LDTK_IMPORT_CELL_AREA_H
+#define LDTK_IMPORT_CELL_AREA_H
+
+#include <algorithm>
+
+#include "ldtkimport/Types.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief A rectangle of cells in a grid, from (left, top) to (right, bottom), including both corners.
+ *  Coordinates are in "grid-space", not pixels.
+ */
+struct CellArea
+{
+   CellArea() :
+      left(0),
+      top(0),
+      right(-1),
+      bottom(-1)
+   {
+   }
+
+   CellArea(int newLeft, int newTop, int newRight, int newBottom) :
+      left(newLeft),
+      top(newTop),
+      right(newRight),
+      bottom(newBottom)
+   {
+   }
+
+   /**
+    *  @brief Whether the area has no cells at all.
+    */
+   bool isEmpty() const
+   {
+      return right < left || bottom < top;
+   }
+
+   int getWidth() const
+   {
+      return isEmpty() ? 0 : (right - left + 1);
+   }
+
+   int getHeight() const
+   {
+      return isEmpty() ? 0 : (bottom - top + 1);
+   }
+
+   bool contains(int cellX, int cellY) const
+   {
+      return cellX >= left && cellX <= right && cellY >= top && cellY <= bottom;
+   }
+
+   bool contains(const CellArea &other) const
+   {
+      return other.isEmpty() || (!isEmpty() && other.left >= left && other.right <= right && other.top >= top && other.bottom <= bottom);
+   }
+
+   bool overlaps(const CellArea &other) const
+   {
+      return !isEmpty() && !other.isEmpty() &&
+         other.left <= right && other.right >= left && other.top <= bottom && other.bottom >= top;
+   }
+
+   /**
+    *  @brief Grow the area so it also covers the given cell.
+    */
+   void add(int cellX, int cellY)
+   {
+      if (isEmpty())
+      {
+         *this = CellArea(cellX, cellY, cellX, cellY);
+         return;
+      }
+      left = std::min(left, cellX);
+      top = std::min(top, cellY);
+      right = std::max(right, cellX);
+      bottom = std::max(bottom, cellY);
+   }
+
+   /**
+    *  @brief Grow the area so it also covers another area.
+    */
+   void add(const CellArea &other)
+   {
+      if (other.isEmpty())
+      {
+         return;
+      }
+      add(other.left, other.top);
+      add(other.right, other.bottom);
+   }
+
+   /**
+    *  @brief Get this area, grown by the given number of cells on each side.
+    */
+   CellArea getExpanded(int amount) const
+   {
+      if (isEmpty())
+      {
+         return *this;
+      }
+      return CellArea(left - amount, top - amount, right + amount, bottom + amount);
+   }
+
+   /**
+    *  @brief Get the part of this area that's inside a grid of the given size.
+    */
+   CellArea getClamped(dimensions_t width, dimensions_t height) const
+   {
+      return CellArea(std::max(left, 0), std::max(top, 0), std::min(right, width - 1), std::min(bottom, height - 1));
+   }
+
+   bool operator==(const CellArea &other) const
+   {
+      return left == other.left && top == other.top && right == other.right && bottom == other.bottom;
+   }
+
+   int left;
+   int top;
+   int right;
+   int bottom;
+};
+
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_CELL_AREA_H
@@ -48,6 +48,23 @@ static inline int getRandomIndex(int seed, int x, int y, int min, int max)
    return getRandomIndex(seed, x, y, max - min + 1) + min;
 }
 
+/**
+ *  @brief Mix a seed and a counter into a new seed, so that each counter value gives an unrelated seed.
+ *  Unlike rand(), this has no hidden state, so the result doesn't depend on which thread calls it, or when.
+ *  The result is never negative when stored in an int, same as rand().
+ */
+static inline uint32_t getCounterSeed(uint32_t seed, uint32_t counter)
+{
+   // Based on the splitmix64 finalizer
+   // Source: https://prng.di.unimi.it/splitmix64.c
+   // Note: h is meant to overflow on purpose
+   uint64_t h = ((static_cast<uint64_t>(seed) << 32) | counter) + 0x9E3779B97F4A7C15ULL;
+   h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+   h = h ^ (h >> 31);
+   return static_cast<uint32_t>(h) & 0x7FFFFFFF;
+}
+
 /**
  *  @brief Assuming you have a 1-dimensional array used as a 2d grid,
  *  this converts an x, y coordinate to the array index to allow accessing it with the [] operator.
@@ -80,6 +80,11 @@ public:
    intgridvalue_t &operator()(int x, int y);
    intgridvalue_t operator()(int x, int y) const;
 
+   /**
+    *  @brief Pointer to the first cell of a row. The rest of the row's cells follow right after it.
+    */
+   const intgridvalue_t *getRow(int y) const;
+
    dimensions_t getWidth() const;
    dimensions_t getHeight() const;
 
@@ -120,6 +125,25 @@ public:
       }
    }
 
+   /**
+    *  @brief Count how many cells have each IntGridValue.
+    *
+    *  @param[out] outCounts Count of each IntGridValue, using the IntGridValue as the index.
+    *                        Only goes up to the largest IntGridValue in the IntGrid.
+    */
+   void getValueCounts(std::vector<uint32_t> &outCounts) const
+   {
+      outCounts.assign(1, 0);
+      for (auto cell = m_cells.cbegin(), end = m_cells.cend(); cell != end; ++cell)
+      {
+         if (*cell >= outCounts.size())
+         {
+            outCounts.resize(static_cast<size_t>(*cell) + 1, 0);
+         }
+         ++outCounts[*cell];
+      }
+   }
+
    friend std::ostream &operator<<(std::ostream &os, const IntGrid &intGrid);
 
 private:
@@ -181,6 +205,16 @@ inline intgridvalue_t IntGrid::operator()(int x, int y) const
    return m_cells[GridUtility::getIndex(x, y, m_width)];
 }
 
+inline const intgridvalue_t *IntGrid::getRow(int y) const
+{
+   ASSERT_THROW(y >= 0, std::out_of_range,
+      "supplied y index is negative: " << y);
+   ASSERT_THROW(y < m_height, std::out_of_range,
+      "supplied y index is beyond height: " << y << " (height: " << m_height << ")");
+
+   return m_cells.data() + GridUtility::getIndex(0, y, m_width);
+}
+
 /**
  * @brief Number of cells in the x-axis.
  */
@@ -0,0 +1,316 @@
+#ifndef LDTK_IMPORT_INT_GRID_PLANES_H
+#define LDTK_IMPORT_INT_GRID_PLANES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ldtkimport/AssertUtility.h"
+#include "ldtkimport/Types.h"
+#include "ldtkimport/IntGrid.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief An IntGrid split into bitplanes, one bitplane per IntGridValue,
+ *  so that a Rule's pattern can be checked on 64 cells at a time using bitwise operations.
+ *
+ *  @details Each bitplane is a 2d grid of bits. A bit is set if the cell at
+ *  that position has the IntGridValue that the bitplane stands for.
+ *
+ *  Each row of a bitplane is packed into 64-bit words. The leftmost cell
+ *  of the row is in the lowest bit of the row's first word. Unused bits
+ *  in the last word of a row (when the width isn't a multiple of 64) are always 0.
+ *
+ *  Aside from the bitplanes of each IntGridValue, there are some special bitplanes:
+ *  PLANE_NON_ZERO has the bits set for any cell that isn't 0
+ *  (this is what RULE_PATTERN_ANYTHING and RULE_PATTERN_NOTHING check against),
+ *  and PLANE_EMPTY has no bits set at all (for IntGridValues that weren't asked to have a bitplane,
+ *  which would be the same as saying no cell has that IntGridValue).
+ *
+ *  The bitplanes have a halo around the IntGrid, so that a Rule's pattern can be checked
+ *  without any bounds checks: there are extra rows above and below (as many as the halo size),
+ *  and one extra word to the left and right of each row. The cells in the halo act as if
+ *  they have a sentinel value: PLANE_HORIZONTAL_OUT_OF_BOUNDS has the bits set for the cells
+ *  to the left and right of the IntGrid, PLANE_VERTICAL_OUT_OF_BOUNDS for the cells above and below
+ *  (including the corners), and PLANE_OUT_OF_BOUNDS for both. The halo cells are never set in the other bitplanes.
+ *
+ *  Optionally, buildAreaSums() makes a summed-area table of each bitplane, so that the number
+ *  of bits set in a rectangle can be counted without going through each row of it.
+ */
+class IntGridPlanes
+{
+public:
+
+   using word_t = uint64_t;
+
+   static constexpr int WORD_BITS = 64;
+
+   /**
+    *  @brief Index of the bitplane that has a bit set for every cell that isn't 0.
+    */
+   static constexpr uint16_t PLANE_NON_ZERO = 0;
+
+   /**
+    *  @brief Index of the bitplane that has no bits set.
+    */
+   static constexpr uint16_t PLANE_EMPTY = 1;
+
+   /**
+    *  @brief Index of the bitplane that has a bit set for the halo cells to the left and right of the IntGrid.
+    */
+   static constexpr uint16_t PLANE_HORIZONTAL_OUT_OF_BOUNDS = 2;
+
+   /**
+    *  @brief Index of the bitplane that has a bit set for the halo cells above and below the IntGrid,
+    *  including the ones diagonally outside it.
+    */
+   static constexpr uint16_t PLANE_VERTICAL_OUT_OF_BOUNDS = 3;
+
+   /**
+    *  @brief Index of the bitplane that has a bit set for all halo cells.
+    */
+   static constexpr uint16_t PLANE_OUT_OF_BOUNDS = 4;
+
+   /**
+    *  @brief Index of the first bitplane that's for an IntGridValue. All special bitplanes come before it.
+    */
+   static constexpr uint16_t PLANE_FIRST_VALUE = 5;
+
+   /**
+    *  @brief Largest halo size allowed. The halo can't be wider than the extra word on each side of a row.
+    */
+   static constexpr int HALO_SIZE_MAX = WORD_BITS;
+
+   /**
+    *  @brief How many cells wide each column of the summed-area tables is.
+    *  getAreaSum() can only count rectangles that start and end at the edges of these columns.
+    */
+   static constexpr int AREA_SUM_COLUMN_CELLS = 8;
+
+   IntGridPlanes() :
+      m_width(0),
+      m_height(0),
+      m_wordsPerRow(0),
+      m_haloSize(0),
+      m_rowStride(0),
+      m_paddedHeight(0),
+      m_planeCount(0),
+      m_planeIdxOfValue(),
+      m_planeValues(),
+      m_bits(),
+      m_areaSumColumns(0),
+      m_areaSums()
+   {
+   }
+
+   /**
+    *  @brief Split the IntGrid into bitplanes.
+    *
+    *  @param[in] cells The IntGrid to get the values from.
+    *  @param[in] values Which IntGridValues need their own bitplane.
+    *                    Duplicates are fine. 0 is ignored (use PLANE_NON_ZERO for that).
+    *  @param[in] haloSize How many rows to add above and below the IntGrid.
+    *                      This should be the largest radius (patternSize / 2) of the Rules that will use this.
+    *
+    *  @details The bitplane of values[n] is at index (PLANE_FIRST_VALUE + n), as long as
+    *  values has no duplicates and no 0. Rule::compileChecks relies on this.
+    *
+    *  On x86, this uses SSE2 or AVX2 (whichever the CPU supports) to compare
+    *  16 or 32 cells at a time. Define LDTK_IMPORT_NO_SIMD to always use the plain C++ version.
+    */
+   void build(const IntGrid &cells, const std::vector<intgridvalue_t> &values, const int haloSize);
+
+   /**
+    *  @brief Make the summed-area tables used by getAreaSum(). Needs to be called after build().
+    *
+    *  @details Only PLANE_NON_ZERO and the bitplanes of each IntGridValue get a table,
+    *  the rest are simple enough that getAreaSum() can work them out from the rectangle itself.
+    *  Each table has one entry per row and per AREA_SUM_COLUMN_CELLS cells.
+    */
+   void buildAreaSums();
+
+   bool hasAreaSums() const
+   {
+      return !m_areaSums.empty();
+   }
+
+   /**
+    *  @brief Widen a range of cells (inclusive on both ends) so that it starts and ends at the edges
+    *  of the summed-area table columns, which is what getAreaSum() needs.
+    */
+   static void alignAreaColumns(int &left, int &right)
+   {
+      // C++20 guarantees arithmetic shift for negative values, so these are floor divisions
+      left = (left >> 3) * AREA_SUM_COLUMN_CELLS;
+      right = ((right >> 3) * AREA_SUM_COLUMN_CELLS) + (AREA_SUM_COLUMN_CELLS - 1);
+      static_assert(AREA_SUM_COLUMN_CELLS == 8, "the shifts above need to match AREA_SUM_COLUMN_CELLS");
+   }
+
+   /**
+    *  @brief Count how many bits are set in a rectangle of a bitplane. The edges are inclusive.
+    *
+    *  @details The rectangle can go past the halo, the cells out there count as being in the halo.
+    *  left and right need to be aligned with alignAreaColumns() first.
+    *  Only works after buildAreaSums().
+    */
+   uint32_t getAreaSum(uint16_t planeIdx, int left, int top, int right, int bottom) const;
+
+   /**
+    *  @brief Get the index of the bitplane for an IntGridValue.
+    *  If the IntGridValue wasn't given to build(), this returns PLANE_EMPTY.
+    */
+   uint16_t getPlaneIdx(intgridvalue_t value) const
+   {
+      if (value >= m_planeIdxOfValue.size())
+      {
+         return PLANE_EMPTY;
+      }
+      return m_planeIdxOfValue[value];
+   }
+
+   /**
+    *  @brief Get the words of one row of a bitplane.
+    *  y can go from -haloSize to (height + haloSize - 1).
+    *  The extra words at index -1 and getWordsPerRow() are also valid.
+    */
+   const word_t *getRow(uint16_t planeIdx, int y) const
+   {
+      ASSERT(planeIdx < m_planeCount, "planeIdx is beyond plane count: " << planeIdx << " (plane count: " << m_planeCount << ")");
+      ASSERT(y >= -m_haloSize && y < m_height + m_haloSize, "y is out of bounds: " << y << " (height: " << m_height << ", halo: " << m_haloSize << ")");
+
+      return m_bits.data() + (((static_cast<size_t>(planeIdx) * m_paddedHeight) + (y + m_haloSize)) * m_rowStride) + 1;
+   }
+
+   /**
+    *  @brief Get 64 bits of a bitplane's row, starting at cell (wordIdx * 64) + shift.
+    *  In other words, bit n of the result tells if cell ((wordIdx * 64) + n + shift) has the bitplane's value.
+    *  shift should be within -haloSize to haloSize, so that this never reads past the halo.
+    */
+   word_t getShiftedWord(uint16_t planeIdx, int y, size_t wordIdx, int shift) const
+   {
+      ASSERT(shift >= -m_haloSize && shift <= m_haloSize, "shift is beyond the halo: " << shift << " (halo: " << m_haloSize << ")");
+
+      const word_t *row = getRow(planeIdx, y);
+
+      // C++20 guarantees arithmetic shift for negative values, so this is a floor division
+      int bitPos = static_cast<int>(wordIdx * WORD_BITS) + shift;
+      int firstWordIdx = bitPos >> 6;
+      int bitOffset = bitPos & (WORD_BITS - 1);
+
+      word_t low = row[firstWordIdx];
+      if (bitOffset == 0)
+      {
+         return low;
+      }
+      word_t high = row[firstWordIdx + 1];
+      return (low >> bitOffset) | (high << (WORD_BITS - bitOffset));
+   }
+
+   /**
+    *  @brief Which bits of a row's word stand for an actual cell (i.e. aren't past the width).
+    */
+   word_t getValidMask(size_t wordIdx) const
+   {
+      return getBitRange(0, static_cast<int>(m_width) - static_cast<int>(wordIdx * WORD_BITS));
+   }
+
+   size_t getWordsPerRow() const
+   {
+      return m_wordsPerRow;
+   }
+
+   dimensions_t getWidth() const
+   {
+      return m_width;
+   }
+
+   dimensions_t getHeight() const
+   {
+      return m_height;
+   }
+
+   int getHaloSize() const
+   {
+      return m_haloSize;
+   }
+
+   /**
+    *  @brief Bits from begin (inclusive) to end (exclusive) are set. Values are clamped to 0 to 64.
+    */
+   static word_t getBitRange(int begin, int end)
+   {
+      if (begin < 0)
+      {
+         begin = 0;
+      }
+      if (end > WORD_BITS)
+      {
+         end = WORD_BITS;
+      }
+      if (begin >= end)
+      {
+         return 0;
+      }
+      word_t upTo = (end == WORD_BITS) ? ~word_t(0) : ((word_t(1) << end) - 1);
+      word_t below = (word_t(1) << begin) - 1;
+      return upTo & ~below;
+   }
+
+private:
+
+   word_t *getMutableRow(uint16_t planeIdx, int y)
+   {
+      return const_cast<word_t *>(static_cast<const IntGridPlanes *>(this)->getRow(planeIdx, y));
+   }
+
+   dimensions_t m_width;
+   dimensions_t m_height;
+   size_t m_wordsPerRow;
+   int m_haloSize;
+
+   /**
+    *  @brief Words per row, including the extra word on each side.
+    */
+   size_t m_rowStride;
+
+   /**
+    *  @brief Rows per bitplane, including the halo rows.
+    */
+   size_t m_paddedHeight;
+
+   uint16_t m_planeCount;
+
+   /**
+    *  @brief Lookup table of which bitplane each IntGridValue has, using the IntGridValue as the index.
+    */
+   std::vector<uint16_t> m_planeIdxOfValue;
+
+   /**
+    *  @brief Which IntGridValue each bitplane is for, using the bitplane index as the index.
+    *  The entries for PLANE_NON_ZERO and PLANE_EMPTY are unused.
+    */
+   std::vector<intgridvalue_t> m_planeValues;
+
+   /**
+    *  @brief All bitplanes, one after the other.
+    */
+   std::vector<word_t> m_bits;
+
+   /**
+    *  @brief Columns of each summed-area table, not counting the extra column at the start.
+    */
+   size_t m_areaSumColumns;
+
+   /**
+    *  @brief Summed-area tables of PLANE_NON_ZERO, then the bitplane of each IntGridValue, one after the other.
+    *  Each has an extra row and column of zeroes at the start, so entry (column, row) is the number of bits set above and to the left of it.
+    */
+   std::vector<uint32_t> m_areaSums;
+};
+
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_INT_GRID_PLANES_H
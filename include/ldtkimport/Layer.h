@@ -1,11 +1,13 @@
 #ifndef LDTK_IMPORT_LAYER_H
 #define LDTK_IMPORT_LAYER_H
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <vector>
 
 #include "ldtkimport/IntGridValue.h"
+#include "ldtkimport/NeighbourhoodTable.h"
 #include "ldtkimport/RuleGroup.h"
 #include "ldtkimport/TileGrid.h"
 
@@ -13,6 +15,198 @@
 namespace ldtkimport
 {
 
+/**
+ *  @brief Why a Rule can never place any tile. See CompiledRules::deadRules.
+ */
+namespace DeadRule
+{
+/**
+ *  @brief The Rule isn't dead (as far as we can tell).
+ */
+static const uint8_t None = 0;
+
+/**
+ *  @brief The pattern needs an IntGridValue that the Layer doesn't have (see Rule::canMatchValueCounts),
+ *  e.g. it was deleted from the Layer after the Rule was made.
+ */
+static const uint8_t NeedsMissingValue = 1;
+
+/**
+ *  @brief An earlier Rule always matches (and finalizes) the cells this Rule would match. See Rule::shadows.
+ */
+static const uint8_t Shadowed = 2;
+}
+
+/**
+ *  @brief All Rules of a Layer, with their patterns compiled into a form that
+ *  can be checked against the IntGrid's bitplanes (IntGridPlanes).
+ *
+ *  @details This is computed in LdtkDefFile::preProcess, and updated by LdtkDefFile::replaceRule when a Rule is edited.
+ *  If the Rules are edited any other way, running them compiles them again each time (see isCompiledFrom)
+ *  until preProcess is called again.
+ */
+struct CompiledRules
+{
+   CompiledRules() :
+      planeValues(),
+      haloSize(0),
+      checks(),
+      ruleCheckStarts(),
+      ruleRevisions(),
+      ruleHashes(),
+      centerCandidateStarts(),
+      centerCandidates(),
+      deadRules(),
+      shadowingRules(),
+      neighbourhoodTable()
+   {
+   }
+
+   /**
+    *  @brief IntGridValues that the Rules check for, in the order they're given to IntGridPlanes::build.
+    */
+   std::vector<intgridvalue_t> planeValues;
+
+   /**
+    *  @brief Largest radius (patternSize / 2) of the Rules' patterns.
+    */
+   int haloSize;
+
+   /**
+    *  @brief Compiled patterns of all Rules, one Rule after the other.
+    *  Each Rule has Rule::ORIENTATION_COUNT versions of its pattern in here. See Rule::compileChecks.
+    */
+   std::vector<Rule::PlaneCheck> checks;
+
+   /**
+    *  @brief Index of where each Rule's checks start, for every Rule of every RuleGroup in the order they're in.
+    *  Has one extra value at the end, so that each Rule's checks end where the next one's starts.
+    */
+   std::vector<uint32_t> ruleCheckStarts;
+
+   /**
+    *  @brief For each Rule (counting through all RuleGroups), a number that's different every time the Rule is compiled,
+    *  so that RuleCheckpoints can tell which Rules were edited since they were last run.
+    */
+   std::vector<uint64_t> ruleRevisions;
+
+   /**
+    *  @brief For each Rule (counting through all RuleGroups), its Rule::getCompileHash at the time it was compiled,
+    *  so that edits to the Rules made without going through LdtkDefFile::replaceRule can be found (see isCompiledFrom).
+    */
+   std::vector<uint64_t> ruleHashes;
+
+   /**
+    *  @brief Largest IntGridValue that gets its own list in centerCandidates.
+    *  Layers with Rules that check for IntGridValues beyond this only get one list, with all Rules in it.
+    */
+   static constexpr intgridvalue_t CENTER_CANDIDATE_VALUE_MAX = 1023;
+
+   /**
+    *  @brief Index of where each IntGridValue's list starts in centerCandidates, starting with IntGridValue 0.
+    *  The last list is for all IntGridValues from there on. Has one extra value at the end, so that each list
+    *  ends where the next one starts. See getCenterCandidates.
+    */
+   std::vector<uint32_t> centerCandidateStarts;
+
+   /**
+    *  @brief For each IntGridValue, index of each Rule (counting through all RuleGroups) that could match
+    *  a cell with that IntGridValue, going by the center of its pattern (see Rule::passesPatternCenter).
+    *  Each list is in the same order as the Rules, one list after the other.
+    */
+   std::vector<uint32_t> centerCandidates;
+
+   /**
+    *  @brief For each Rule (counting through all RuleGroups), a value from DeadRule of why it can never place any tile.
+    *  Only the Rules that are active, in an active RuleGroup, are looked at.
+    *
+    *  @details LdtkDefFile::runRulesOnLayer skips the Rules that are DeadRule::Shadowed, as long as the Rule
+    *  shadowing them is still being run. Rules that are DeadRule::NeedsMissingValue still get run, in case the IntGrid
+    *  has values the Layer doesn't list, but are skipped anyway if the IntGrid really doesn't have those values.
+    *  Use LdtkDefFile::debugPrintDeadRules to list them.
+    */
+   std::vector<uint8_t> deadRules;
+
+   /**
+    *  @brief For each Rule that's DeadRule::Shadowed, index of the earlier Rule that shadows it (counting through all RuleGroups).
+    *  Other Rules have 0 here.
+    */
+   std::vector<uint32_t> shadowingRules;
+
+   /**
+    *  @brief All Rules put in one lookup table, if the Rules are simple enough for it.
+    *  When built, this is used instead of the checks.
+    */
+   NeighbourhoodTable neighbourhoodTable;
+
+   void clear()
+   {
+      planeValues.clear();
+      haloSize = 0;
+      checks.clear();
+      ruleCheckStarts.clear();
+      ruleRevisions.clear();
+      ruleHashes.clear();
+      centerCandidateStarts.clear();
+      centerCandidates.clear();
+      deadRules.clear();
+      shadowingRules.clear();
+      neighbourhoodTable.clear();
+   }
+
+   /**
+    *  @brief Whether these were compiled from the given Rules as they are now, i.e. no Rule was added,
+    *  removed, or edited since (other than being turned on or off). See Rule::getCompileHash.
+    */
+   bool isCompiledFrom(const std::vector<RuleGroup> &ruleGroups) const
+   {
+      size_t ruleIdx = 0;
+      for (auto ruleGroup = ruleGroups.cbegin(), ruleGroupEnd = ruleGroups.cend(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+      {
+         for (auto rule = ruleGroup->rules.cbegin(), ruleEnd = ruleGroup->rules.cend(); rule != ruleEnd; ++rule, ++ruleIdx)
+         {
+            if (ruleIdx >= ruleHashes.size() || ruleHashes[ruleIdx] != rule->getCompileHash())
+            {
+               return false;
+            }
+         }
+      }
+      return ruleIdx == ruleHashes.size() && ruleCheckStarts.size() == ruleIdx + 1;
+   }
+
+   /**
+    *  @brief Pointer to the first check of a Rule, given its index (counting through all RuleGroups).
+    */
+   const Rule::PlaneCheck *getChecks(size_t ruleIdx) const
+   {
+      return checks.data() + ruleCheckStarts[ruleIdx];
+   }
+
+   /**
+    *  @brief How many checks there are in one version of a Rule's pattern, given its index (counting through all RuleGroups).
+    */
+   uint16_t getCheckCount(size_t ruleIdx) const
+   {
+      return static_cast<uint16_t>((ruleCheckStarts[ruleIdx + 1] - ruleCheckStarts[ruleIdx]) / Rule::ORIENTATION_COUNT);
+   }
+
+   /**
+    *  @brief Get the Rules that could match a cell with the given IntGridValue, going by the center of their pattern.
+    *  The Rules are given as their index (counting through all RuleGroups), in the same order as the Rules.
+    *  Rules that are inactive are still in here.
+    *
+    *  @param[in] value IntGridValue of the cell.
+    *  @param[out] outBegin Pointer to the first Rule index.
+    *  @param[out] outEnd Pointer past the last Rule index.
+    */
+   void getCenterCandidates(const intgridvalue_t value, const uint32_t *&outBegin, const uint32_t *&outEnd) const
+   {
+      const size_t listIdx = std::min(static_cast<size_t>(value), centerCandidateStarts.size() - 2);
+      outBegin = centerCandidates.data() + centerCandidateStarts[listIdx];
+      outEnd = centerCandidates.data() + centerCandidateStarts[listIdx + 1];
+   }
+};
+
 /**
  *  @brief https://ldtk.io/json/#ldtk-LayerDefJson
  */
@@ -27,7 +221,8 @@ struct Layer
       autoSourceLayerDefUid(-1),
       initialRandomSeed(0),
       intGridValues(),
-      ruleGroups()
+      ruleGroups(),
+      compiledRules()
    {
    }
 
@@ -97,6 +292,11 @@ struct Layer
     */
    std::vector<RuleGroup> ruleGroups;
 
+   /**
+    *  @brief Cached form of ruleGroups that's used when running the rules. Computed in LdtkDefFile::preProcess.
+    */
+   CompiledRules compiledRules;
+
    /**
     *  @brief Get the IntGridValue struct in this layer with the specified IntGridValue Id.
     *  @param[in] intGridValueId Id of the IntGridValue to get.
@@ -1,6 +1,7 @@
 #ifndef LDTK_IMPORT_LDTK_DEF_FILE_H
 #define LDTK_IMPORT_LDTK_DEF_FILE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <ostream>
@@ -9,10 +10,14 @@
 #include "ldtkimport/Color.h"
 #include "ldtkimport/IntGridValue.h"
 #include "ldtkimport/IntGrid.h"
+#include "ldtkimport/IntGridPlanes.h"
 #include "ldtkimport/Layer.h"
 #include "ldtkimport/RuleGroup.h"
 #include "ldtkimport/TileSet.h"
 #include "ldtkimport/Level.h"
+#include "ldtkimport/MatchCache.h"
+#include "ldtkimport/PlacementHistory.h"
+#include "ldtkimport/RuleCheckpoints.h"
 
 
 namespace ldtkimport
@@ -21,6 +26,24 @@ namespace ldtkimport
 using layers_t = std::vector<Layer>;
 using tilesets_t = std::vector<TileSet>;
 
+/**
+ *  @brief One Level to be populated by LdtkDefFile::runRulesBatch.
+ */
+struct RunRulesJob
+{
+   /**
+    *  @brief Where output of rule matching process is placed onto.
+    *  Each job should have its own Level.
+    */
+   Level *level;
+
+   /**
+    *  @brief Where the random seed of each layer comes from, if RunSettings::RandomizeSeeds is used.
+    *  Use LdtkDefFile::getJobSeed to give each job its own seed from one starting seed.
+    */
+   uint32_t seed;
+};
+
 /**
  *  @brief Main class that holds together the definitions part of an LDtk file.
  *
@@ -79,7 +102,8 @@ public:
    /**
     *  @brief This computes certain values that will be cached, so that
     *  they wouldn't have to be computed over and over every time you generate a new level.
-    *  Particularly, this caches the offsets for each tile to be used in a tile stamp.
+    *  Particularly, this caches the offsets for each tile to be used in a tile stamp,
+    *  and compiles each Layer's Rules into the form used when running them (Layer::compiledRules).
     *
     *  This is automatically called in loadFromText.
     *  If you assign data to the LdtkDefFile procedurally, then you should call this manually as the last step.
@@ -94,6 +118,30 @@ public:
 #endif
       bool preProcessDeactivatedContent = false);
 
+   /**
+    *  @brief Replace one Rule with an edited version of it, keeping its place among the other Rules,
+    *  and do what preProcess does for that Rule only: compute its stamp offsets, and compile its pattern.
+    *  Meant for editing the Rules while looking at the result, e.g. in a level editor.
+    *
+    *  @param[in] ruleUid Unique id of the Rule to replace.
+    *  @param[in] newRule The edited Rule.
+    *  @return false if there's no Rule with that uid, in which case nothing is changed.
+    *
+    *  @details The other Rules' compiled patterns are left as they are. The parts of Layer::compiledRules that
+    *  look at all the Rules together (CompiledRules::centerCandidates, CompiledRules::deadRules, and
+    *  CompiledRules::neighbourhoodTable) are made again, since those depend on every Rule.
+    *
+    *  Only the replaced Rule gets a new revision (see CompiledRules::ruleRevisions), so Levels that keep
+    *  checkpoints (see Level::setKeepCheckpoints) only run this Rule and the ones after it the next time.
+    *
+    *  If other Rules of the Layer were edited directly since they were compiled, all of them are compiled again instead.
+    */
+   bool replaceRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      int ruleUid, const Rule &newRule);
+
    // ---------------------------------------------------------------------
 
    /**
@@ -102,18 +150,34 @@ public:
     */
    friend std::ostream &operator<<(std::ostream &os, const LdtkDefFile &ldtkFile);
 
+   /**
+    *  @brief Runs the Rules a little at a time, the same way runRulesOnLayer does.
+    */
+   friend class RuleRunner;
+
    /**
     *  @brief Prints the contents of a particular Rule to the out stream.
     *  Use std::cout to print it immediately, or a std::ostringstream if you want it as a string.
     */
    void debugPrintRule(std::ostream &outStream, int ruleUid) const;
 
+   /**
+    *  @brief Prints the Rules that can never place a tile (see CompiledRules::deadRules), and why, to the out stream.
+    *  These are found in preProcess, so that has to be called first.
+    *  Use std::cout to print it immediately, or a std::ostringstream if you want it as a string.
+    *
+    *  @return How many Rules were printed.
+    */
+   size_t debugPrintDeadRules(std::ostream &outStream) const;
+
    // ---------------------------------------------------------------------
 
    /**
     *  @brief Check if this Definition File has valid data.
+    *
+    *  @param[out] outReason If not null, the reason the data isn't valid is written here.
     */
-   bool isValid() const;
+   bool isValid(std::ostream *outReason = nullptr) const;
 
    /**
     *  @brief Ensure the given level has correct data to allow this LdtkDefFile to run its rules on it.
@@ -128,6 +192,9 @@ public:
     *  @param[out] level Where output of rule matching process is placed onto.
     *  @param[in] randomizeSeed Set to true to give a new random seed to each layer,
     *                           creating a new variation for the randomized parts.
+    *
+    *  @details If the level keeps its matches (see Level::setKeepMatches), running this again
+    *  on the same IntGrid only has to place the tiles, which is much faster for rerolling the randomized parts.
     */
    void runRules(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
@@ -135,18 +202,145 @@ public:
 #endif
       Level &level, const uint8_t runSettings = RunSettings::None) const;
 
+   /**
+    *  @brief Populate a level's TileGrids by letting this LdtkDefFile run its Rules through it,
+    *  running the Rules of different layers at the same time.
+    *
+    *  @param[out] level Where output of rule matching process is placed onto.
+    *  @param[in] runSettings Bitwise flags from RunSettings.
+    *  @param[in] threadCount How many threads to use, including the calling thread. 0 means one per CPU core.
+    *
+    *  @details Each layer only writes to its own TileGrid, so the result is
+    *  the same as the single-threaded runRules, including the random seeds chosen
+    *  with RunSettings::RandomizeSeeds (these are all picked before any layer starts).
+    *  If there are more threads than layers, the remaining threads are split among the layers
+    *  to run the Rules within each layer (see runRulesOnLayer).
+    *  When LDTK_IMPORT_DEBUG_RULE is enabled, the layers still run one after another,
+    *  since they'd all be writing to the same RulesLog.
+    */
+   void runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const uint8_t runSettings, const unsigned int threadCount) const;
+
+   /**
+    *  @brief Populate the TileGrids of many levels, spread over multiple threads.
+    *
+    *  @param[in] jobs The levels to populate, and the seed to use for each.
+    *  @param[in] runSettings Bitwise flags from RunSettings.
+    *  @param[in] threadCount How many threads to use, including the calling thread. 0 means one per CPU core.
+    *
+    *  @details With RunSettings::RandomizeSeeds, the random seed of each layer is computed from
+    *  the job's seed and the layer's index, so a job always gives the same result
+    *  no matter which thread it ran on, or in what order. Without it, each layer uses its
+    *  Layer::initialRandomSeed, same as runRules.
+    *
+    *  Jobs are given to whichever thread is free next. The layers of one job run one after another.
+    *  When LDTK_IMPORT_DEBUG_RULE is enabled, all jobs run one after another, since they'd all be writing to the same RulesLog.
+    *
+    *  Thread safety: runRulesBatch, runRulesOnLayer, and runRules (without RunSettings::RandomizeSeeds,
+    *  which uses rand()) only read from the LdtkDefFile. So they can be called from different threads at the
+    *  same time on one LdtkDefFile, as long as each call has its own Levels, and the LdtkDefFile isn't
+    *  modified (loadFromText, preProcess, etc.) while that happens.
+    */
+   void runRulesBatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      const std::vector<RunRulesJob> &jobs, const uint8_t runSettings = RunSettings::None, const unsigned int threadCount = 0) const;
+
+   /**
+    *  @brief Get a seed for a RunRulesJob. Each jobIdx gives a different seed, and the same
+    *  baseSeed and jobIdx will always give the same seed.
+    *
+    *  @param[in] baseSeed Starting seed of the whole batch.
+    *  @param[in] jobIdx Index of the job in the batch.
+    */
+   static uint32_t getJobSeed(const uint32_t baseSeed, const size_t jobIdx);
+
+   /**
+    *  @brief Populate a level's TileGrids once for each of the given seeds, to get many variations of the same level.
+    *
+    *  @param[in,out] level The level to run the Rules on. Its TileGrids end up with the last variant.
+    *  @param[in] variantSeeds Seed of each variant.
+    *  @param[out] outVariants The TileGrids of each variant, one per layer, in the same order as variantSeeds.
+    *  @param[in] runSettings Bitwise flags from RunSettings. RunSettings::RandomizeSeeds is always used.
+    *  @param[in] threadCount How many threads to use, including the calling thread. 0 means one per CPU core.
+    *
+    *  @details Variant n is the same as what runRulesBatch gives for a RunRulesJob with variantSeeds[n] as its seed,
+    *  with RunSettings::RandomizeSeeds. But which cells each Rule matches doesn't depend on the seed,
+    *  so that's only done once per layer (see MatchCache), and each variant only places the tiles.
+    */
+   void runRulesVariants(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const std::vector<uint32_t> &variantSeeds, std::vector<std::vector<TileGrid>> &outVariants,
+      const uint8_t runSettings = RunSettings::None, const unsigned int threadCount = 0) const;
+
    /**
     *  @brief Populate a layer of a level's TileGrids by letting this LdtkDefFile run its Rules through it.
     *
     *  @param[out] level Where output of rule matching process is placed onto.
     *  @param[in] layerIdx Which layer's rules to run.
     *  @param[in] randomSeed Random seed value to use for the layer.
+    *  @param[in] runSettings Bitwise flags from RunSettings.
+    *  @param[in] threadCount How many threads to use, including the calling thread. 0 means one per CPU core.
+    *
+    *  @details With more than one thread, this is done in two steps: first, a batch of Rules find the cells they match,
+    *  all at the same time (see Rule::matchRule). Then, one Rule after another, in order, they place their tiles
+    *  (see Rule::placeMatches), which is where breakOnMatch is taken into account. The result is the same as with one thread.
+    *
+    *  If the layer's Rules were simple enough to be put in a NeighbourhoodTable (see CompiledRules::neighbourhoodTable),
+    *  that is used instead, on the calling thread.
+    *
+    *  Rules that need an IntGridValue that the Level's IntGrid doesn't have are left out (see Rule::canMatchValueCounts
+    *  and Level::getIntGridValueCounts). If that leaves no Rule, the layer is skipped entirely.
+    *
+    *  @param[in,out] matchCache If given, the matches of every Rule are kept in it (and the NeighbourhoodTable
+    *                            and RunSettings::MemoizeMatches aren't used). The next time this is called with
+    *                            the same MatchCache on the same IntGrid, only the tiles are placed.
+    *
+    *  If there's no matchCache and the level keeps checkpoints (see Level::setKeepCheckpoints), the Rules are run
+    *  one after another, and the tiles each one placed are kept. The next time, the tiles of the Rules that weren't
+    *  edited since (up to the first one that was) are put back as they were, and only the rest are run.
     */
    void runRulesOnLayer(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
       RulesLog &rulesLog,
 #endif
-      Level &level, const size_t layerIdx, const uint32_t randomSeed, const uint8_t runSettings = RunSettings::None) const;
+      Level &level, const size_t layerIdx, const uint32_t randomSeed, const uint8_t runSettings = RunSettings::None, const unsigned int threadCount = 1,
+      MatchCache *matchCache = nullptr) const;
+
+   /**
+    *  @brief Update a level's TileGrids after cells of its IntGrid were changed with Level::setIntGrid(x, y, value),
+    *  only running the Rules again around those cells (see Level::getDirtyAreas). The result is the same as running
+    *  the Rules on the whole Level with the same random seeds.
+    *
+    *  @param[in,out] level The level to update. Its dirty areas are cleared afterwards.
+    *  @param[in] runSettings Bitwise flags from RunSettings. RunSettings::RandomizeSeeds only picks the seed
+    *                         of layers that get their Rules run on the whole Level.
+    *  @param[in] threadCount How many threads to use in total. 0 means one per CPU core.
+    *
+    *  @details The first time this is called on a Level, the Rules are run on the whole Level, and where each Rule
+    *  placed its tiles is kept (see PlacementHistory). After that, only the tiles around each dirty area are removed
+    *  and placed again, with each layer keeping its random seed. The Rules are run on the whole Level again if the Rules
+    *  being run or the runSettings are different, or if the changes spread over too much of the Level. A Rule edited with
+    *  replaceRule counts as a different Rule. So do all the Rules of a layer that has to have its Rules compiled each time
+    *  (see getCompiledRules), since then there's no telling what changed.
+    *
+    *  A Rule's tiles can finalize cells that later Rules would have matched, so a change can spread further than
+    *  the Rules' patterns and offsets reach. To make sure the result is the same, the Rules are run again on a border
+    *  around each area as well, and if that's different from what the history says, the area is made larger and done again.
+    *
+    *  Running the Rules any other way (e.g. runRules) makes the next call run the Rules on the whole Level again.
+    */
+   void runRulesIncremental(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const uint8_t runSettings = RunSettings::None, const unsigned int threadCount = 1) const;
 
    // ---------------------------------------------------------------------
 
@@ -412,6 +606,20 @@ public:
 
 private:
 
+   /**
+    *  @brief A Rule that will be run on a layer, in the order they're applied.
+    */
+   struct RuleToRun
+   {
+      const Rule *rule;
+      const RuleGroup *ruleGroup;
+      size_t ruleIdx;
+      uint8_t rulePriority;
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RuleLog *ruleLog;
+#endif
+   };
+
    // ---------------------------------------------------------------------
 
    /**
@@ -429,6 +637,190 @@ private:
     */
    void setLayerInitialSeed(int layerDefUid, int newInitialSeed);
 
+   /**
+    *  @brief Get the IntGridValues that a Layer's Rules are meant for,
+    *  which are in another Layer if the Layer uses Layer::autoSourceLayerDefUid.
+    */
+   const std::vector<IntGridValue> &getIntGridValuesOfLayer(const Layer &layer) const;
+
+   /**
+    *  @brief Compile the patterns of all Rules in a Layer, for use in runRulesOnLayer.
+    *  Deactivated Rules and RuleGroups are included, since they can be activated afterwards.
+    *  This also finds the Rules that can never place a tile (see CompiledRules::deadRules).
+    *
+    *  @param[in] layer The Layer whose Rules will be compiled.
+    *  @param[in] intGridValues The IntGridValues the Layer's Rules are meant for, from getIntGridValuesOfLayer.
+    *  @param[out] outCompiledRules Where the result is placed.
+    */
+   static void compileRules(const Layer &layer, const std::vector<IntGridValue> &intGridValues, CompiledRules &outCompiledRules);
+
+   /**
+    *  @brief Get the Rules of a Layer compiled in preProcess. If this LdtkDefFile was
+    *  assigned data procedurally and preProcess wasn't called, or the Rules were edited since
+    *  without going through replaceRule (see CompiledRules::isCompiledFrom), they're compiled into compiledNow.
+    */
+   const CompiledRules &getCompiledRules(const Layer &layer, CompiledRules &compiledNow) const;
+
+   /**
+    *  @brief Note down the Rules of a Layer that will actually do something, in the order they're applied:
+    *  the active ones that have tiles and a chance to occur. Each one gets the next rulePriority.
+    */
+   static void getRulesToRun(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      const Layer &layer, std::vector<RuleToRun> &outRulesToRun);
+
+   /**
+    *  @brief Find which of the Rules being run can match something in the IntGrid. Rules that need an IntGridValue
+    *  the IntGrid doesn't have can't, and neither can Rules that an earlier Rule being run always shadows.
+    *
+    *  @param[in] layerIdx Which layer the Rules are from, for the debug messages.
+    *  @param[in] compiledRules From getCompiledRules.
+    *  @param[in] rulesToRun From getRulesToRun.
+    *  @param[in] valueCounts From Level::getIntGridValueCounts.
+    *  @param[in] cellCount How many cells the IntGrid has.
+    *  @param[out] outCanMatch For each of rulesToRun, whether it can match.
+    *  @return Whether any of them can match.
+    */
+   static bool findRulesThatCanMatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      const size_t layerIdx,
+#endif
+      const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+      const std::vector<uint32_t> &valueCounts, const size_t cellCount, std::vector<bool> &outCanMatch);
+
+   /**
+    *  @brief Take out the Rules that findRulesThatCanMatch found can't match, keeping the order of the rest.
+    */
+   static void removeRulesThatCantMatch(std::vector<RuleToRun> &rulesToRun, const std::vector<bool> &canMatch);
+
+   /**
+    *  @brief Run the Rules on a whole layer, like runRulesOnLayer, putting back the tiles kept in the checkpoints
+    *  for the Rules that didn't change since, and keeping the tiles of the Rules that had to be run.
+    *
+    *  @param[in] rulesToRun From getRulesToRun.
+    *  @param[in] threadCount How many threads to use for matching each Rule. 0 means one per CPU core.
+    */
+   void runRulesOnLayerFromCheckpoints(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+      const uint32_t randomSeed, const uint8_t runSettings, const unsigned int threadCount, RuleCheckpoints &checkpoints) const;
+
+   /**
+    *  @brief Part of runRulesOnLayer: place the tiles of each Rule from the matches kept in the MatchCache,
+    *  matching them all first if the MatchCache isn't filled for these Rules yet.
+    *
+    *  @param[in] rulesToRun Only the ones that can match (see removeRulesThatCantMatch).
+    *  @param[in] threadCount How many threads to use for matching the Rules. 0 means one per CPU core.
+    */
+   void runRulesOnLayerWithMatchCache(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+      const uint32_t randomSeed, const uint8_t runSettings, const unsigned int threadCount, MatchCache &matchCache) const;
+
+   /**
+    *  @brief Part of runRulesOnLayer: look up which Rule matches each cell in CompiledRules::neighbourhoodTable,
+    *  checking the Rules one by one only on the cells the table can't tell.
+    *
+    *  @param[in] rulesToRun All of them, in the same order as the table's Rules.
+    *  @param[in] runIdxOfRule Where each Rule is in rulesToRun, or -1 if it isn't there.
+    */
+   void runRulesOnLayerWithNeighbourhoodTable(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+      const std::vector<int32_t> &runIdxOfRule, const uint32_t randomSeed, const uint8_t runSettings) const;
+
+   /**
+    *  @brief Part of runRulesOnLayer: go one cell at a time, remembering which Rule matched each neighbourhood
+    *  of cells (see MatchMemo). Only works if every Rule is Rule::isCellLocal.
+    *
+    *  @param[in] rulesToRun Only the ones that can match (see removeRulesThatCantMatch).
+    *  @param[in] runIdxOfRule Where each Rule is in rulesToRun, or -1 if it isn't there.
+    *  @param[in] memoPatternSize Size of the largest pattern of rulesToRun.
+    */
+   void runRulesOnLayerWithMatchMemo(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+      const std::vector<int32_t> &runIdxOfRule, const int memoPatternSize, const uint32_t randomSeed, const uint8_t runSettings) const;
+
+   /**
+    *  @brief Part of runRulesOnLayer: apply one Rule after another on the calling thread.
+    *
+    *  @param[in] rulesToRun Only the ones that can match (see removeRulesThatCantMatch).
+    *  @param[in] planes The IntGrid split into the bitplanes of compiledRules, with area sums.
+    */
+   void runRulesOnLayerOneByOne(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+      const IntGridPlanes &planes, const uint32_t randomSeed, const uint8_t runSettings) const;
+
+   /**
+    *  @brief Part of runRulesOnLayer: match a batch of Rules at the same time, then place their tiles one Rule after another.
+    *
+    *  @param[in] rulesToRun Only the ones that can match (see removeRulesThatCantMatch).
+    *  @param[in] planes The IntGrid split into the bitplanes of compiledRules, with area sums.
+    *  @param[in] ruleThreadCount How many threads to use, more than 1.
+    */
+   void runRulesOnLayerInBatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+      const IntGridPlanes &planes, const uint32_t randomSeed, const uint8_t runSettings, const unsigned int ruleThreadCount) const;
+
+   /**
+    *  @brief Run the Rules on a whole layer, like runRulesOnLayer, and note down in the history where each Rule placed its tiles.
+    *
+    *  @param[in] compiledRules From getCompiledRules.
+    *  @param[in] rulesToRun From getRulesToRun.
+    *  @param[in] threadCount How many threads to use for matching each Rule. 0 means one per CPU core.
+    */
+   void runRulesOnLayerWithHistory(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+      const uint32_t randomSeed, const uint8_t runSettings, const unsigned int threadCount, PlacementHistory &history) const;
+
+   /**
+    *  @brief Run the Rules again only around the dirty areas of a layer, using the history for everything else (see runRulesIncremental).
+    *
+    *  @param[in] rulesToRun From getRulesToRun. Should be the same Rules as in the history.
+    *  @return false if the changes spread too far, in which case the TileGrid and history
+    *          are left in a half-done state, and the Rules have to be run on the whole layer.
+    */
+   bool rebuildDirtyAreas(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const size_t layerIdx, const std::vector<RuleToRun> &rulesToRun, const uint8_t runSettings,
+      const std::vector<CellArea> &dirtyAreas, PlacementHistory &history) const;
+
+   /**
+    *  @brief Populate a level's TileGrids using the given random seed for each layer.
+    *
+    *  @param[out] level Where output of rule matching process is placed onto.
+    *  @param[in] randomSeeds Random seed to use for each layer. Should have as many elements as there are layers.
+    *  @param[in] runSettings Bitwise flags from RunSettings. RunSettings::RandomizeSeeds is ignored here.
+    *  @param[in] threadCount How many threads to use in total. 0 means one per CPU core.
+    */
+   void runRulesWithSeeds(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      Level &level, const std::vector<uint32_t> &randomSeeds, const uint8_t runSettings, const unsigned int threadCount) const;
+
    bool isVersionAtLeast(const int16_t major, const int16_t minor, const int16_t patch) const
    {
       if (m_versionMajor > major)
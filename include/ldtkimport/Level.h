@@ -3,8 +3,12 @@
 
 #include <vector>
 
+#include "ldtkimport/CellArea.h"
 #include "ldtkimport/IntGrid.h"
 #include "ldtkimport/TileGrid.h"
+#include "ldtkimport/MatchCache.h"
+#include "ldtkimport/PlacementHistory.h"
+#include "ldtkimport/RuleCheckpoints.h"
 
 
 namespace ldtkimport
@@ -17,12 +21,37 @@ class Level
 {
 public:
 
+   /**
+    *  @brief When more separate areas than this have been changed in the IntGrid, they're all merged into one (see getDirtyAreas).
+    */
+   static const size_t MAX_DIRTY_AREAS = 32;
+
+   Level() :
+      m_intGrid(),
+      m_hasIntGridValueCounts(false),
+      m_intGridValueCounts(),
+      m_tileGrids(),
+      m_tileStorage(TileGrid::Storage::PerCell),
+      m_keepMatches(false),
+      m_matchCaches(),
+      m_dirtyAreas(),
+      m_placementHistories(),
+      m_keepCheckpoints(false),
+      m_ruleCheckpoints()
+   {
+   }
+
    /**
     *  @brief Assign values to the Level's IntGrid. This will resize the TileGrids.
     */
    void setIntGrid(dimensions_t width, dimensions_t height, std::vector<intgridvalue_t> &&values)
    {
       m_intGrid.set(width, height, std::move(values));
+      m_hasIntGridValueCounts = false;
+      clearMatchCaches();
+      clearPlacementHistories();
+      clearRuleCheckpoints();
+      clearDirtyAreas();
 
       for (auto tileGrid = m_tileGrids.begin(), end = m_tileGrids.end(); tileGrid != end; ++tileGrid)
       {
@@ -35,15 +64,34 @@ public:
     *  @param x x-coordinate. Starts at 0 (left edge of grid).
     *  @param y y-coordinate. Starts at 0 (top edge of grid).
     *  @param value Value to assign at the cell.
+    *
+    *  @details If the value is different, the cell is added to the dirty areas (see getDirtyAreas).
     */
    void setIntGrid(int x, int y, intgridvalue_t value)
    {
+      if (m_intGrid(x, y) != value)
+      {
+         addDirtyCell(x, y);
+      }
       m_intGrid(x, y) = value;
+      m_hasIntGridValueCounts = false;
+      clearMatchCaches();
+      clearRuleCheckpoints();
    }
 
    void setIntGrid(int idx, intgridvalue_t value)
    {
+      if (m_intGrid(idx) != value)
+      {
+         int x;
+         int y;
+         GridUtility::getCoordinates(idx, m_intGrid.getWidth(), x, y);
+         addDirtyCell(x, y);
+      }
       m_intGrid(idx) = value;
+      m_hasIntGridValueCounts = false;
+      clearMatchCaches();
+      clearRuleCheckpoints();
    }
 
    /**
@@ -72,6 +120,24 @@ public:
       return m_intGrid;
    }
 
+   /**
+    *  @brief How many cells of the IntGrid have each IntGridValue, using the IntGridValue as the index.
+    *  Only goes up to the largest IntGridValue in the IntGrid.
+    *
+    *  @details This is counted the first time it's asked for after the IntGrid changes, and kept until the next change.
+    *  Counting it isn't safe to do from multiple threads at the same time, so LdtkDefFile::runRules
+    *  asks for it once before running the layers.
+    */
+   const std::vector<uint32_t> &getIntGridValueCounts()
+   {
+      if (!m_hasIntGridValueCounts)
+      {
+         m_intGrid.getValueCounts(m_intGridValueCounts);
+         m_hasIntGridValueCounts = true;
+      }
+      return m_intGridValueCounts;
+   }
+
    size_t getTileGridCount() const
    {
       return m_tileGrids.size();
@@ -84,12 +150,45 @@ public:
    {
       while (m_tileGrids.size() < newCount)
       {
-         m_tileGrids.push_back(TileGrid(m_intGrid.getWidth(), m_intGrid.getHeight()));
+         m_tileGrids.push_back(TileGrid(m_intGrid.getWidth(), m_intGrid.getHeight(), m_tileStorage));
       }
       while (m_tileGrids.size() > newCount)
       {
          m_tileGrids.pop_back();
       }
+
+      if (m_keepMatches)
+      {
+         m_matchCaches.resize(newCount);
+      }
+
+      m_placementHistories.resize(newCount);
+
+      if (m_keepCheckpoints)
+      {
+         m_ruleCheckpoints.resize(newCount);
+      }
+   }
+
+   /**
+    *  @brief How the TileGrids keep their tiles (see TileGrid::Storage).
+    *  Changes the TileGrids the Level already has, and the ones it makes afterwards.
+    *
+    *  @details TileGrid::Storage::Flat takes a lot less memory and allocations on big levels,
+    *  but the tiles have to be read with TileGrid::getTiles instead of TileGrid::operator().
+    */
+   void setTileStorage(TileGrid::Storage storage)
+   {
+      m_tileStorage = storage;
+      for (auto tileGrid = m_tileGrids.begin(), end = m_tileGrids.end(); tileGrid != end; ++tileGrid)
+      {
+         tileGrid->setStorage(storage);
+      }
+   }
+
+   TileGrid::Storage getTileStorage() const
+   {
+      return m_tileStorage;
    }
 
    /**
@@ -98,6 +197,11 @@ public:
    void cleanUpIntGrid()
    {
       m_intGrid.cleanUp();
+      m_hasIntGridValueCounts = false;
+      clearMatchCaches();
+      clearPlacementHistories();
+      clearRuleCheckpoints();
+      clearDirtyAreas();
    }
 
    /**
@@ -109,6 +213,149 @@ public:
       {
          tileGrid->cleanUp();
       }
+      clearPlacementHistories();
+   }
+
+   /**
+    *  @brief Keep which cells each Rule matched when running the Rules (see MatchCache), so that running them
+    *  again with only a different random seed (e.g. with RunSettings::RandomizeSeeds) only has to place the tiles.
+    *
+    *  @details The matches are forgotten whenever the IntGrid changes. They take 3 bits per cell for each Rule,
+    *  and the NeighbourhoodTable and RunSettings::MemoizeMatches aren't used while this is on.
+    *  If the Rules themselves are changed, or a different LdtkDefFile is run on this Level, call clearMatchCaches().
+    */
+   void setKeepMatches(bool keepMatches)
+   {
+      m_keepMatches = keepMatches;
+      if (keepMatches)
+      {
+         m_matchCaches.resize(m_tileGrids.size());
+      }
+      else
+      {
+         m_matchCaches.clear();
+      }
+   }
+
+   bool isKeepingMatches() const
+   {
+      return m_keepMatches;
+   }
+
+   /**
+    *  @brief Forget the matches kept for all layers, so the next run matches the Rules all over again.
+    */
+   void clearMatchCaches()
+   {
+      for (auto matchCache = m_matchCaches.begin(), end = m_matchCaches.end(); matchCache != end; ++matchCache)
+      {
+         matchCache->clear();
+      }
+   }
+
+   /**
+    *  @brief The matches kept for a layer, or nullptr if the Level isn't keeping them (see setKeepMatches).
+    */
+   MatchCache *getMatchCache(size_t idx)
+   {
+      if (!m_keepMatches || idx >= m_matchCaches.size())
+      {
+         return nullptr;
+      }
+      return &m_matchCaches[idx];
+   }
+
+   /**
+    *  @brief Areas of the IntGrid that were changed with setIntGrid(x, y, value) since the Rules were last run.
+    *  LdtkDefFile::runRulesIncremental only runs the Rules again around these.
+    *
+    *  @details Cells changed next to each other end up in the same area. Areas can cover more cells
+    *  than the ones that were changed, but never less.
+    */
+   const std::vector<CellArea> &getDirtyAreas() const
+   {
+      return m_dirtyAreas;
+   }
+
+   void clearDirtyAreas()
+   {
+      m_dirtyAreas.clear();
+   }
+
+   /**
+    *  @brief Where the Rules of a layer placed their tiles the last time LdtkDefFile::runRulesIncremental was called,
+    *  or nullptr if there's no layer with that index.
+    */
+   PlacementHistory *getPlacementHistory(size_t idx)
+   {
+      if (idx >= m_placementHistories.size())
+      {
+         return nullptr;
+      }
+      return &m_placementHistories[idx];
+   }
+
+   /**
+    *  @brief Forget where the Rules placed their tiles for all layers, so the next LdtkDefFile::runRulesIncremental
+    *  runs the Rules on the whole Level. Call this if the Rules themselves are changed.
+    */
+   void clearPlacementHistories()
+   {
+      for (auto history = m_placementHistories.begin(), end = m_placementHistories.end(); history != end; ++history)
+      {
+         history->clear();
+      }
+   }
+
+   /**
+    *  @brief Keep the tiles each Rule placed when running the Rules (see RuleCheckpoints), so that after
+    *  a Rule is edited with LdtkDefFile::replaceRule, running the Rules again starts from that Rule instead of the first one.
+    *  Meant for editing the Rules while looking at the result, e.g. in a level editor.
+    *
+    *  @details The tiles are forgotten whenever the IntGrid changes. They take about as much memory as the TileGrids,
+    *  and the NeighbourhoodTable, RunSettings::MemoizeMatches, and running the Rules of a layer on multiple threads
+    *  aren't used while this is on (each Rule is matched with multiple threads instead).
+    *  If the Rules are changed some other way than LdtkDefFile::replaceRule, call LdtkDefFile::preProcess or clearRuleCheckpoints().
+    */
+   void setKeepCheckpoints(bool keepCheckpoints)
+   {
+      m_keepCheckpoints = keepCheckpoints;
+      if (keepCheckpoints)
+      {
+         m_ruleCheckpoints.resize(m_tileGrids.size());
+      }
+      else
+      {
+         m_ruleCheckpoints.clear();
+      }
+   }
+
+   bool isKeepingCheckpoints() const
+   {
+      return m_keepCheckpoints;
+   }
+
+   /**
+    *  @brief Forget the tiles kept for all layers, so the next run starts from the first Rule.
+    */
+   void clearRuleCheckpoints()
+   {
+      for (auto checkpoints = m_ruleCheckpoints.begin(), end = m_ruleCheckpoints.end(); checkpoints != end; ++checkpoints)
+      {
+         checkpoints->clear();
+      }
+   }
+
+   /**
+    *  @brief The tiles kept for a layer, or nullptr if the Level isn't keeping them (see setKeepCheckpoints).
+    */
+   RuleCheckpoints *getRuleCheckpoints(size_t idx)
+   {
+      if (!m_keepCheckpoints || idx >= m_ruleCheckpoints.size())
+      {
+         return nullptr;
+      }
+      return &m_ruleCheckpoints[idx];
    }
 
    TileGrid &getTileGridByIdx(int idx)
@@ -127,12 +374,56 @@ public:
 
 private:
 
+   void addDirtyCell(int x, int y);
+
    IntGrid m_intGrid;
 
+   /**
+    * @brief Whether m_intGridValueCounts is up to date with m_intGrid.
+    */
+   bool m_hasIntGridValueCounts;
+
+   std::vector<uint32_t> m_intGridValueCounts;
+
    /**
     * @brief Results of rules applied on the Level are stored here.
     */
    std::vector<TileGrid> m_tileGrids;
+
+   /**
+    * @brief How the TileGrids in m_tileGrids keep their tiles.
+    */
+   TileGrid::Storage m_tileStorage;
+
+   /**
+    * @brief Whether m_matchCaches are used.
+    */
+   bool m_keepMatches;
+
+   /**
+    * @brief Matches of the Rules of each layer, from the last time they were run on m_intGrid.
+    */
+   std::vector<MatchCache> m_matchCaches;
+
+   /**
+    * @brief Areas of m_intGrid changed one cell at a time, since the Rules were last run.
+    */
+   std::vector<CellArea> m_dirtyAreas;
+
+   /**
+    * @brief Where the Rules of each layer placed their tiles, for LdtkDefFile::runRulesIncremental.
+    */
+   std::vector<PlacementHistory> m_placementHistories;
+
+   /**
+    * @brief Whether m_ruleCheckpoints are used.
+    */
+   bool m_keepCheckpoints;
+
+   /**
+    * @brief Tiles placed by each Rule of each layer, from the last time they were run on m_intGrid.
+    */
+   std::vector<RuleCheckpoints> m_ruleCheckpoints;
 };
 
 inline std::ostream &operator<<(std::ostream &os, const Level &level)
@@ -144,6 +435,33 @@ inline std::ostream &operator<<(std::ostream &os, const Level &level)
    return os;
 }
 
+inline void Level::addDirtyCell(int x, int y)
+{
+   // grow an area that the cell touches, if there is one
+   for (auto area = m_dirtyAreas.begin(), end = m_dirtyAreas.end(); area != end; ++area)
+   {
+      if (area->getExpanded(1).contains(x, y))
+      {
+         area->add(x, y);
+         return;
+      }
+   }
+
+   if (m_dirtyAreas.size() >= MAX_DIRTY_AREAS)
+   {
+      // too many to keep apart, just cover all of them
+      CellArea all(x, y, x, y);
+      for (auto area = m_dirtyAreas.cbegin(), end = m_dirtyAreas.cend(); area != end; ++area)
+      {
+         all.add(*area);
+      }
+      m_dirtyAreas.assign(1, all);
+      return;
+   }
+
+   m_dirtyAreas.push_back(CellArea(x, y, x, y));
+}
+
 inline void Level::debugPrintTileGrids(std::ostream &os) const
 {
    os << "TileGrids: " << m_tileGrids.size() << std::endl;
@@ -0,0 +1,71 @@
+#ifndef LDTK_IMPORT_MATCH_CACHE_H
+#define LDTK_IMPORT_MATCH_CACHE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "ldtkimport/Rule.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief Which cells each Rule of one Layer matched on an IntGrid, kept so that the Layer can be run again
+ *  on the same IntGrid with a different random seed, without matching the Rules all over again.
+ *
+ *  @details Whether a Rule's pattern (and modulo) matches a cell doesn't depend on the random seed.
+ *  Only the Rule's chance, which tile it picks, and its random offsets do, and those are all done
+ *  when placing the tiles (see Rule::placeMatches). So when given one of these, LdtkDefFile::runRulesOnLayer
+ *  fills it in the first time, and after that only places the tiles.
+ *
+ *  The matches are only for the IntGrid and Rules they were made with. The Rules are told apart by their
+ *  revisions (see CompiledRules::ruleRevisions), so a Rule edited with LdtkDefFile::replaceRule gets matched again.
+ *  If the IntGrid changes, call clear().
+ */
+struct MatchCache
+{
+   MatchCache() :
+      ruleIdxs(),
+      ruleRevisions(),
+      matches()
+   {
+   }
+
+   void clear()
+   {
+      ruleIdxs.clear();
+      ruleRevisions.clear();
+      matches.clear();
+   }
+
+   /**
+    *  @brief Whether there are matches for exactly these Rules, in this order, at these revisions.
+    *
+    *  @param[in] runRuleIdxs Index of each Rule that will be run (counting through all RuleGroups), in the order they're applied.
+    *  @param[in] runRuleRevisions Revision of each Rule in runRuleIdxs (see CompiledRules::ruleRevisions).
+    */
+   bool isFilledFor(const std::vector<uint32_t> &runRuleIdxs, const std::vector<uint64_t> &runRuleRevisions) const
+   {
+      return matches.size() == ruleIdxs.size() && ruleIdxs == runRuleIdxs && ruleRevisions == runRuleRevisions;
+   }
+
+   /**
+    *  @brief Index of each Rule that was matched (counting through all RuleGroups), in the order they're applied.
+    */
+   std::vector<uint32_t> ruleIdxs;
+
+   /**
+    *  @brief Revision of each Rule in ruleIdxs, at the time it was matched (see CompiledRules::ruleRevisions).
+    */
+   std::vector<uint64_t> ruleRevisions;
+
+   /**
+    *  @brief Cells matched by each Rule in ruleIdxs, from Rule::matchRule.
+    */
+   std::vector<Rule::Matches> matches;
+};
+
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_MATCH_CACHE_H
@@ -0,0 +1,149 @@
+#ifndef LDTK_IMPORT_MATCH_MEMO_H
+#define LDTK_IMPORT_MATCH_MEMO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ldtkimport/IntGrid.h"
+#include "ldtkimport/NeighbourhoodTable.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief Remembers which Rule matched each distinct neighbourhood of cells, while going through an IntGrid
+ *  cell by cell. Used by LdtkDefFile::runRulesOnLayer when RunSettings::MemoizeMatches is given,
+ *  on layers where every Rule is Rule::isCellLocal.
+ *
+ *  @details For those Rules, the only thing that decides which tile a cell gets is the window of
+ *  patternSize x patternSize cells around it (the out-of-bounds values only depend on which side
+ *  of the IntGrid a cell is outside of). So in large areas that all have the same IntGridValue,
+ *  many cells have the same window, and only need the Rules checked on them once.
+ *
+ *  The windows are keyed by a hash that is rolled from one cell to the next as a row is scanned
+ *  from left to right. Windows are compared in full on a hit, so a hash collision never gives a wrong result.
+ */
+class MatchMemo
+{
+public:
+
+   using Match = NeighbourhoodTable::Match;
+
+   /**
+    *  @brief Default limit on how many windows are remembered.
+    *  An IntGrid with no large uniform areas would have mostly unique windows, which aren't worth remembering.
+    */
+   static constexpr size_t DEFAULT_MAX_ENTRIES = 1 << 14;
+
+   explicit MatchMemo(size_t maxEntries = DEFAULT_MAX_ENTRIES) :
+      m_maxEntries(maxEntries),
+      m_cells(nullptr),
+      m_width(0),
+      m_height(0),
+      m_patternSize(0),
+      m_paddedWidth(0),
+      m_rows(),
+      m_columnHashes(),
+      m_highestPower(0),
+      m_nextX(0),
+      m_hash(0),
+      m_lookup(),
+      m_windows(),
+      m_matches()
+   {
+   }
+
+   /**
+    *  @brief Get ready to go through the cells of an IntGrid. This forgets all remembered windows.
+    *
+    *  @param[in] cells The IntGrid to go through. Needs to stay alive and unchanged while this is used.
+    *  @param[in] patternSize Largest patternSize of the Rules. Each cell's window is this size.
+    */
+   void begin(const IntGrid &cells, const int patternSize);
+
+   /**
+    *  @brief Start going through a row. The cells of the row are then given to next(), from left to right.
+    */
+   void beginRow(const int cellY);
+
+   /**
+    *  @brief Move on to the next cell of the row (starting with cellX 0), and check if its window was seen before.
+    *
+    *  @param[out] outMatch If the window was seen before, which Rule matched it.
+    *  @return true if the window was seen before.
+    */
+   bool next(Match &outMatch);
+
+   /**
+    *  @brief Remember which Rule matched the window of the cell last given by next().
+    */
+   void remember(const Match &match);
+
+   size_t getEntryCount() const
+   {
+      return m_matches.size();
+   }
+
+private:
+
+   /**
+    *  @brief Get the window of cellX in the current row, starting with its top-left cell.
+    *  The window's rows are m_paddedWidth apart.
+    */
+   const uint32_t *getWindow(const int cellX) const
+   {
+      return m_rows.data() + cellX;
+   }
+
+   bool isSameWindow(const uint32_t *window, const uint32_t *stored) const;
+
+   size_t m_maxEntries;
+
+   const IntGrid *m_cells;
+   int m_width;
+   int m_height;
+   int m_patternSize;
+
+   /**
+    *  @brief Width of the IntGrid, with room for the cells outside it on both sides.
+    */
+   int m_paddedWidth;
+
+   /**
+    *  @brief The rows of the IntGrid that the current row's windows cover, m_patternSize rows of m_paddedWidth.
+    *  Each cell is stored as its IntGridValue + 2, or OUT_OF_BOUNDS_HORIZONTAL or OUT_OF_BOUNDS_VERTICAL.
+    */
+   std::vector<uint32_t> m_rows;
+
+   /**
+    *  @brief Hash of each column of m_rows.
+    */
+   std::vector<uint64_t> m_columnHashes;
+
+   /**
+    *  @brief The hash base between columns, to the power of (m_patternSize - 1), for removing the leftmost column when rolling the hash.
+    */
+   uint64_t m_highestPower;
+
+   int m_nextX;
+   uint64_t m_hash;
+
+   /**
+    *  @brief Index into m_matches (and m_windows), using the window's hash as the key.
+    */
+   std::unordered_map<uint64_t, uint32_t> m_lookup;
+
+   /**
+    *  @brief The cells of each remembered window, one window after the other, m_patternSize * m_patternSize each.
+    */
+   std::vector<uint32_t> m_windows;
+
+   std::vector<Match> m_matches;
+};
+
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_MATCH_MEMO_H
@@ -0,0 +1,165 @@
+#ifndef LDTK_IMPORT_NEIGHBOURHOOD_TABLE_H
+#define LDTK_IMPORT_NEIGHBOURHOOD_TABLE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "ldtkimport/Types.h"
+#include "ldtkimport/IntGrid.h"
+#include "ldtkimport/RuleGroup.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief Every Rule of a Layer compiled into one lookup table, for Layers that only do
+ *  classic 3x3 autotiling, so that running the Layer is one table lookup per cell,
+ *  instead of checking each Rule on each cell.
+ *
+ *  @details This can only be built if the Rules fit a certain shape:
+ *  - Patterns are 3x3 (or 1x1), and only check for one IntGridValue
+ *    (either that it's there or that it's not), RULE_PATTERN_ANYTHING, or RULE_PATTERN_NOTHING.
+ *  - Rule::isCellLocal is true (no chance, modulo, checker, or offsets, and breakOnMatch is on).
+ *
+ *  With those, the only thing that decides which tile a cell gets is the 3x3 neighbourhood
+ *  around it, which is turned into a 9-bit index: bit (x + (y * 3)) is set if the cell at
+ *  offset (x - 1, y - 1) has the IntGridValue (or has any value, if the Rules don't check for a specific one).
+ *  Each entry of the table has the first Rule (and which flipped version of it) that matches that neighbourhood,
+ *  in the same order as the Rules would have been applied.
+ *
+ *  Cells near the edge of the IntGrid depend on each Rule's out-of-bounds values, and if the Rules check for
+ *  both the IntGridValue and RULE_PATTERN_ANYTHING/NOTHING, a cell with some other IntGridValue can't be
+ *  told apart from an empty one in the 9-bit index. lookUp() marks those cells with CHECK_CELL,
+ *  so that the caller checks the Rules on them one by one.
+ */
+class NeighbourhoodTable
+{
+public:
+
+   static constexpr size_t ENTRY_COUNT = 1 << 9;
+
+   /**
+    *  @brief Value of Match::ruleNum when none of the Rules match.
+    */
+   static constexpr uint16_t NO_MATCH = UINT16_MAX;
+
+   /**
+    *  @brief Value of Match::ruleNum when the table can't be used for the cell.
+    */
+   static constexpr uint16_t CHECK_CELL = UINT16_MAX - 1;
+
+   struct Match
+   {
+      /**
+       *  @brief Which Rule matched, as an index to getRuleIdxs(). Or NO_MATCH, or CHECK_CELL.
+       */
+      uint16_t ruleNum;
+
+      /**
+       *  @brief TileFlags::FlippedX and TileFlags::FlippedY, of which version of the Rule's pattern matched.
+       */
+      uint8_t flags;
+   };
+
+   NeighbourhoodTable() :
+      m_value(0),
+      m_checksValue(false),
+      m_checksNonZero(false),
+      m_radius(0),
+      m_ruleIdxs(),
+      m_entries()
+   {
+   }
+
+   /**
+    *  @brief Build the table out of the Rules, if they fit the shape.
+    *
+    *  @param[in] ruleGroups The Rules to build it from. Inactive RuleGroups and Rules,
+    *                        and Rules that have no tiles or no chance, are left out,
+    *                        the same way LdtkDefFile::runRulesOnLayer leaves them out.
+    *  @return true if the table was built. If not, isBuilt() will be false.
+    */
+   bool build(const std::vector<RuleGroup> &ruleGroups);
+
+   void clear()
+   {
+      m_value = 0;
+      m_checksValue = false;
+      m_checksNonZero = false;
+      m_radius = 0;
+      m_ruleIdxs.clear();
+      m_entries.clear();
+   }
+
+   bool isBuilt() const
+   {
+      return !m_entries.empty();
+   }
+
+   /**
+    *  @brief Index of each Rule that the table was built from (counting through all RuleGroups), in the order they're applied.
+    *  If the Rules that will actually be run aren't the same as these (e.g. a Rule was turned off after build()), the table can't be used.
+    */
+   const std::vector<uint32_t> &getRuleIdxs() const
+   {
+      return m_ruleIdxs;
+   }
+
+   /**
+    *  @brief Find out which Rule matches each cell of the IntGrid.
+    *
+    *  @param[in] cells The IntGrid to check.
+    *  @param[out] outMatches One Match per cell, in the same order as the cells of the IntGrid.
+    */
+   void lookUp(const IntGrid &cells, std::vector<Match> &outMatches) const;
+
+private:
+
+   /**
+    *  @brief What each cell counts as, in the 9-bit index.
+    */
+   enum CellClass : uint8_t
+   {
+      CLASS_UNSET = 0,
+      CLASS_SET = 1,
+
+      /**
+       *  @brief Has an IntGridValue that can't be put in the 9-bit index.
+       */
+      CLASS_UNKNOWN = 2,
+   };
+
+   CellClass getCellClass(const intgridvalue_t value) const;
+
+   /**
+    *  @brief The one IntGridValue the patterns check for. Only used if m_checksValue is true.
+    */
+   intgridvalue_t m_value;
+
+   /**
+    *  @brief Whether a pattern checks for m_value.
+    */
+   bool m_checksValue;
+
+   /**
+    *  @brief Whether a pattern uses RULE_PATTERN_ANYTHING or RULE_PATTERN_NOTHING.
+    */
+   bool m_checksNonZero;
+
+   /**
+    *  @brief Largest radius (patternSize / 2) of the patterns. Either 0 or 1.
+    */
+   int m_radius;
+
+   std::vector<uint32_t> m_ruleIdxs;
+
+   /**
+    *  @brief ENTRY_COUNT entries if built, empty otherwise.
+    */
+   std::vector<Match> m_entries;
+};
+
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_NEIGHBOURHOOD_TABLE_H
@@ -0,0 +1,116 @@
+#ifndef LDTK_IMPORT_PARALLEL_UTILITY_H
+#define LDTK_IMPORT_PARALLEL_UTILITY_H
+
+#include <cstddef>
+#include <exception>
+
+#if !defined(LDTK_IMPORT_NO_THREADS)
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+
+namespace ldtkimport
+{
+namespace ParallelUtility
+{
+
+/**
+ *  @brief How many threads to use if the caller asks for 0 (i.e. "as many as makes sense").
+ *  Define LDTK_IMPORT_NO_THREADS to make everything run on the calling thread.
+ */
+static inline unsigned int getDefaultThreadCount()
+{
+#if !defined(LDTK_IMPORT_NO_THREADS)
+   unsigned int threadCount = std::thread::hardware_concurrency();
+   return threadCount > 0 ? threadCount : 1;
+#else
+   return 1;
+#endif
+}
+
+/**
+ *  @brief Call func(idx) for each idx from 0 to (count - 1), spread over multiple threads.
+ *
+ *  @param[in] count How many times to call func.
+ *  @param[in] threadCount How many threads to use, including the calling thread. 0 means getDefaultThreadCount().
+ *                         With 1, everything is done on the calling thread, in order.
+ *  @param[in] func What to call. Different threads will call it at the same time,
+ *                  so it should only ever write to data that belongs to the idx it was given.
+ *
+ *  @details Each idx is given to whichever thread is free next, so an idx that takes long
+ *  doesn't hold up the rest. This returns once all calls are done. If a call throws,
+ *  the remaining indices are skipped and the first exception is rethrown here.
+ */
+template <typename Func>
+static inline void parallelFor(const size_t count, unsigned int threadCount, Func &&func)
+{
+   if (threadCount == 0)
+   {
+      threadCount = getDefaultThreadCount();
+   }
+   if (threadCount > count)
+   {
+      threadCount = static_cast<unsigned int>(count);
+   }
+
+#if !defined(LDTK_IMPORT_NO_THREADS)
+   if (threadCount > 1)
+   {
+      std::atomic<size_t> nextIdx(0);
+      std::exception_ptr firstException;
+      std::mutex exceptionMutex;
+
+      auto work = [&]()
+      {
+         for (size_t idx = nextIdx++; idx < count; idx = nextIdx++)
+         {
+            try
+            {
+               func(idx);
+            }
+            catch (...)
+            {
+               std::lock_guard<std::mutex> lock(exceptionMutex);
+               if (!firstException)
+               {
+                  firstException = std::current_exception();
+               }
+               // make the other threads stop picking up work
+               nextIdx = count;
+            }
+         }
+      };
+
+      std::vector<std::thread> threads;
+      threads.reserve(threadCount - 1);
+      for (unsigned int n = 1; n < threadCount; ++n)
+      {
+         threads.emplace_back(work);
+      }
+      work();
+      for (auto thread = threads.begin(), end = threads.end(); thread != end; ++thread)
+      {
+         thread->join();
+      }
+
+      if (firstException)
+      {
+         std::rethrow_exception(firstException);
+      }
+      return;
+   }
+#endif
+
+   for (size_t idx = 0; idx < count; ++idx)
+   {
+      func(idx);
+   }
+}
+
+} // namespace ParallelUtility
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_PARALLEL_UTILITY_H
@@ -0,0 +1,140 @@
+#ifndef LDTK_IMPORT_PLACEMENT_HISTORY_H
+#define LDTK_IMPORT_PLACEMENT_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ldtkimport/Types.h"
+#include "ldtkimport/IntGridPlanes.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief Which cells each Rule of one Layer placed its tiles on, the last time the Rules were run on a Level.
+ *  Used by LdtkDefFile::runRulesIncremental to only run the Rules again around the cells that changed.
+ *
+ *  @details Whether a Rule places its tiles on a cell depends on the cell's neighbourhood in the IntGrid,
+ *  the random seed, and whether the cell was already finalized by the Rules before it. Cells far from
+ *  a change in the IntGrid keep the same neighbourhood, so as long as they also keep being finalized
+ *  at the same point, the Rules do the same thing on them as last time, which is what this remembers.
+ */
+struct PlacementHistory
+{
+   using word_t = IntGridPlanes::word_t;
+
+   PlacementHistory() :
+      ruleIdxs(),
+      ruleRevisions(),
+      randomSeed(0),
+      runSettings(0),
+      width(0),
+      height(0),
+      wordsPerRow(0),
+      placed()
+   {
+   }
+
+   void clear()
+   {
+      ruleIdxs.clear();
+      ruleRevisions.clear();
+      randomSeed = 0;
+      runSettings = 0;
+      width = 0;
+      height = 0;
+      wordsPerRow = 0;
+      placed.clear();
+   }
+
+   /**
+    *  @brief Start over, for the given Rules (and their revisions, see CompiledRules::ruleRevisions),
+    *  random seed, and grid size. Nothing is marked as placed.
+    */
+   void reset(const std::vector<uint32_t> &newRuleIdxs, const std::vector<uint64_t> &newRuleRevisions,
+      uint32_t newRandomSeed, uint8_t newRunSettings, dimensions_t newWidth, dimensions_t newHeight)
+   {
+      ruleIdxs = newRuleIdxs;
+      ruleRevisions = newRuleRevisions;
+      randomSeed = newRandomSeed;
+      runSettings = newRunSettings;
+      width = newWidth;
+      height = newHeight;
+      wordsPerRow = (static_cast<size_t>(newWidth) + IntGridPlanes::WORD_BITS - 1) / IntGridPlanes::WORD_BITS;
+      placed.assign(ruleIdxs.size() * wordsPerRow * newHeight, 0);
+   }
+
+   /**
+    *  @brief Whether this has what the Rules did on a grid of this size, for exactly these Rules, in this order,
+    *  at these revisions, with this random seed. A Rule edited with LdtkDefFile::replaceRule gets a new revision,
+    *  so then the Rules have to be run on the whole Level again.
+    */
+   bool isFilledFor(const std::vector<uint32_t> &runRuleIdxs, const std::vector<uint64_t> &runRuleRevisions,
+      uint32_t runRandomSeed, uint8_t runRunSettings, dimensions_t runWidth, dimensions_t runHeight) const
+   {
+      return !placed.empty() && randomSeed == runRandomSeed && runSettings == runRunSettings &&
+         width == runWidth && height == runHeight && ruleIdxs == runRuleIdxs && ruleRevisions == runRuleRevisions;
+   }
+
+   /**
+    *  @brief Get the placed cells of one row for one Rule, one bit per cell.
+    *
+    *  @param[in] ruleNum Which Rule, counting in the order they're applied (i.e. index in ruleIdxs).
+    */
+   word_t *getRow(size_t ruleNum, int cellY)
+   {
+      return placed.data() + (((ruleNum * height) + cellY) * wordsPerRow);
+   }
+
+   const word_t *getRow(size_t ruleNum, int cellY) const
+   {
+      return placed.data() + (((ruleNum * height) + cellY) * wordsPerRow);
+   }
+
+   bool wasPlaced(size_t ruleNum, int cellX, int cellY) const
+   {
+      return (getRow(ruleNum, cellY)[cellX / IntGridPlanes::WORD_BITS] & (word_t(1) << (cellX % IntGridPlanes::WORD_BITS))) != 0;
+   }
+
+   void setPlaced(size_t ruleNum, int cellX, int cellY, bool isPlaced)
+   {
+      word_t &word = getRow(ruleNum, cellY)[cellX / IntGridPlanes::WORD_BITS];
+      const word_t bit = word_t(1) << (cellX % IntGridPlanes::WORD_BITS);
+      if (isPlaced)
+      {
+         word |= bit;
+      }
+      else
+      {
+         word &= ~bit;
+      }
+   }
+
+   /**
+    *  @brief Index of each Rule that was run (counting through all RuleGroups), in the order they're applied.
+    */
+   std::vector<uint32_t> ruleIdxs;
+
+   /**
+    *  @brief Revision of each Rule in ruleIdxs, at the time it was run (see CompiledRules::ruleRevisions).
+    */
+   std::vector<uint64_t> ruleRevisions;
+
+   uint32_t randomSeed;
+   uint8_t runSettings;
+   dimensions_t width;
+   dimensions_t height;
+   size_t wordsPerRow;
+
+   /**
+    *  @brief One bit per cell for each Rule in ruleIdxs, set if the Rule placed its tiles on that cell
+    *  (i.e. that cell matched, and wasn't finalized yet). Each Rule has height rows of wordsPerRow words.
+    */
+   std::vector<word_t> placed;
+};
+
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_PLACEMENT_HISTORY_H
@@ -10,6 +10,7 @@
 #include "ldtkimport/Types.h"
 #include "ldtkimport/TileFlags.h"
 #include "ldtkimport/IntGrid.h"
+#include "ldtkimport/IntGridPlanes.h"
 #include "ldtkimport/IntGridValue.h"
 #include "ldtkimport/TileGrid.h"
 
@@ -41,6 +42,14 @@ static const uint8_t RandomizeSeeds = 1 << 0;
  */
 static const uint8_t FasterStampBreakOnMatch = 1 << 1;
 
+/**
+ *  @brief Pass this to LdtkDefFile::runRules to remember which Rule matched each distinct
+ *  neighbourhood of cells, so cells with the same neighbourhood don't need the Rules checked again.
+ *  This helps levels that have large areas of the same IntGridValue, but it's only
+ *  used on layers where every Rule is Rule::isCellLocal. See MatchMemo.
+ */
+static const uint8_t MemoizeMatches = 1 << 2;
+
 /**
  *  @brief Whether a runSettings int has RandomizeSeeds.
  */
@@ -57,6 +66,14 @@ static inline bool hasFasterStampBreakOnMatch(const uint8_t flags)
    return (flags & FasterStampBreakOnMatch) == FasterStampBreakOnMatch;
 }
 
+/**
+ *  @brief Whether a runSettings int has MemoizeMatches.
+ */
+static inline bool hasMemoizeMatches(const uint8_t flags)
+{
+   return (flags & MemoizeMatches) == MemoizeMatches;
+}
+
 }
 
 /// @warning Any Visual Studio Project making use of ldtkimport should define LDTK_IMPORT_DEBUG_RULE with the same int value as the one defined in the ldtkimport's Solution.props file,
@@ -139,6 +156,21 @@ inline std::ostream &operator<<(std::ostream &os, const RuleLog &rule)
 }
 #endif
 
+namespace RuleResult
+{
+
+/**
+ *  @brief Return value given by Rule::passesRule to indicate that the Rule did not match.
+ */
+static const int8_t Fail = -1;
+
+/**
+ *  @brief Return value given by Rule::passesRule to indicate that the non-flipped version of the Rule matched.
+ */
+static const int8_t Success = 0;
+
+}
+
 /**
  *  @brief Specifies what tile/s to draw for cells that match a specific pattern.
  *
@@ -182,31 +214,48 @@ public:
    {
    }
 
-   bool isValid() const
+   /**
+    *  @brief Check if this Rule has values that can be used in the rule matching process.
+    *
+    *  @param[out] outReason If not null, the reason the Rule isn't valid is written here.
+    */
+   bool isValid(std::ostream *outReason = nullptr) const
    {
       if (xModulo == 0 || yModulo == 0)
       {
          // Modulo should never be 0 because it's used as a divisor.
          // We'll get a divide by zero error if this is used.
-         std::cout << "rule " << uid << " not valid due to modulo: xModulo: " << xModulo << " yModulo: " << yModulo << std::endl;
+         if (outReason != nullptr)
+         {
+            *outReason << "rule " << uid << " not valid due to modulo: xModulo: " << xModulo << " yModulo: " << yModulo << std::endl;
+         }
          return false;
       }
 
       if (active && chance > 0 && tileMode == TileMode::Stamp && stampTileOffsets.size() != tileIds.size())
       {
          // stampTileOffsets not initialized, or has too many values
-         std::cout << "rule " << uid << " not valid due to stampTileOffsets" << std::endl;
+         if (outReason != nullptr)
+         {
+            *outReason << "rule " << uid << " not valid due to stampTileOffsets" << std::endl;
+         }
          return false;
       }
 
       if (randomPosXOffsetMin > randomPosXOffsetMax)
       {
-         std::cout << "rule " << uid << " not valid due to randomPosXOffset's min being greater than max. min: " << randomPosXOffsetMin << " max: " << randomPosXOffsetMax << std::endl;
+         if (outReason != nullptr)
+         {
+            *outReason << "rule " << uid << " not valid due to randomPosXOffset's min being greater than max. min: " << randomPosXOffsetMin << " max: " << randomPosXOffsetMax << std::endl;
+         }
          return false;
       }
       if (randomPosYOffsetMin > randomPosYOffsetMax)
       {
-         std::cout << "rule " << uid << " not valid due to randomPosYOffset's min being greater than max. min: " << randomPosYOffsetMin << " max: " << randomPosYOffsetMax << std::endl;
+         if (outReason != nullptr)
+         {
+            *outReason << "rule " << uid << " not valid due to randomPosYOffset's min being greater than max. min: " << randomPosYOffsetMin << " max: " << randomPosYOffsetMax << std::endl;
+         }
          return false;
       }
 
@@ -214,23 +263,322 @@ public:
       return true;
    }
 
+   /**
+    *  @brief Whether this Rule's result on a cell only depends on the IntGrid values around that cell:
+    *  it has no random chance, modulo, or checker, and when it matches, it places one tile
+    *  right on the matched cell and finalizes it (breakOnMatch, Single tileMode, no offsets).
+    *
+    *  @details If all Rules of a Layer are like this, each cell only ever gets the tile of the
+    *  first Rule that matches it, so the Rules can be checked one cell at a time instead of one Rule at a time.
+    *  NeighbourhoodTable and MatchMemo rely on this.
+    */
+   bool isCellLocal() const
+   {
+      return chance >= 1.0f &&
+         xModulo == 1 && yModulo == 1 &&
+         checker == CheckerMode::None &&
+         breakOnMatch &&
+         tileMode == TileMode::Single &&
+         posXOffset == 0 && posYOffset == 0 &&
+         randomPosXOffsetMin == 0 && randomPosXOffsetMax == 0 &&
+         randomPosYOffsetMin == 0 && randomPosYOffsetMax == 0;
+   }
+
+   /**
+    *  @brief Whether this Rule could match anywhere in an IntGrid, going only by which IntGridValues the IntGrid has.
+    *
+    *  @details A pattern that needs a certain IntGridValue can't match if no cell has it
+    *  (unless the out-of-bounds values could stand in for it). The same goes for RULE_PATTERN_ANYTHING
+    *  when every cell is empty, RULE_PATTERN_NOTHING when no cell is, and "anything but" a value when every cell has that value.
+    *  LdtkDefFile::runRulesOnLayer uses this to leave out Rules that wouldn't do anything.
+    *
+    *  @param[in] valueCounts How many cells have each IntGridValue, using the IntGridValue as the index.
+    *                         IntGridValues past the end count as 0. See Level::getIntGridValueCounts.
+    *  @param[in] cellCount How many cells the IntGrid has.
+    *  @return false if this Rule can't match any cell.
+    */
+   bool canMatchValueCounts(const std::vector<uint32_t> &valueCounts, const size_t cellCount) const;
+
+   /**
+    *  @brief Whether this Rule matches (and finalizes) every cell that a later Rule in the same Layer could match,
+    *  so the later Rule would never get to place anything.
+    *
+    *  @details This has to be Rule::isCellLocal with at least one tile, so that each cell it matches gets a
+    *  TileFlags::Final tile right there. Then each value in its pattern has to be implied by the later Rule's value
+    *  at the same spot (including what the out-of-bounds values would give), and it has to allow at least
+    *  the same flipped versions. This only looks at the Rules themselves, so it doesn't know if either of them is active.
+    *
+    *  @param[in] laterRule A Rule that gets applied after this one.
+    */
+   bool shadows(const Rule &laterRule) const;
+
+   /**
+    *  @brief A hash of everything about this Rule that affects which tiles it places, except whether it's active.
+    *  LdtkDefFile uses this to tell if the Rules were edited since they were compiled (see CompiledRules::ruleHashes).
+    *
+    *  @details Whether the Rule is active is left out, since the compiled Rules already work
+    *  for any Rule being turned on or off. stampTileOffsets is left out, since it's computed from the other values.
+    */
+   uint64_t getCompileHash() const;
+
+   /**
+    *  @brief Get the value at the center of the pattern, which is the one that checks the cell being matched.
+    *  Every flipped version of the pattern has the same center. This is 0 (meaning any value is fine) if the pattern isn't the right size.
+    */
+   pattern_t getPatternCenter() const
+   {
+      if (pattern.size() != static_cast<size_t>(patternSize) * patternSize)
+      {
+         return 0;
+      }
+      const size_t radius = patternSize / 2;
+      return pattern[radius + (radius * patternSize)];
+   }
+
+   /**
+    *  @brief How many cells away from a matched cell this Rule can place a tile, counting its
+    *  offsets (at their largest), its stamp, and the one cell a stamp tile can be moved over
+    *  to keep the z-order (see placeTiles).
+    *
+    *  @param[in] cellPixelSize Width and height of each cell in pixels, from the Layer.
+    */
+   int getPlacementReach(const dimensions_t cellPixelSize) const;
+
+   /**
+    *  @brief Whether the center of the pattern allows a cell to have the given IntGridValue.
+    *  If not, this Rule can't match that cell.
+    */
+   bool passesPatternCenter(const intgridvalue_t value) const;
+
+   /**
+    *  @brief One non-zero value of the pattern, converted into a check on an IntGridPlanes bitplane.
+    */
+   struct PlaneCheck
+   {
+      /**
+       *  @brief Position of the cell to check, relative to the cell being matched.
+       */
+      int8_t x;
+      int8_t y;
+
+      /**
+       *  @brief Which bitplane to check.
+       */
+      uint16_t planeIdx;
+
+      /**
+       *  @brief When true, the check passes if the bit is not set.
+       */
+      bool negate;
+
+      /**
+       *  @brief Result of this check when the cell to check is in the halo, to the left or right of the IntGrid.
+       *  Always false if horizontalOutOfBoundsValue is -1.
+       */
+      bool passesHorizontalOutOfBounds;
+
+      /**
+       *  @brief Result of this check when the cell to check is in the halo, above or below (or diagonally outside) the IntGrid.
+       *  Always false if verticalOutOfBoundsValue is -1.
+       */
+      bool passesVerticalOutOfBounds;
+   };
+
+   /**
+    *  @brief How many versions of the pattern compileChecks() makes.
+    *  In order: non-flipped, flipped both horizontally and vertically, flipped horizontally, flipped vertically.
+    *  This is the same order passesRule checks them.
+    */
+   static constexpr int ORIENTATION_COUNT = 4;
+
+   /**
+    *  @brief Compile the pattern into PlaneChecks, skipping the pattern values that are 0.
+    *
+    *  @details All ORIENTATION_COUNT versions of the pattern are appended to outChecks one after
+    *  the other (each the same length), with the offsets already mirrored for the flipped versions.
+    *  The flipped versions are always made, even if the Rule doesn't use flipX or flipY.
+    *
+    *  @param[in] planeValues IntGridValues that will have a bitplane, in the order given to IntGridPlanes::build.
+    *                         Must not have duplicates or 0. IntGridValues not in here are treated as if no cell has them.
+    *  @param[out] outChecks Where the checks are appended to.
+    *  @return How many checks there are in each version of the pattern.
+    */
+   uint16_t compileChecks(const std::vector<intgridvalue_t> &planeValues, std::vector<PlaneCheck> &outChecks) const;
+
    /**
     *  @brief Apply this Rule for the entire IntGrid, assigning the tiles to draw for each cell.
     *
     *  @param[out] tileGrid All rules that successfuly match will place Tile Id values here.
     *  @param[in] cells The data that indicates what IntGridValue is in each cell.
     *                   These are the values that a rule's pattern is compared against.
+    *  @param[in] planes The same IntGrid, split into bitplanes. This is what the pattern is actually
+    *                    checked against. It needs to have been built with the same planeValues given to compileChecks(),
+    *                    and a halo at least as wide as this Rule's pattern radius.
+    *  @param[in] checks This Rule's compiled pattern, from compileChecks().
+    *  @param[in] checkCount Return value of compileChecks().
     *  @param[in] randomSeed Used when a rule uses random chance.
     *  @param[in] rulePriority The priority of the rule being applied.
     *                          Priority determines whether the tiles applied by the rule should
     *                          visually be on top of other tiles (that are placed by other rules) on the same cell.
     *                          Lower values have higher priority. Starts at 0 (highest priority).
+    *  @param[in] threadCount How many threads to use, including the calling thread. 0 means one per CPU core.
+    *                         With more than one, the rows are matched in horizontal bands at the same time (see matchRule),
+    *                         then the tiles are placed one row after another (see placeMatches). The result is the same either way.
     */
    void applyRule(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
       RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
 #endif
-      TileGrid &tileGrid, const IntGrid &cells, const int randomSeed, const dimensions_t cellPixelSize,  const uint8_t rulePriority, const uint8_t runSettings) const;
+      TileGrid &tileGrid, const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+      const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings,
+      const unsigned int threadCount = 1) const;
+
+   /**
+    *  @brief Apply this Rule on some rows of the IntGrid only, same as applyRule does with one thread.
+    *  Calling this on one range of rows after another, in order from the top, gives the same result
+    *  as calling applyRule once. Used to split up running a Rule over multiple calls (see RuleRunner).
+    *
+    *  @param[in] rowBegin Y-coordinate of the first row to apply the Rule on.
+    *  @param[in] rowEnd Y-coordinate past the last row to apply the Rule on.
+    *
+    *  @details The other parameters are the same as in applyRule. Unlike applyRule,
+    *  this doesn't clear the RuleLog's matchedCells first, and doesn't check the sizes of the grids.
+    */
+   void applyRuleOnRows(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+      TileGrid &tileGrid, const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+      const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings,
+      const int rowBegin, const int rowEnd) const;
+
+   /**
+    *  @brief Which cells a Rule's pattern matched on the entire IntGrid, before any tiles are placed.
+    *
+    *  @details Each row of the IntGrid is packed into 64-bit words, same as in IntGridPlanes,
+    *  and the rows are one after the other.
+    */
+   struct Matches
+   {
+      /**
+       *  @brief How many words each row has.
+       */
+      size_t wordsPerRow = 0;
+
+      /**
+       *  @brief One bit per cell, set if any version of the pattern matched, and the cell passed the modulo and checker filter.
+       *  This doesn't take random chance, or cells that are already finalized, into account.
+       */
+      std::vector<IntGridPlanes::word_t> matched;
+
+      /**
+       *  @brief One bit per cell, set if the version of the pattern that matched was flipped horizontally.
+       */
+      std::vector<IntGridPlanes::word_t> matchedFlippedX;
+
+      /**
+       *  @brief One bit per cell, set if the version of the pattern that matched was flipped vertically.
+       */
+      std::vector<IntGridPlanes::word_t> matchedFlippedY;
+   };
+
+   /**
+    *  @brief First half of applyRule: find which cells this Rule matches, without placing any tiles.
+    *
+    *  @details This only reads from the IntGrid, so it can be done for many Rules at the same time.
+    *  Afterwards, call placeMatches on each Rule, in the order the Rules would have been applied,
+    *  to get the same result as applyRule.
+    *
+    *  @param[in] cells The data that indicates what IntGridValue is in each cell.
+    *  @param[in] planes The same IntGrid, split into bitplanes (see applyRule).
+    *  @param[in] checks This Rule's compiled pattern, from compileChecks().
+    *  @param[in] checkCount Return value of compileChecks().
+    *  @param[in] randomSeed Used when a rule uses random chance.
+    *  @param[out] outMatches Where the result is placed.
+    *  @param[in] threadCount How many threads to use, including the calling thread. 0 means one per CPU core.
+    *                         The rows are split into horizontal bands that are matched at the same time.
+    *                         When LDTK_IMPORT_DEBUG_RULE > 1, this is always done on the calling thread.
+    *  @param[in] finalized If given, cells that are already finalized in this TileGrid are left out,
+    *                       since placeMatches would skip them anyway. It's only read from, and
+    *                       shouldn't have tiles placed on it until this returns.
+    */
+   void matchRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RuleLog &ruleLog,
+#endif
+      const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+      const int randomSeed, Matches &outMatches, const unsigned int threadCount = 1, const TileGrid *finalized = nullptr) const;
+
+   /**
+    *  @brief Second half of applyRule: place this Rule's tiles on the cells that matchRule found,
+    *  skipping cells that are already finalized, and the ones that fail the random chance.
+    *
+    *  @param[out] tileGrid All rules that successfuly match will place Tile Id values here.
+    *  @param[in] matches Result of matchRule.
+    *  @param[in] randomSeed Should be the same one given to matchRule.
+    *  @param[in] rulePriority The priority of the rule being applied (see applyRule).
+    *  @param[out] outPlaced If given, the bit of each cell this Rule placed its tiles on is set here,
+    *                        laid out the same way as Matches::matched. Other bits are left as they are.
+    */
+   void placeMatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+      TileGrid &tileGrid, const Matches &matches,
+      const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings,
+      IntGridPlanes::word_t *outPlaced = nullptr) const;
+
+   /**
+    *  @brief Apply this Rule on one cell only. The cell is checked one pattern value at a time
+    *  (see passesRule), so this doesn't need the IntGridPlanes.
+    *
+    *  @details This is for the cells that a NeighbourhoodTable can't handle.
+    *  The cell is assumed to not be finalized yet.
+    *
+    *  @return true if the Rule matched (and its tiles were placed).
+    */
+   bool applyRuleOnCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+      TileGrid &tileGrid, const IntGrid &cells, const int cellX, const int cellY,
+      const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings) const;
+
+   /**
+    *  @brief Place this Rule's tiles on one cell that's already known to match, e.g. from a NeighbourhoodTable.
+    *
+    *  @param[in] matchFlags TileFlags::FlippedX and/or TileFlags::FlippedY if a flipped version of the Rule matched.
+    */
+   void placeMatchedCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+      TileGrid &tileGrid, const int cellX, const int cellY, const uint8_t matchFlags,
+      const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings) const;
+
+   /**
+    *  @brief Check if this Rule matches the given cell coordinates.
+    *  It will also properly check modulo, checker, and the flipped versions of the Rule if needed.
+    *
+    *  @note applyRule doesn't use this, it checks entire rows at a time with the IntGridPlanes instead.
+    *  This is kept as the reference implementation, and is used to double-check the results
+    *  when LDTK_IMPORT_DEBUG_RULE > 1. It's also used for the cells that LdtkDefFile::runRulesOnLayer
+    *  goes through one at a time (see NeighbourhoodTable and MatchMemo).
+    *
+    *  @param[in] cells The data that indicates what IntGridValue is in each cell.
+    *                   These are the values that a rule's pattern is compared against.
+    *  @param[in] cellX X-coordinate of the cell we're checking a match for.
+    *  @param[in] cellY Y-coordinate of the cell we're checking a match for.
+    *  @param[in] randomSeed Used when a rule uses random chance.
+    *  @return RuleResult::Fail if this Rule didn't match the cell with specified X and Y coordinates.
+    *          Otherwise, TileFlags indicating if it was the horizontally and/or vertically flipped version
+    *          of the Rule that matched, if ever.
+    */
+   int8_t passesRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+      RuleLog &ruleLog,
+#endif
+      const IntGrid &cells, const int cellX, const int cellY, const int randomSeed) const;
 
    /**
     *  @brief Unique identifier for this rule. Also contributes to the seed in pseudo-random number checks.
@@ -639,6 +987,151 @@ public:
 
 private:
 
+   /**
+    *  @brief Check one row of cells for matches, 64 cells at a time.
+    *
+    *  @param[in] planes The IntGrid, split into bitplanes.
+    *  @param[in] checks One version of this Rule's compiled pattern.
+    *  @param[in] checkCount How many checks there are in that version.
+    *  @param[in] cellY Which row to check.
+    *  @param[in,out] matched One bit per cell of the row. Only the cells whose bits are set are checked.
+    *                         Afterwards, only the bits of the cells that matched remain set.
+    */
+   void matchRow(
+      const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount, const int cellY,
+      IntGridPlanes::word_t *matched) const;
+
+   /**
+    *  @brief Fewest rows in each band when matchRule splits the rows between threads.
+    */
+   static constexpr int MATCH_BAND_MIN_ROWS = 8;
+
+   /**
+    *  @brief Match the rows from rowBegin (inclusive) to rowEnd (exclusive), for matchRule.
+    *  Only writes to those rows of outMatches, which should already have been sized.
+    */
+   void matchRows(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+      RuleLog &ruleLog,
+#endif
+      const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+      const int randomSeed, const int rowBegin, const int rowEnd, const TileGrid *finalized, Matches &outMatches) const;
+
+   /**
+    *  @brief Check all versions of the pattern (non-flipped, and flipped if allowed) on one row of cells.
+    *
+    *  @param[in] cellY Which row to check.
+    *  @param[in] columns One bit per cell of the row. Only the cells whose bits are set are checked.
+    *  @param[out] matched One bit per cell of the row, set if any version of the pattern matched.
+    *  @param[out] matchedFlippedX One bit per cell of the row, set if the version that matched was flipped horizontally.
+    *  @param[out] matchedFlippedY One bit per cell of the row, set if the version that matched was flipped vertically.
+    *  @param[out] scratch Temporary storage, one word per word of the row.
+    */
+   void matchRowOrientations(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+      RuleLog &ruleLog,
+#endif
+      const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+      const int randomSeed, const int cellY, const IntGridPlanes::word_t *columns,
+      IntGridPlanes::word_t *matched, IntGridPlanes::word_t *matchedFlippedX, IntGridPlanes::word_t *matchedFlippedY,
+      IntGridPlanes::word_t *scratch) const;
+
+   /**
+    *  @brief Place this Rule's tiles on the cells of a row that matched, from left to right.
+    *
+    *  @param[in] cellY Which row the cells are in.
+    *  @param[in] wordLen How many words the row has.
+    *  @param[in] matched One bit per cell of the row, set if the cell matched.
+    *  @param[in] matchedFlippedX One bit per cell of the row, set if the cell matched with the pattern flipped horizontally.
+    *  @param[in] matchedFlippedY One bit per cell of the row, set if the cell matched with the pattern flipped vertically.
+    *  @param[out] outPlaced If not null, one bit per cell of the row, set for each cell that got this Rule's tiles.
+    */
+   void placeRow(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+      TileGrid &tileGrid, const int cellY, const size_t wordLen, const IntGridPlanes::word_t *matched,
+      const IntGridPlanes::word_t *matchedFlippedX, const IntGridPlanes::word_t *matchedFlippedY,
+      const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings,
+      IntGridPlanes::word_t *outPlaced) const;
+
+   /**
+    *  @brief Get which rows can pass the Y modulo: from outRowStart, every outRowStep rows.
+    */
+   void getRowRange(int &outRowStart, int &outRowStep) const;
+
+   /**
+    *  @brief Whether the given cell coordinates pass the modulo and checker filter.
+    */
+   bool passesModulo(const int cellX, const int cellY) const;
+
+   /**
+    *  @brief Get which cells of a row pass the modulo and checker filter.
+    *  This only steps through the columns that can pass, instead of checking every cell.
+    *
+    *  @param[in] planes The IntGrid, split into bitplanes.
+    *  @param[in] cellY Which row to check. Should already pass the Y modulo (unless the vertical checker is used).
+    *  @param[out] outColumns One bit per cell of the row, set if the cell passes.
+    *  @return false if no cell in the row passes.
+    */
+   bool getModuloColumns(const IntGridPlanes &planes, const int cellY, IntGridPlanes::word_t *outColumns) const;
+
+   /**
+    *  @brief How many rows skipEmptyBlocks checks at a time.
+    */
+   static constexpr int SKIP_BLOCK_ROWS = 16;
+
+   /**
+    *  @brief Whether any cell in a rectangle could match one of the versions of the pattern, going by how many bits
+    *  are set in each PlaneCheck's bitplane around it. The edges are inclusive.
+    *
+    *  @details This is only a quick check: if it returns true, the cells still need to be matched.
+    *  But if it returns false, none of them can match. E.g. a pattern that needs a certain IntGridValue
+    *  can't match anywhere near where that IntGridValue isn't, and a RULE_PATTERN_NOTHING can't
+    *  match anywhere where every cell has an IntGridValue.
+    */
+   bool canMatchBlock(const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+      const int left, const int top, const int right, const int bottom) const;
+
+   /**
+    *  @brief Take out cells from a row that can't match, SKIP_BLOCK_ROWS rows and 64 cells at a time,
+    *  using the summed-area tables of the IntGridPlanes. Does nothing if the IntGridPlanes don't have them.
+    *
+    *  @param[in] cellY Which row columns is for. Needs to go from top to bottom between calls.
+    *  @param[in,out] blockBottom Last row that blockColumns was worked out for. Start with -1.
+    *  @param[in,out] blockColumns One word per word of the row, all bits set if any cell in the block could match, 0 if not.
+    *  @param[in,out] columns One bit per cell of the row. Cells that can't match are taken out.
+    *  @return false if no cell in the row is left.
+    */
+   bool skipEmptyBlocks(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+      RuleLog &ruleLog,
+#endif
+      const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+      const int randomSeed, const int cellY, int &blockBottom, IntGridPlanes::word_t *blockColumns, IntGridPlanes::word_t *columns) const;
+
+   /**
+    *  @brief Whether the given cell coordinates pass the random chance check.
+    */
+   bool passesChance(const int cellX, const int cellY, const int randomSeed) const;
+
+   /**
+    *  @brief Place this Rule's tile/s on a cell that the Rule matched.
+    *
+    *  @param[out] tileGrid Where the tiles are placed.
+    *  @param[in] cellX X-coordinate of the cell that matched.
+    *  @param[in] cellY Y-coordinate of the cell that matched.
+    *  @param[in] matchFlags TileFlags::FlippedX and/or TileFlags::FlippedY if a flipped version of the Rule matched.
+    *  @param[in] randomSeed Used when a rule uses random chance.
+    *  @param[in] rulePriority The priority of the rule being applied.
+    */
+   void placeTiles(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+      TileGrid &tileGrid, const int cellX, const int cellY, const uint8_t matchFlags,
+      const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings) const;
+
    /**
     *  @brief Check if this Rule matches the given cell coordinates.
     *  @param[out] debugLog Only used for debugging. The Rule will log what happened in the matching process here.
@@ -656,25 +1149,6 @@ private:
       std::ostream &debugLog,
 #endif
       const IntGrid &cells, const int cellX, const int cellY, const int8_t directionX, const int8_t directionY, const int randomSeed) const;
-
-   /**
-    *  @brief Check if this Rule matches the given cell coordinates.
-    *  It will also properly check modulo, checker, and the flipped versions of the Rule if needed.
-    *
-    *  @param[in] cells The data that indicates what IntGridValue is in each cell.
-    *                   These are the values that a rule's pattern is compared against.
-    *  @param[in] cellX X-coordinate of the cell we're checking a match for.
-    *  @param[in] cellY Y-coordinate of the cell we're checking a match for.
-    *  @param[in] randomSeed Used when a rule uses random chance.
-    *  @return Bitflags indicating whether this Rule matched the cell with specified X and Y coordinates.
-    *          The flag will also indicate if it was the horizontally and/or vertically flipped version
-    *          of the Rule that matched, if ever.
-    */
-   int8_t passesRule(
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
-      RuleLog &ruleLog,
-#endif
-      const IntGrid &cells, const int cellX, const int cellY, const int randomSeed) const;
 };
 
 inline std::ostream &operator<<(std::ostream &os, const Rule &rule)
@@ -0,0 +1,150 @@
+#ifndef LDTK_IMPORT_RULE_CHECKPOINTS_H
+#define LDTK_IMPORT_RULE_CHECKPOINTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ldtkimport/Types.h"
+#include "ldtkimport/TileInCell.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief The tiles each Rule of one Layer placed, the last time the Rules were run on a Level.
+ *  Used by LdtkDefFile::runRulesOnLayer so that after a Rule is edited (see LdtkDefFile::replaceRule),
+ *  only that Rule and the ones after it have to be run again.
+ *
+ *  @details What a Rule places only depends on the IntGrid, the random seed, and the tiles placed by the Rules
+ *  before it. So as long as those stay the same, the state of the TileGrid right before any Rule can be
+ *  brought back by putting the tiles of the Rules before it back in the same order, which is what this keeps.
+ *  Only the tiles are kept (not a copy of the TileGrid for each Rule), so this takes about as much memory as the TileGrid.
+ *
+ *  The tiles are only for the IntGrid they were made with. If it changes, call clear().
+ */
+struct RuleCheckpoints
+{
+   RuleCheckpoints() :
+      ruleIdxs(),
+      ruleRevisions(),
+      randomSeed(0),
+      runSettings(0),
+      width(0),
+      height(0),
+      tileStarts(),
+      cellIdxs(),
+      tiles()
+   {
+   }
+
+   void clear()
+   {
+      ruleIdxs.clear();
+      ruleRevisions.clear();
+      randomSeed = 0;
+      runSettings = 0;
+      width = 0;
+      height = 0;
+      tileStarts.clear();
+      cellIdxs.clear();
+      tiles.clear();
+   }
+
+   /**
+    *  @brief How many of the given Rules, counting from the first one, are the same as last time,
+    *  i.e. how many Rules' tiles can be put back instead of running those Rules again.
+    *
+    *  @param[in] runRuleIdxs Index of each Rule that will be run (counting through all RuleGroups), in the order they're applied.
+    *  @param[in] runRuleRevisions Revision of each Rule in runRuleIdxs (see CompiledRules::ruleRevisions).
+    */
+   size_t getReusableRuleCount(const std::vector<uint32_t> &runRuleIdxs, const std::vector<uint64_t> &runRuleRevisions,
+      uint32_t runRandomSeed, uint8_t runRunSettings, dimensions_t runWidth, dimensions_t runHeight) const
+   {
+      if (tileStarts.size() != ruleIdxs.size() + 1 || randomSeed != runRandomSeed || runSettings != runRunSettings ||
+         width != runWidth || height != runHeight)
+      {
+         return 0;
+      }
+
+      size_t count = 0;
+      while (count < ruleIdxs.size() && count < runRuleIdxs.size() &&
+         ruleIdxs[count] == runRuleIdxs[count] && ruleRevisions[count] == runRuleRevisions[count])
+      {
+         ++count;
+      }
+      return count;
+   }
+
+   /**
+    *  @brief Forget the tiles of every Rule from the given one onwards, and start over
+    *  for the given Rules, keeping the tiles of the Rules before keptRuleCount.
+    */
+   void resume(size_t keptRuleCount, const std::vector<uint32_t> &runRuleIdxs, const std::vector<uint64_t> &runRuleRevisions,
+      uint32_t runRandomSeed, uint8_t runRunSettings, dimensions_t runWidth, dimensions_t runHeight)
+   {
+      if (keptRuleCount == 0)
+      {
+         tileStarts.assign(1, 0);
+         cellIdxs.clear();
+         tiles.clear();
+      }
+      else
+      {
+         tileStarts.resize(keptRuleCount + 1);
+         cellIdxs.resize(tileStarts.back());
+         tiles.resize(tileStarts.back());
+      }
+
+      ruleIdxs = runRuleIdxs;
+      ruleRevisions = runRuleRevisions;
+      randomSeed = runRandomSeed;
+      runSettings = runRunSettings;
+      width = runWidth;
+      height = runHeight;
+   }
+
+   /**
+    *  @brief Mark the end of the next Rule's tiles, after they were added to cellIdxs and tiles.
+    */
+   void endRule()
+   {
+      tileStarts.push_back(static_cast<uint32_t>(tiles.size()));
+   }
+
+   /**
+    *  @brief Index of each Rule that was run (counting through all RuleGroups), in the order they're applied.
+    */
+   std::vector<uint32_t> ruleIdxs;
+
+   /**
+    *  @brief Revision of each Rule in ruleIdxs, at the time it was run (see CompiledRules::ruleRevisions).
+    */
+   std::vector<uint64_t> ruleRevisions;
+
+   uint32_t randomSeed;
+   uint8_t runSettings;
+   dimensions_t width;
+   dimensions_t height;
+
+   /**
+    *  @brief Index in tiles where each Rule's tiles start, for the Rules in ruleIdxs that got their tiles noted down.
+    *  Has one extra value at the end, so that each Rule's tiles end where the next one's starts.
+    */
+   std::vector<uint32_t> tileStarts;
+
+   /**
+    *  @brief Location of each tile in tiles, as an index (see GridUtility::getIndex).
+    */
+   std::vector<uint32_t> cellIdxs;
+
+   /**
+    *  @brief Tiles placed by all the Rules, one Rule after the other, in the order they were placed (see TileGrid::copyPendingTiles).
+    */
+   std::vector<TileInCell> tiles;
+};
+
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_RULE_CHECKPOINTS_H
@@ -0,0 +1,183 @@
+#ifndef LDTK_IMPORT_RULE_RUNNER_H
+#define LDTK_IMPORT_RULE_RUNNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ldtkimport/IntGridPlanes.h"
+#include "ldtkimport/Layer.h"
+#include "ldtkimport/LdtkDefFile.h"
+#include "ldtkimport/Level.h"
+#include "ldtkimport/Rule.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief Runs the Rules of an LdtkDefFile on a Level a little at a time, so that it can be spread over
+ *  multiple frames (e.g. during a transition animation) instead of stopping the game while LdtkDefFile::runRules does it all at once.
+ *
+ *  @details Call start(), then step() or stepFor() once per frame until it returns true. The result is the same
+ *  as calling LdtkDefFile::runRules with the same runSettings, including the random seeds picked for RunSettings::RandomizeSeeds
+ *  (these are all picked in start()). The Rules are run one after another, a few rows of the Level at a time,
+ *  on the calling thread.
+ *
+ *  The LdtkDefFile and the Level need to stay alive, and the LdtkDefFile and the Level's IntGrid unchanged,
+ *  until this is done. The Level's TileGrids aren't complete until then either.
+ */
+class RuleRunner
+{
+public:
+
+   /**
+    *  @brief How many cells stepFor() does between checking how much time it took.
+    */
+   static constexpr size_t CELLS_PER_TIME_CHECK = 1024;
+
+   RuleRunner() :
+      m_ldtkDefFile(nullptr),
+      m_level(nullptr),
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      m_rulesLog(nullptr),
+#endif
+      m_runSettings(0),
+      m_randomSeeds(),
+      m_layerIdx(0),
+      m_isLayerStarted(false),
+      m_compiledNow(),
+      m_isCompiledNow(false),
+      m_rulesToRun(),
+      m_planes(),
+      m_runIdx(0),
+      m_cellY(0)
+   {
+   }
+
+   /**
+    *  @brief Get ready to run the Rules of an LdtkDefFile on a Level. Nothing is run until step() or stepFor() is called.
+    *
+    *  @param[in] ldtkDefFile Where the Rules come from.
+    *  @param[out] level Where output of rule matching process is placed onto. Its TileGrids are cleaned up here.
+    *  @param[in] runSettings Bitwise flags from RunSettings, same as in LdtkDefFile::runRules.
+    *
+    *  @details If the Level has no width or height, there's nothing to do, and isFinished() is true right away.
+    */
+   void start(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      RulesLog &rulesLog,
+#endif
+      const LdtkDefFile &ldtkDefFile, Level &level, const uint8_t runSettings = RunSettings::None);
+
+   /**
+    *  @brief Run the Rules on about maxCells cells, counting each row a Rule goes through as that many cells.
+    *  At least one row is done each time, so this always gets closer to being finished.
+    *
+    *  @details Getting a layer ready (splitting the IntGrid into bitplanes) and moving the placed tiles
+    *  to their cells at the end of a layer (TileGrid::compact) each count as the whole Level's cells.
+    *
+    *  @return true once all the Rules have been run.
+    */
+   bool step(const size_t maxCells);
+
+   /**
+    *  @brief Run the Rules until about budgetMicroseconds has passed, or until done.
+    *  Checks the time every CELLS_PER_TIME_CHECK cells (see step()), so it can go a little over.
+    *
+    *  @return true once all the Rules have been run.
+    */
+   bool stepFor(const uint32_t budgetMicroseconds);
+
+   /**
+    *  @brief Whether all the Rules have been run (or start() was never called).
+    */
+   bool isFinished() const
+   {
+      return m_ldtkDefFile == nullptr || m_layerIdx >= m_randomSeeds.size();
+   }
+
+   /**
+    *  @brief Index of the layer whose Rules are being run.
+    */
+   size_t getLayerIdx() const
+   {
+      return m_layerIdx;
+   }
+
+private:
+
+   /**
+    *  @brief Do the next bit of work: get a layer ready, run a Rule on a few rows, or finish a layer.
+    *
+    *  @param[in] maxCells Roughly how many cells to go through.
+    *  @return How many cells were counted as done.
+    */
+   size_t advance(const size_t maxCells);
+
+   void startLayer();
+
+   void finishLayer();
+
+   /**
+    *  @brief The current layer's compiled Rules, the ones in the Layer or m_compiledNow (see m_isCompiledNow).
+    */
+   const CompiledRules &getCompiledRules() const;
+
+   const LdtkDefFile *m_ldtkDefFile;
+
+   Level *m_level;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog *m_rulesLog;
+#endif
+
+   uint8_t m_runSettings;
+
+   /**
+    *  @brief Random seed of each layer, picked in start().
+    */
+   std::vector<uint32_t> m_randomSeeds;
+
+   /**
+    *  @brief Which layer is being run.
+    */
+   size_t m_layerIdx;
+
+   /**
+    *  @brief Whether startLayer() was done for the layer in m_layerIdx.
+    */
+   bool m_isLayerStarted;
+
+   /**
+    *  @brief The current layer's Rules, if they had to be compiled here (see LdtkDefFile::getCompiledRules).
+    */
+   CompiledRules m_compiledNow;
+
+   /**
+    *  @brief Whether the current layer's Rules are in m_compiledNow instead of the Layer. Kept as a flag rather
+    *  than a pointer to either one, so that the RuleRunner can be copied or moved while it's running.
+    */
+   bool m_isCompiledNow;
+
+   /**
+    *  @brief The current layer's Rules that can match something in the IntGrid, in the order they're applied.
+    */
+   std::vector<LdtkDefFile::RuleToRun> m_rulesToRun;
+
+   IntGridPlanes m_planes;
+
+   /**
+    *  @brief Which Rule in m_rulesToRun is being run.
+    */
+   size_t m_runIdx;
+
+   /**
+    *  @brief The next row the Rule will be run on.
+    */
+   int m_cellY;
+};
+
+} // namespace ldtkimport
+
+#endif // LDTK_IMPORT_RULE_RUNNER_H
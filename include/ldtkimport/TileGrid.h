@@ -1,12 +1,15 @@
 #ifndef LDTK_IMPORT_TILE_GRID_H
 #define LDTK_IMPORT_TILE_GRID_H
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
 #include <sstream>
 
 #include "ldtkimport/AssertUtility.h"
+#include "ldtkimport/CellArea.h"
 #include "ldtkimport/GridUtility.h"
 #include "ldtkimport/Types.h"
 #include "ldtkimport/TileInCell.h"
@@ -22,6 +25,81 @@ namespace ldtkimport
  */
 using tiles_t = std::vector<TileInCell>;
 
+/**
+ *  @brief Read-only view of the tiles in one cell of a TileGrid (see TileGrid::getTiles).
+ *  Same order as tiles_t, first element should be visually on top.
+ *
+ *  @details This only points to the tiles stored in a TileGrid, so it's
+ *  only valid until tiles are placed in or removed from the TileGrid, or it's resized.
+ */
+class TileSpan
+{
+public:
+
+   using value_type = TileInCell;
+   using iterator = const TileInCell *;
+   using const_iterator = const TileInCell *;
+
+   TileSpan() :
+      m_data(nullptr),
+      m_size(0)
+   {
+   }
+
+   TileSpan(const TileInCell *data, size_t size) :
+      m_data(data),
+      m_size(size)
+   {
+   }
+
+   const TileInCell &operator[](size_t idx) const
+   {
+      ASSERT_THROW(idx < m_size, std::out_of_range,
+         "supplied index to a TileSpan is beyond size: " << idx << " (size: " << m_size << ")");
+
+      return m_data[idx];
+   }
+
+   const TileInCell *data() const
+   {
+      return m_data;
+   }
+
+   size_t size() const
+   {
+      return m_size;
+   }
+
+   bool empty() const
+   {
+      return m_size == 0;
+   }
+
+   const_iterator begin() const
+   {
+      return m_data;
+   }
+
+   const_iterator end() const
+   {
+      return m_data + m_size;
+   }
+
+   const_iterator cbegin() const
+   {
+      return m_data;
+   }
+
+   const_iterator cend() const
+   {
+      return m_data + m_size;
+   }
+
+private:
+   const TileInCell *m_data;
+   size_t m_size;
+};
+
 /**
  *  @brief A grid of Tile Id values to be drawn on-screen.
  *
@@ -31,26 +109,69 @@ using tiles_t = std::vector<TileInCell>;
  *  TileGrid allows stacking of tiles in one cell.
  *
  *  The values here are basically tiles that have been placed down after Rules are applied.
+ *
+ *  Tiles placed with putTile are first added to a list in the order they were placed,
+ *  and only moved to their cell once compact() is called, or the tiles are read.
+ *  How the tiles are kept in their cells depends on the Storage (see setStorage).
  */
 class TileGrid
 {
 public:
 
+   using finalword_t = uint64_t;
+
+   static constexpr int FINAL_WORD_BITS = 64;
+
+   /**
+    *  @brief How the tiles of each cell are kept.
+    */
+   enum class Storage
+   {
+      /**
+       *  @brief Each cell has its own tiles_t, which can be read and edited through operator().
+       */
+      PerCell,
+
+      /**
+       *  @brief All tiles are in one array, sorted by cell, with each cell only having the index of where its tiles start.
+       *  Takes a lot less memory and allocations on big levels, but the tiles can only be read through getTiles.
+       */
+      Flat
+   };
+
    TileGrid() :
       m_layerUid(0),
       m_randomSeed(0),
       m_width(0),
       m_height(0),
-      m_grid()
+      m_storage(Storage::PerCell),
+      m_grid(),
+      m_tiles(),
+      m_cellStarts(1, 0),
+      m_pendingTiles(),
+      m_highestPriority(),
+      m_finalWordsPerRow(0),
+      m_finalBits(),
+      m_openCellCount(0),
+      m_openCellsInRow()
    {
    }
 
-   TileGrid(dimensions_t width, dimensions_t height) :
+   TileGrid(dimensions_t width, dimensions_t height, Storage storage = Storage::PerCell) :
       m_layerUid(0),
       m_randomSeed(0),
       m_width(width),
       m_height(height),
-      m_grid(width * height, tiles_t())
+      m_storage(storage),
+      m_grid((storage == Storage::PerCell) ? (width * height) : 0, tiles_t()),
+      m_tiles(),
+      m_cellStarts((storage == Storage::Flat) ? ((width * height) + 1) : 1, 0),
+      m_pendingTiles(),
+      m_highestPriority(width * height, UINT8_MAX),
+      m_finalWordsPerRow(getFinalWordsPerRow(width)),
+      m_finalBits(m_finalWordsPerRow * height, 0),
+      m_openCellCount(static_cast<size_t>(width) * height),
+      m_openCellsInRow(height, width)
    {
    }
 
@@ -69,6 +190,10 @@ public:
     *  @param[in] posYOffset Additional position offset in y-axis. This value is in pixels.
     *  @param[in] flags Bitwise flags of indicators how the tile should be drawn.
     *  @param[in] priority Only used in the rule matching process to fix problems with z-order of stamp tiles.
+    *
+    *  @details This keeps the location's highest priority up to date (see getHighestPriority).
+    *  If flags has TileFlags::Final, the location is also marked as finalized (see canStillPlaceTiles).
+    *  Tiles added through operator() instead of here don't update those.
     */
    void putTile(tileid_t tileId, int cellX, int cellY, int8_t posXOffset, int8_t posYOffset, uint8_t opacity, uint8_t flags, uint8_t priority)
    {
@@ -80,9 +205,23 @@ public:
       size_t cellIdx = GridUtility::getIndex(cellX, cellY, m_width);
 
       ASSERT_THROW(cellIdx >= 0, std::out_of_range, "supplied index is negative: " << cellIdx);
-      ASSERT_THROW(cellIdx < m_grid.size(), std::out_of_range, "supplied index is beyond size: " << cellIdx << " (size: " << m_grid.size() << ")");
+      ASSERT_THROW(cellIdx < size(), std::out_of_range, "supplied index is beyond size: " << cellIdx << " (size: " << size() << ")");
 
-      m_grid[cellIdx].push_back(TileInCell(tileId, posXOffset, posYOffset, opacity, flags, priority));
+      addPendingTile(cellIdx, cellX, cellY, TileInCell(tileId, posXOffset, posYOffset, opacity, flags, priority));
+   }
+
+   /**
+    *  @brief Place a tile that was already made, e.g. one copied with copyPendingTiles.
+    *  Same as the other putTile, but the location is given as an index (see GridUtility::getIndex).
+    */
+   void putTile(size_t cellIdx, const TileInCell &tile)
+   {
+      ASSERT_THROW(cellIdx < size(), std::out_of_range, "supplied index is beyond size: " << cellIdx << " (size: " << size() << ")");
+
+      int cellX;
+      int cellY;
+      GridUtility::getCoordinates(static_cast<int>(cellIdx), m_width, cellX, cellY);
+      addPendingTile(cellIdx, cellX, cellY, tile);
    }
 
    /**
@@ -108,21 +247,44 @@ public:
       ASSERT_THROW(cellY < m_height, std::out_of_range,
          "supplied cellY index to an AppliedRules is beyond height: " << cellY << " (height: " << m_height << ")");
 
-      size_t cellIdx = GridUtility::getIndex(cellX, cellY, m_width);
+      return (getFinalWord(cellX / FINAL_WORD_BITS, cellY) & (finalword_t(1) << (cellX % FINAL_WORD_BITS))) == 0;
+   }
 
-      ASSERT_THROW(cellIdx >= 0, std::out_of_range, "supplied index to an AppliedRules is negative: " << cellIdx);
-      ASSERT_THROW(cellIdx < m_grid.size(), std::out_of_range, "supplied index to an AppliedRules is beyond size: " << cellIdx << " (size: " << m_grid.size() << ")");
+   /**
+    *  @brief Get which of 64 locations in a row have been finalized, i.e. can't have more tiles placed on them.
+    *  Bit n of the result is for the location at x-coordinate ((wordIdx * 64) + n).
+    *  Bits past the width are always 0.
+    *
+    *  @param[in] wordIdx Which group of 64 locations in the row. Goes from 0 to ((width + 63) / 64) - 1.
+    *  @param[in] cellY Y-coordinate of the row. This value is in "grid-space", not pixels. Starts at 0, which is at the top edge of the grid.
+    */
+   finalword_t getFinalWord(size_t wordIdx, int cellY) const
+   {
+      ASSERT(wordIdx < m_finalWordsPerRow, "supplied wordIdx is beyond words per row: " << wordIdx << " (words per row: " << m_finalWordsPerRow << ")");
+      ASSERT(cellY >= 0 && cellY < m_height, "supplied cellY index is out of bounds: " << cellY << " (height: " << m_height << ")");
 
-      tiles_t &tiles = m_grid[cellIdx];
-      for (auto t = tiles.data(), end = tiles.data() + tiles.size(); t != end; ++t)
-      {
-         if (t->isFinal())
-         {
-            return false;
-         }
-      }
+      return m_finalBits[(cellY * m_finalWordsPerRow) + wordIdx];
+   }
 
-      return true;
+   /**
+    *  @brief How many locations can still have more tiles placed on them (see canStillPlaceTiles).
+    *  Once this is 0, no Rule of this Layer can place anything anymore.
+    */
+   size_t getOpenCellCount() const
+   {
+      return m_openCellCount;
+   }
+
+   /**
+    *  @brief How many locations in a row can still have more tiles placed on them (see canStillPlaceTiles).
+    *
+    *  @param[in] cellY Y-coordinate of the row. This value is in "grid-space", not pixels. Starts at 0, which is at the top edge of the grid.
+    */
+   uint32_t getOpenCellCountInRow(int cellY) const
+   {
+      ASSERT(cellY >= 0 && cellY < m_height, "supplied cellY index is out of bounds: " << cellY << " (height: " << m_height << ")");
+
+      return m_openCellsInRow[cellY];
    }
 
    /**
@@ -153,21 +315,93 @@ public:
       size_t cellIdx = GridUtility::getIndex(cellX, cellY, m_width);
 
       ASSERT_THROW(cellIdx >= 0, std::out_of_range, "supplied index to an AppliedRules is negative: " << cellIdx);
-      ASSERT_THROW(cellIdx < m_grid.size(), std::out_of_range, "supplied index to an AppliedRules is beyond size: " << cellIdx << " (size: " << m_grid.size() << ")");
+      ASSERT_THROW(cellIdx < m_highestPriority.size(), std::out_of_range, "supplied index to an AppliedRules is beyond size: " << cellIdx << " (size: " << m_highestPriority.size() << ")");
+
+      return m_highestPriority[cellIdx];
+   }
+
+   /**
+    *  @brief Move the tiles placed with putTile into their cells.
+    *  In each cell, the newly placed tiles go after the ones that were already there, in the order they were placed.
+    *  LdtkDefFile::runRules already does this after running the Rules of each Layer.
+    *
+    *  @details Reading the tiles does this too if it wasn't done yet, so this doesn't need to be called
+    *  before reading. But since that changes how the tiles are stored, don't read the tiles
+    *  from multiple threads at the same time unless this was called first.
+    */
+   void compact()
+   {
+      compactPendingTiles();
+   }
 
-      tiles_t &tiles = m_grid[cellIdx];
-      uint8_t result = UINT8_MAX;
-      for (auto t = tiles.data(), end = tiles.data() + tiles.size(); t != end; ++t)
+   Storage getStorage() const
+   {
+      return m_storage;
+   }
+
+   /**
+    *  @brief Change how the tiles of each cell are kept (see Storage). The tiles stay the same.
+    */
+   void setStorage(Storage storage)
+   {
+      changeStorage(storage);
+   }
+
+   /**
+    *  @brief Checks if there are tiles placed with putTile that haven't been moved to their cells yet.
+    */
+   bool hasPendingTiles() const
+   {
+      return !m_pendingTiles.empty();
+   }
+
+   /**
+    *  @brief How many tiles were placed with putTile since compact() was last called.
+    */
+   size_t getPendingTileCount() const
+   {
+      return m_pendingTiles.size();
+   }
+
+   /**
+    *  @brief Append the tiles placed with putTile that haven't been compacted yet, starting from the given one,
+    *  in the order they were placed. Putting them back with putTile(cellIdx, tile) in the same order gives the same result.
+    *
+    *  @param[in] firstIdx Index of the first pending tile to copy, e.g. what getPendingTileCount() was before placing them.
+    *  @param[out] outCellIdxs Location of each tile, as an index (see GridUtility::getIndex).
+    *  @param[out] outTiles The tiles.
+    */
+   void copyPendingTiles(size_t firstIdx, std::vector<uint32_t> &outCellIdxs, std::vector<TileInCell> &outTiles) const
+   {
+      for (size_t n = firstIdx, len = m_pendingTiles.size(); n < len; ++n)
       {
-         if (t->priority < result)
-         {
-            result = t->priority;
-         }
+         outCellIdxs.push_back(m_pendingTiles[n].cellIdx);
+         outTiles.push_back(m_pendingTiles[n].tile);
       }
-
-      return result;
    }
 
+   /**
+    *  @brief Tiles placed in a location, which works with any Storage.
+    *
+    *  @param[in] idx Index of the location (see GridUtility::getIndex).
+    */
+   TileSpan getTiles(size_t idx) const;
+
+   /**
+    *  @brief Tiles placed in a location, which works with any Storage.
+    *
+    *  @param[in] x X-coordinate of the location. This value is in "grid-space", not pixels. Starts at 0, which is at the left edge of the grid.
+    *  @param[in] y Y-coordinate of the location. This value is in "grid-space", not pixels. Starts at 0, which is at the top edge of the grid.
+    */
+   TileSpan getTiles(int x, int y) const;
+
+   /**
+    *  @brief Tiles placed in a location.
+    *
+    *  @details With Storage::Flat, the non-const version switches the TileGrid to Storage::PerCell first,
+    *  since the tiles of a cell aren't kept in their own tiles_t otherwise. The const version doesn't change
+    *  how the tiles are stored, so it can only be used with Storage::PerCell. Use getTiles to read the tiles with any Storage.
+    */
    tiles_t &operator()(size_t idx);
    const tiles_t &operator()(size_t idx) const;
 
@@ -193,10 +427,57 @@ public:
          return;
       }
 
+      compact();
+
       /// @todo properly move values since we are enlarging/shrinking
-      m_grid.resize(width * height);
+      size_t oldCellCount = size();
+      size_t newCellCount = width * height;
+      if (m_storage == Storage::PerCell)
+      {
+         m_grid.resize(newCellCount);
+      }
+      else if (newCellCount < oldCellCount)
+      {
+         m_tiles.resize(m_cellStarts[newCellCount]);
+         m_cellStarts.resize(newCellCount + 1);
+      }
+      else
+      {
+         // new cells start out empty, i.e. they all start at the end
+         m_cellStarts.resize(newCellCount + 1, m_cellStarts[oldCellCount]);
+      }
       m_width = width;
       m_height = height;
+
+      // tiles could have moved to different locations, so recreate the final bits and priorities from scratch
+      m_finalWordsPerRow = getFinalWordsPerRow(width);
+      m_finalBits.assign(m_finalWordsPerRow * height, 0);
+      m_openCellCount = static_cast<size_t>(width) * height;
+      m_openCellsInRow.assign(height, width);
+      m_highestPriority.assign(width * height, UINT8_MAX);
+      for (int y = 0; y < height; ++y)
+      {
+         for (int x = 0; x < width; ++x)
+         {
+            size_t cellIdx = GridUtility::getIndex(x, y, m_width);
+            const TileSpan tiles = getTiles(cellIdx);
+            for (auto t = tiles.cbegin(), end = tiles.cend(); t != end; ++t)
+            {
+               finalword_t &finalWord = m_finalBits[(y * m_finalWordsPerRow) + (x / FINAL_WORD_BITS)];
+               const finalword_t finalBit = finalword_t(1) << (x % FINAL_WORD_BITS);
+               if (t->isFinal() && (finalWord & finalBit) == 0)
+               {
+                  finalWord |= finalBit;
+                  --m_openCellsInRow[y];
+                  --m_openCellCount;
+               }
+               if (t->priority < m_highestPriority[cellIdx])
+               {
+                  m_highestPriority[cellIdx] = t->priority;
+               }
+            }
+         }
+      }
    }
 
    /**
@@ -208,8 +489,29 @@ public:
       {
          tiles->clear();
       }
+      m_tiles.clear();
+      m_pendingTiles.clear();
+      std::fill(m_cellStarts.begin(), m_cellStarts.end(), 0);
+      std::fill(m_finalBits.begin(), m_finalBits.end(), 0);
+      m_openCellCount = size();
+      std::fill(m_openCellsInRow.begin(), m_openCellsInRow.end(), m_width);
+      std::fill(m_highestPriority.begin(), m_highestPriority.end(), UINT8_MAX);
    }
 
+   /**
+    *  @brief Removes all previously placed tiles in the given area only, including ones that weren't compacted yet (see compact()).
+    *  Locations outside it are left as they are.
+    */
+   void cleanUpArea(const CellArea &area);
+
+   /**
+    *  @brief Throw away tiles placed with putTile that haven't been compacted yet, except the ones inside any of keepAreas.
+    *
+    *  @details Only the tiles themselves are thrown away. Locations that were finalized, or had their
+    *  priority changed by those tiles, stay that way.
+    */
+   void discardPendingTiles(const std::vector<CellArea> &keepAreas);
+
    void setRandomSeed(uint32_t newRandomSeed)
    {
       m_randomSeed = newRandomSeed;
@@ -234,7 +536,7 @@ public:
       {
          for (int x = 0; x < m_width; ++x)
          {
-            const tiles_t &tilesInCell = m_grid[GridUtility::getIndex(x, y, m_width)];
+            const TileSpan tilesInCell = getTiles(x, y);
 
             auto tileLen = tilesInCell.size();
 
@@ -279,7 +581,7 @@ public:
       {
          for (int x = 0; x < m_width; ++x)
          {
-            const tiles_t &tilesInCell = m_grid[GridUtility::getIndex(x, y, m_width)];
+            const TileSpan tilesInCell = getTiles(x, y);
 
             auto tileLen = tilesInCell.size();
 
@@ -331,18 +633,381 @@ private:
     */
    uint32_t m_randomSeed;
 
+   static size_t getFinalWordsPerRow(dimensions_t width)
+   {
+      return (static_cast<size_t>(width) + FINAL_WORD_BITS - 1) / FINAL_WORD_BITS;
+   }
+
+   /**
+    *  @brief A tile placed with putTile that hasn't been moved to its cell yet.
+    */
+   struct PendingTile
+   {
+      uint32_t cellIdx;
+      TileInCell tile;
+   };
+
+   /**
+    *  @brief Same as compact(). Only changes how the tiles are stored, not which tiles each cell has,
+    *  which is why it can be done when reading the tiles.
+    */
+   void compactPendingTiles() const;
+
+   /**
+    *  @brief Same as setStorage(), but also used by the non-const operator().
+    */
+   void changeStorage(Storage storage);
+
+   void addPendingTile(size_t cellIdx, int cellX, int cellY, const TileInCell &tile)
+   {
+      m_pendingTiles.push_back(PendingTile{ static_cast<uint32_t>(cellIdx), tile });
+
+      if (tile.priority < m_highestPriority[cellIdx])
+      {
+         m_highestPriority[cellIdx] = tile.priority;
+      }
+
+      if (TileFlags::isFinal(tile.flags))
+      {
+         finalword_t &finalWord = m_finalBits[(cellY * m_finalWordsPerRow) + (cellX / FINAL_WORD_BITS)];
+         const finalword_t finalBit = finalword_t(1) << (cellX % FINAL_WORD_BITS);
+         if ((finalWord & finalBit) == 0)
+         {
+            finalWord |= finalBit;
+            --m_openCellsInRow[cellY];
+            --m_openCellCount;
+         }
+      }
+   }
+
    dimensions_t m_width;
    dimensions_t m_height;
-   std::vector<tiles_t> m_grid;
+
+   Storage m_storage;
+
+   // The pending tiles are moved to their cells when they're read,
+   // so where the tiles are kept can be changed in const functions.
+
+   /**
+    *  @brief Tiles of each cell, with Storage::PerCell. Empty otherwise.
+    */
+   mutable std::vector<tiles_t> m_grid;
+
+   /**
+    *  @brief Tiles of all cells, with the tiles of each cell next to each other, with Storage::Flat. Empty otherwise.
+    */
+   mutable std::vector<TileInCell> m_tiles;
+
+   /**
+    *  @brief Index in m_tiles where each cell's tiles start. The tiles of a cell
+    *  end where the next cell's tiles start, so this has one extra element at the end.
+    *  Only has the one element with Storage::PerCell.
+    */
+   mutable std::vector<uint32_t> m_cellStarts;
+
+   /**
+    *  @brief Tiles placed with putTile, in the order they were placed, waiting to be moved to their cells.
+    */
+   mutable std::vector<PendingTile> m_pendingTiles;
+
+   /**
+    *  @brief Lowest priority value (i.e. highest priority) of the tiles in each location,
+    *  or UINT8_MAX if the location has no tiles. One element per location.
+    */
+   std::vector<uint8_t> m_highestPriority;
+
+   size_t m_finalWordsPerRow;
+
+   /**
+    *  @brief One bit per location, set if the location has a tile with TileFlags::Final.
+    *  Each row is packed into 64-bit words, the leftmost location being in the lowest bit of the row's first word.
+    */
+   std::vector<finalword_t> m_finalBits;
+
+   /**
+    *  @brief How many locations don't have their bit set in m_finalBits.
+    */
+   size_t m_openCellCount;
+
+   /**
+    *  @brief Same as m_openCellCount, but for each row.
+    */
+   std::vector<uint32_t> m_openCellsInRow;
 };
 
+inline void TileGrid::compactPendingTiles() const
+{
+   if (m_pendingTiles.empty())
+   {
+      return;
+   }
+
+   if (m_storage == Storage::PerCell)
+   {
+      for (auto pending = m_pendingTiles.cbegin(), end = m_pendingTiles.cend(); pending != end; ++pending)
+      {
+         m_grid[pending->cellIdx].push_back(pending->tile);
+      }
+      m_pendingTiles.clear();
+      return;
+   }
+
+   const size_t cellCount = size();
+
+   if (m_pendingTiles.size() * 8 < m_tiles.size())
+   {
+      // Only a few tiles to add (e.g. after LdtkDefFile::runRulesIncremental), so insert them in place.
+      // Going from the back, the tiles of each cell move over by the number of pending tiles in the cells up to it.
+      std::stable_sort(m_pendingTiles.begin(), m_pendingTiles.end(), [](const PendingTile &a, const PendingTile &b)
+      {
+         return a.cellIdx < b.cellIdx;
+      });
+
+      uint32_t moveEnd = static_cast<uint32_t>(m_tiles.size());
+      m_tiles.resize(m_tiles.size() + m_pendingTiles.size());
+
+      size_t pendingIdx = m_pendingTiles.size();
+      for (size_t cellIdx = cellCount; pendingIdx > 0; --cellIdx)
+      {
+         // m_cellStarts[cellIdx] is where the tiles of the cell before it end
+         const uint32_t oldEnd = m_cellStarts[cellIdx];
+         m_cellStarts[cellIdx] = oldEnd + static_cast<uint32_t>(pendingIdx);
+
+         if (m_pendingTiles[pendingIdx - 1].cellIdx != cellIdx - 1)
+         {
+            // nothing to add to this cell, its tiles get moved together with the ones before it
+            continue;
+         }
+
+         std::move_backward(m_tiles.begin() + oldEnd, m_tiles.begin() + moveEnd, m_tiles.begin() + moveEnd + pendingIdx);
+         moveEnd = oldEnd;
+
+         // the pending tiles go after the ones the cell already had, in the order they were placed
+         while (pendingIdx > 0 && m_pendingTiles[pendingIdx - 1].cellIdx == cellIdx - 1)
+         {
+            --pendingIdx;
+            m_tiles[oldEnd + pendingIdx] = m_pendingTiles[pendingIdx].tile;
+         }
+      }
+
+      m_pendingTiles.clear();
+      return;
+   }
+
+   // count how many tiles each cell will have, then add those up to get where each cell's tiles will start
+   std::vector<uint32_t> newCellStarts(cellCount + 1, 0);
+   for (size_t cellIdx = 0; cellIdx < cellCount; ++cellIdx)
+   {
+      newCellStarts[cellIdx + 1] = m_cellStarts[cellIdx + 1] - m_cellStarts[cellIdx];
+   }
+   for (auto pending = m_pendingTiles.cbegin(), end = m_pendingTiles.cend(); pending != end; ++pending)
+   {
+      ++newCellStarts[pending->cellIdx + 1];
+   }
+   for (size_t cellIdx = 0; cellIdx < cellCount; ++cellIdx)
+   {
+      newCellStarts[cellIdx + 1] += newCellStarts[cellIdx];
+   }
+
+   // tiles that were already in a cell stay in front, then the pending ones follow in the order they were placed
+   std::vector<TileInCell> newTiles(newCellStarts[cellCount]);
+   std::vector<uint32_t> insertIdx(newCellStarts.cbegin(), newCellStarts.cend() - 1);
+   if (!m_tiles.empty())
+   {
+      for (size_t cellIdx = 0; cellIdx < cellCount; ++cellIdx)
+      {
+         auto cellBegin = m_tiles.cbegin() + m_cellStarts[cellIdx];
+         auto cellEnd = m_tiles.cbegin() + m_cellStarts[cellIdx + 1];
+         std::copy(cellBegin, cellEnd, newTiles.begin() + insertIdx[cellIdx]);
+         insertIdx[cellIdx] += static_cast<uint32_t>(cellEnd - cellBegin);
+      }
+   }
+   for (auto pending = m_pendingTiles.cbegin(), end = m_pendingTiles.cend(); pending != end; ++pending)
+   {
+      newTiles[insertIdx[pending->cellIdx]++] = pending->tile;
+   }
+
+   m_tiles.swap(newTiles);
+   m_cellStarts.swap(newCellStarts);
+   m_pendingTiles.clear();
+}
+
+inline void TileGrid::changeStorage(Storage storage)
+{
+   if (m_storage == storage)
+   {
+      return;
+   }
+
+   compactPendingTiles();
+
+   const size_t cellCount = size();
+   if (storage == Storage::PerCell)
+   {
+      m_grid.assign(cellCount, tiles_t());
+      for (size_t cellIdx = 0; cellIdx < cellCount; ++cellIdx)
+      {
+         m_grid[cellIdx].assign(m_tiles.cbegin() + m_cellStarts[cellIdx], m_tiles.cbegin() + m_cellStarts[cellIdx + 1]);
+      }
+      m_tiles = std::vector<TileInCell>();
+      m_cellStarts.assign(1, 0);
+   }
+   else
+   {
+      m_cellStarts.assign(cellCount + 1, 0);
+      for (size_t cellIdx = 0; cellIdx < cellCount; ++cellIdx)
+      {
+         m_cellStarts[cellIdx + 1] = m_cellStarts[cellIdx] + static_cast<uint32_t>(m_grid[cellIdx].size());
+      }
+      m_tiles.clear();
+      m_tiles.reserve(m_cellStarts[cellCount]);
+      for (auto tiles = m_grid.cbegin(), end = m_grid.cend(); tiles != end; ++tiles)
+      {
+         m_tiles.insert(m_tiles.end(), tiles->cbegin(), tiles->cend());
+      }
+      m_grid = std::vector<tiles_t>();
+   }
+
+   m_storage = storage;
+}
+
+inline void TileGrid::cleanUpArea(const CellArea &area)
+{
+   compact();
+
+   const CellArea clamped = area.getClamped(m_width, m_height);
+   if (clamped.isEmpty())
+   {
+      return;
+   }
+
+   if (m_storage == Storage::PerCell)
+   {
+      for (int y = clamped.top; y <= clamped.bottom; ++y)
+      {
+         for (int x = clamped.left; x <= clamped.right; ++x)
+         {
+            const size_t cellIdx = GridUtility::getIndex(x, y, m_width);
+            m_grid[cellIdx].clear();
+            m_highestPriority[cellIdx] = UINT8_MAX;
+
+            finalword_t &finalWord = m_finalBits[(y * m_finalWordsPerRow) + (x / FINAL_WORD_BITS)];
+            const finalword_t finalBit = finalword_t(1) << (x % FINAL_WORD_BITS);
+            if ((finalWord & finalBit) != 0)
+            {
+               finalWord &= ~finalBit;
+               ++m_openCellsInRow[y];
+               ++m_openCellCount;
+            }
+         }
+      }
+      return;
+   }
+
+   // go through the cells from the area's first one, moving the tiles of the cells outside the area back over the removed ones
+   const size_t cellCount = size();
+   const size_t firstCellIdx = GridUtility::getIndex(clamped.left, clamped.top, m_width);
+   uint32_t tilesBegin = m_cellStarts[firstCellIdx];
+   uint32_t writeIdx = tilesBegin;
+   int x = clamped.left;
+   int y = clamped.top;
+   for (size_t cellIdx = firstCellIdx; cellIdx < cellCount; ++cellIdx)
+   {
+      const uint32_t tilesEnd = m_cellStarts[cellIdx + 1];
+      m_cellStarts[cellIdx] = writeIdx;
+
+      if (clamped.contains(x, y))
+      {
+         m_highestPriority[cellIdx] = UINT8_MAX;
+
+         finalword_t &finalWord = m_finalBits[(y * m_finalWordsPerRow) + (x / FINAL_WORD_BITS)];
+         const finalword_t finalBit = finalword_t(1) << (x % FINAL_WORD_BITS);
+         if ((finalWord & finalBit) != 0)
+         {
+            finalWord &= ~finalBit;
+            ++m_openCellsInRow[y];
+            ++m_openCellCount;
+         }
+      }
+      else
+      {
+         if (writeIdx != tilesBegin)
+         {
+            std::copy(m_tiles.begin() + tilesBegin, m_tiles.begin() + tilesEnd, m_tiles.begin() + writeIdx);
+         }
+         writeIdx += tilesEnd - tilesBegin;
+      }
+
+      tilesBegin = tilesEnd;
+      if (++x == m_width)
+      {
+         x = 0;
+         ++y;
+      }
+   }
+   m_cellStarts[cellCount] = writeIdx;
+   m_tiles.resize(writeIdx);
+}
+
+inline void TileGrid::discardPendingTiles(const std::vector<CellArea> &keepAreas)
+{
+   auto kept = std::remove_if(m_pendingTiles.begin(), m_pendingTiles.end(), [&](const PendingTile &pending)
+   {
+      int x;
+      int y;
+      GridUtility::getCoordinates(static_cast<int>(pending.cellIdx), m_width, x, y);
+      for (auto keepArea = keepAreas.cbegin(), end = keepAreas.cend(); keepArea != end; ++keepArea)
+      {
+         if (keepArea->contains(x, y))
+         {
+            return false;
+         }
+      }
+      return true;
+   });
+   m_pendingTiles.erase(kept, m_pendingTiles.end());
+}
+
+inline TileSpan TileGrid::getTiles(size_t idx) const
+{
+   ASSERT_THROW(idx >= 0, std::out_of_range,
+      "supplied index to an AppliedRules is negative: " << idx);
+   ASSERT_THROW(idx < size(), std::out_of_range,
+      "supplied index to an AppliedRules is beyond total number of cells. idx: " << idx << " (total number of cells: " << size() << ")");
+
+   compactPendingTiles();
+
+   if (m_storage == Storage::PerCell)
+   {
+      return TileSpan(m_grid[idx].data(), m_grid[idx].size());
+   }
+   return TileSpan(m_tiles.data() + m_cellStarts[idx], m_cellStarts[idx + 1] - m_cellStarts[idx]);
+}
+
+inline TileSpan TileGrid::getTiles(int x, int y) const
+{
+   ASSERT_THROW(x >= 0, std::out_of_range,
+      "supplied x index to an AppliedRules is negative: " << x);
+   ASSERT_THROW(y >= 0, std::out_of_range,
+      "supplied y index to an AppliedRules is negative: " << y);
+
+   ASSERT_THROW(x < m_width, std::out_of_range,
+      "supplied x index to an AppliedRules is beyond width: " << x << " (width: " << m_width << ")");
+   ASSERT_THROW(y < m_height, std::out_of_range,
+      "supplied y index to an AppliedRules is beyond height: " << y << " (height: " << m_height << ")");
+
+   return getTiles(GridUtility::getIndex(x, y, m_width));
+}
+
 inline tiles_t &TileGrid::operator()(size_t idx)
 {
    ASSERT_THROW(idx >= 0, std::out_of_range,
       "supplied index to an AppliedRules is negative: " << idx);
-   ASSERT_THROW(idx < m_grid.size(), std::out_of_range,
-      "supplied index to an AppliedRules is beyond total number of cells. idx: " << idx << " (total number of cells: " << m_grid.size() << ")");
+   ASSERT_THROW(idx < size(), std::out_of_range,
+      "supplied index to an AppliedRules is beyond total number of cells. idx: " << idx << " (total number of cells: " << size() << ")");
 
+   changeStorage(Storage::PerCell);
+   compactPendingTiles();
    return m_grid[idx];
 }
 
@@ -350,15 +1015,24 @@ inline const tiles_t &TileGrid::operator()(size_t idx) const
 {
    ASSERT_THROW(idx >= 0, std::out_of_range,
       "supplied index to an AppliedRules is negative: " << idx);
-   ASSERT_THROW(idx < m_grid.size(), std::out_of_range,
-      "supplied index to an AppliedRules is beyond total number of cells. idx: " << idx << " (total number of cells: " << m_grid.size() << ")");
+   ASSERT_THROW(idx < size(), std::out_of_range,
+      "supplied index to an AppliedRules is beyond total number of cells. idx: " << idx << " (total number of cells: " << size() << ")");
+   ASSERT_THROW(m_storage == Storage::PerCell, std::logic_error,
+      "the tiles of a cell aren't kept in their own tiles_t with Storage::Flat, use getTiles to read them");
+
+   if (m_storage != Storage::PerCell)
+   {
+      static const tiles_t noTiles;
+      return noTiles;
+   }
 
+   compactPendingTiles();
    return m_grid[idx];
 }
 
 inline size_t TileGrid::size() const
 {
-   return m_grid.size();
+   return static_cast<size_t>(m_width) * m_height;
 }
 
 inline tiles_t &TileGrid::operator()(int x, int y)
@@ -373,7 +1047,7 @@ inline tiles_t &TileGrid::operator()(int x, int y)
    ASSERT_THROW(y < m_height, std::out_of_range,
       "supplied y index to an AppliedRules is beyond height: " << y << " (height: " << m_height << ")");
 
-   return m_grid[GridUtility::getIndex(x, y, m_width)];
+   return (*this)(GridUtility::getIndex(x, y, m_width));
 }
 
 inline const tiles_t &TileGrid::operator()(int x, int y) const
@@ -388,7 +1062,7 @@ inline const tiles_t &TileGrid::operator()(int x, int y) const
    ASSERT_THROW(y < m_height, std::out_of_range,
       "supplied y index to an AppliedRules is beyond height: " << y << " (height: " << m_height << ")");
 
-   return m_grid[GridUtility::getIndex(x, y, m_width)];
+   return (*this)(GridUtility::getIndex(x, y, m_width));
 }
 
 inline dimensions_t TileGrid::getWidth() const
@@ -411,7 +1085,7 @@ inline std::ostream &operator<<(std::ostream &os, const TileGrid &tileGrid)
    {
       for (int x = 0, width = tileGrid.getWidth(); x < width; ++x)
       {
-         const tiles_t &tilesInCell = tileGrid(x, y);
+         const TileSpan tilesInCell = tileGrid.getTiles(x, y);
 
          auto tileLen = tilesInCell.size();
 
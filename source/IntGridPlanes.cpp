@@ -0,0 +1,412 @@
+#include "ldtkimport/IntGridPlanes.h"
+
+#include <algorithm>
+#include <bit>
+#include <vector>
+
+#include "ldtkimport/AssertUtility.h"
+#include "ldtkimport/GridUtility.h"
+
+#if !defined(LDTK_IMPORT_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#  define LDTK_IMPORT_PLANES_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#endif
+
+#if defined(LDTK_IMPORT_PLANES_X86) && !defined(_MSC_VER)
+// lets us compile the kernels for instruction sets that aren't enabled in the compiler flags,
+// since we only call them after checking that the CPU supports it
+#  define LDTK_IMPORT_TARGET(instructionSet) __attribute__((target(instructionSet)))
+#else
+// MSVC allows using any intrinsics without this
+#  define LDTK_IMPORT_TARGET(instructionSet)
+#endif
+
+
+namespace ldtkimport
+{
+
+using word_t = IntGridPlanes::word_t;
+
+/**
+ *  @brief What's needed to fill the bits of one row of every bitplane.
+ */
+struct RowBuild
+{
+   /**
+    *  @brief The IntGrid's row.
+    */
+   const intgridvalue_t *cells;
+   int width;
+
+   const uint16_t *planeIdxOfValue;
+   size_t valueLen;
+
+   const intgridvalue_t *planeValues;
+   uint16_t planeCount;
+
+   /**
+    *  @brief The row in the first bitplane. Rows of the other bitplanes are planeStride words apart.
+    */
+   word_t *planeRows;
+   size_t planeStride;
+};
+
+using RowKernel = void (*)(const RowBuild &row);
+
+/**
+ *  @brief Fill the bitplanes one cell at a time, starting at cell startX.
+ */
+static void buildRowScalar(const RowBuild &row, const int startX)
+{
+   for (int x = startX; x < row.width; ++x)
+   {
+      intgridvalue_t value = row.cells[x];
+      if (value == 0)
+      {
+         continue;
+      }
+
+      size_t wordIdx = x / IntGridPlanes::WORD_BITS;
+      word_t bit = word_t(1) << (x % IntGridPlanes::WORD_BITS);
+
+      row.planeRows[(IntGridPlanes::PLANE_NON_ZERO * row.planeStride) + wordIdx] |= bit;
+
+      if (value < row.valueLen && row.planeIdxOfValue[value] != IntGridPlanes::PLANE_EMPTY)
+      {
+         row.planeRows[(row.planeIdxOfValue[value] * row.planeStride) + wordIdx] |= bit;
+      }
+   }
+}
+
+static void buildRowScalar(const RowBuild &row)
+{
+   buildRowScalar(row, 0);
+}
+
+#if defined(LDTK_IMPORT_PLANES_X86)
+
+/**
+ *  @brief Fill the bitplanes 16 cells at a time: compare the cells as 16-bit ints,
+ *  pack the results down to 8-bit, then take the top bit of each.
+ */
+LDTK_IMPORT_TARGET("sse2")
+static void buildRowSse2(const RowBuild &row)
+{
+   const __m128i zero = _mm_setzero_si128();
+
+   int x = 0;
+   for (; x + 16 <= row.width; x += 16)
+   {
+      __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row.cells + x));
+      __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row.cells + x + 8));
+
+      size_t wordIdx = x / IntGridPlanes::WORD_BITS;
+      int bitIdx = x % IntGridPlanes::WORD_BITS;
+
+      uint32_t isZero = static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(low, zero), _mm_cmpeq_epi16(high, zero))));
+      row.planeRows[(IntGridPlanes::PLANE_NON_ZERO * row.planeStride) + wordIdx] |= static_cast<word_t>(~isZero & 0xFFFFu) << bitIdx;
+
+      for (uint16_t planeIdx = IntGridPlanes::PLANE_FIRST_VALUE; planeIdx < row.planeCount; ++planeIdx)
+      {
+         __m128i value = _mm_set1_epi16(static_cast<short>(row.planeValues[planeIdx]));
+         uint32_t isEqual = static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(low, value), _mm_cmpeq_epi16(high, value))));
+         row.planeRows[(planeIdx * row.planeStride) + wordIdx] |= static_cast<word_t>(isEqual) << bitIdx;
+      }
+   }
+
+   buildRowScalar(row, x);
+}
+
+/**
+ *  @brief Turn two registers of 16-bit compare results into 32 bits.
+ */
+LDTK_IMPORT_TARGET("avx2")
+static inline uint32_t toBits(__m256i low, __m256i high)
+{
+   // _mm256_packs_epi16 packs each 128-bit half separately,
+   // so this puts the 64-bit chunks back in order afterwards
+   __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+   return static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+}
+
+/**
+ *  @brief Same as buildRowSse2, but 32 cells at a time.
+ */
+LDTK_IMPORT_TARGET("avx2")
+static void buildRowAvx2(const RowBuild &row)
+{
+   const __m256i zero = _mm256_setzero_si256();
+
+   int x = 0;
+   for (; x + 32 <= row.width; x += 32)
+   {
+      __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row.cells + x));
+      __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row.cells + x + 16));
+
+      size_t wordIdx = x / IntGridPlanes::WORD_BITS;
+      int bitIdx = x % IntGridPlanes::WORD_BITS;
+
+      uint32_t isZero = toBits(_mm256_cmpeq_epi16(low, zero), _mm256_cmpeq_epi16(high, zero));
+      row.planeRows[(IntGridPlanes::PLANE_NON_ZERO * row.planeStride) + wordIdx] |= static_cast<word_t>(~isZero) << bitIdx;
+
+      for (uint16_t planeIdx = IntGridPlanes::PLANE_FIRST_VALUE; planeIdx < row.planeCount; ++planeIdx)
+      {
+         __m256i value = _mm256_set1_epi16(static_cast<short>(row.planeValues[planeIdx]));
+         uint32_t isEqual = toBits(_mm256_cmpeq_epi16(low, value), _mm256_cmpeq_epi16(high, value));
+         row.planeRows[(planeIdx * row.planeStride) + wordIdx] |= static_cast<word_t>(isEqual) << bitIdx;
+      }
+   }
+
+   buildRowScalar(row, x);
+}
+
+#endif // LDTK_IMPORT_PLANES_X86
+
+/**
+ *  @brief Choose the fastest way to fill the bitplanes that the CPU supports.
+ */
+static RowKernel pickRowKernel()
+{
+#if defined(LDTK_IMPORT_PLANES_X86)
+#  if defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 0);
+   int maxLeaf = info[0];
+
+   __cpuid(info, 1);
+   bool hasSse2 = (info[3] & (1 << 26)) != 0;
+
+   // AVX2 also needs the OS to save the upper half of the registers (OSXSAVE + AVX state enabled)
+   bool osSupportsAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+
+   bool hasAvx2 = false;
+   if (maxLeaf >= 7 && osSupportsAvx)
+   {
+      __cpuidex(info, 7, 0);
+      hasAvx2 = (info[1] & (1 << 5)) != 0;
+   }
+#  else
+   __builtin_cpu_init();
+   bool hasSse2 = __builtin_cpu_supports("sse2");
+   bool hasAvx2 = __builtin_cpu_supports("avx2");
+#  endif
+
+   if (hasAvx2)
+   {
+      return buildRowAvx2;
+   }
+   if (hasSse2)
+   {
+      return buildRowSse2;
+   }
+#endif
+   return buildRowScalar;
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void IntGridPlanes::build(const IntGrid &cells, const std::vector<intgridvalue_t> &values, const int haloSize)
+{
+   ASSERT(haloSize >= 0 && haloSize <= HALO_SIZE_MAX, "haloSize is out of range: " << haloSize);
+
+   m_width = cells.getWidth();
+   m_height = cells.getHeight();
+   m_wordsPerRow = (static_cast<size_t>(m_width) + WORD_BITS - 1) / WORD_BITS;
+   m_haloSize = haloSize;
+   m_rowStride = m_wordsPerRow + 2;
+   m_paddedHeight = static_cast<size_t>(m_height) + (haloSize * 2);
+
+   // made again by buildAreaSums() if needed
+   m_areaSumColumns = 0;
+   m_areaSums.clear();
+
+   // assign a bitplane to each IntGridValue, after the special ones
+   m_planeCount = PLANE_FIRST_VALUE;
+   m_planeIdxOfValue.clear();
+   m_planeValues.assign(m_planeCount, 0);
+   for (auto value = values.cbegin(), valueEnd = values.cend(); value != valueEnd; ++value)
+   {
+      if (*value == 0)
+      {
+         continue;
+      }
+
+      if (*value >= m_planeIdxOfValue.size())
+      {
+         m_planeIdxOfValue.resize(static_cast<size_t>(*value) + 1, PLANE_EMPTY);
+      }
+
+      if (m_planeIdxOfValue[*value] == PLANE_EMPTY)
+      {
+         m_planeIdxOfValue[*value] = m_planeCount;
+         m_planeValues.push_back(*value);
+         ++m_planeCount;
+      }
+   }
+
+   m_bits.assign(static_cast<size_t>(m_planeCount) * m_paddedHeight * m_rowStride, 0);
+
+   // only need to check the CPU once
+   static const RowKernel buildRow = pickRowKernel();
+
+   RowBuild row;
+   row.width = m_width;
+   row.planeIdxOfValue = m_planeIdxOfValue.data();
+   row.valueLen = m_planeIdxOfValue.size();
+   row.planeValues = m_planeValues.data();
+   row.planeCount = m_planeCount;
+   row.planeStride = m_paddedHeight * m_rowStride;
+
+   for (int y = 0; y < m_height; ++y)
+   {
+      row.cells = cells.getRow(y);
+      row.planeRows = m_bits.data() + ((y + m_haloSize) * m_rowStride) + 1;
+      buildRow(row);
+   }
+
+   // mark the halo
+   for (int y = -m_haloSize; y < m_height + m_haloSize; ++y)
+   {
+      word_t *horizontalRow = getMutableRow(PLANE_HORIZONTAL_OUT_OF_BOUNDS, y);
+      word_t *verticalRow = getMutableRow(PLANE_VERTICAL_OUT_OF_BOUNDS, y);
+      word_t *outOfBoundsRow = getMutableRow(PLANE_OUT_OF_BOUNDS, y);
+
+      bool isVerticalHalo = y < 0 || y >= m_height;
+
+      for (int wordIdx = -1; wordIdx <= static_cast<int>(m_wordsPerRow); ++wordIdx)
+      {
+         word_t outOfBounds;
+         if (wordIdx < 0 || wordIdx >= static_cast<int>(m_wordsPerRow))
+         {
+            outOfBounds = ~word_t(0);
+         }
+         else
+         {
+            outOfBounds = ~getValidMask(wordIdx);
+         }
+
+         if (isVerticalHalo)
+         {
+            verticalRow[wordIdx] = ~word_t(0);
+            outOfBoundsRow[wordIdx] = ~word_t(0);
+         }
+         else
+         {
+            horizontalRow[wordIdx] = outOfBounds;
+            outOfBoundsRow[wordIdx] = outOfBounds;
+         }
+      }
+   }
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+/**
+ *  @brief Which summed-area table a bitplane has. PLANE_NON_ZERO is first, then each IntGridValue.
+ */
+static size_t getAreaSumTableIdx(uint16_t planeIdx)
+{
+   return (planeIdx == IntGridPlanes::PLANE_NON_ZERO) ? 0 : (planeIdx - IntGridPlanes::PLANE_FIRST_VALUE + 1);
+}
+
+void IntGridPlanes::buildAreaSums()
+{
+   constexpr int COLUMNS_PER_WORD = WORD_BITS / AREA_SUM_COLUMN_CELLS;
+   constexpr word_t COLUMN_MASK = (word_t(1) << AREA_SUM_COLUMN_CELLS) - 1;
+
+   m_areaSumColumns = m_wordsPerRow * COLUMNS_PER_WORD;
+
+   const size_t tableCount = static_cast<size_t>(m_planeCount) - PLANE_FIRST_VALUE + 1;
+   const size_t tableStride = m_areaSumColumns + 1;
+   const size_t tableSize = tableStride * (static_cast<size_t>(m_height) + 1);
+
+   m_areaSums.assign(tableCount * tableSize, 0);
+
+   for (size_t tableIdx = 0; tableIdx < tableCount; ++tableIdx)
+   {
+      const uint16_t planeIdx = (tableIdx == 0) ? PLANE_NON_ZERO : static_cast<uint16_t>(PLANE_FIRST_VALUE + tableIdx - 1);
+      uint32_t *table = m_areaSums.data() + (tableIdx * tableSize);
+
+      for (int y = 0; y < m_height; ++y)
+      {
+         const word_t *row = getRow(planeIdx, y);
+         const uint32_t *above = table + (static_cast<size_t>(y) * tableStride);
+         uint32_t *sums = table + ((static_cast<size_t>(y) + 1) * tableStride);
+
+         uint32_t rowSum = 0;
+         for (size_t column = 0; column < m_areaSumColumns; ++column)
+         {
+            const word_t bits = (row[column / COLUMNS_PER_WORD] >> ((column % COLUMNS_PER_WORD) * AREA_SUM_COLUMN_CELLS)) & COLUMN_MASK;
+            rowSum += static_cast<uint32_t>(std::popcount(bits));
+            sums[column + 1] = above[column + 1] + rowSum;
+         }
+      }
+   }
+}
+
+uint32_t IntGridPlanes::getAreaSum(uint16_t planeIdx, int left, int top, int right, int bottom) const
+{
+   ASSERT(hasAreaSums(), "buildAreaSums() wasn't called");
+   ASSERT(left % AREA_SUM_COLUMN_CELLS == 0 && (right + 1) % AREA_SUM_COLUMN_CELLS == 0,
+      "rectangle isn't aligned to the area sum columns: " << left << " to " << right);
+
+   if (left > right || top > bottom)
+   {
+      return 0;
+   }
+
+   // part of the rectangle that's inside the IntGrid
+   const int insideTop = std::max(top, 0);
+   const int insideBottom = std::min(bottom, static_cast<int>(m_height) - 1);
+   const int insideRows = std::max(insideBottom - insideTop + 1, 0);
+   const int insideColumns = std::max(std::min(right, static_cast<int>(m_width) - 1) - std::max(left, 0) + 1, 0);
+
+   const uint32_t width = static_cast<uint32_t>(right - left + 1);
+   const uint32_t height = static_cast<uint32_t>(bottom - top + 1);
+
+   switch (planeIdx)
+   {
+      case PLANE_EMPTY:
+         return 0;
+
+      case PLANE_HORIZONTAL_OUT_OF_BOUNDS:
+         return static_cast<uint32_t>(insideRows) * (width - insideColumns);
+
+      case PLANE_VERTICAL_OUT_OF_BOUNDS:
+         return (height - insideRows) * width;
+
+      case PLANE_OUT_OF_BOUNDS:
+         return (width * height) - static_cast<uint32_t>(insideRows * insideColumns);
+
+      default:
+         break;
+   }
+
+   ASSERT(planeIdx < m_planeCount, "planeIdx is beyond plane count: " << planeIdx << " (plane count: " << m_planeCount << ")");
+
+   if (insideRows == 0)
+   {
+      return 0;
+   }
+
+   // Cells past the width (up to the end of the last word) are never set in these bitplanes,
+   // so the columns only need to be kept within the table.
+   const int firstColumn = std::max(left, 0) / AREA_SUM_COLUMN_CELLS;
+   const int lastColumn = std::min((right + 1) / AREA_SUM_COLUMN_CELLS, static_cast<int>(m_areaSumColumns));
+   if (firstColumn >= lastColumn)
+   {
+      return 0;
+   }
+
+   const size_t tableStride = m_areaSumColumns + 1;
+   const uint32_t *table = m_areaSums.data() + (getAreaSumTableIdx(planeIdx) * tableStride * (static_cast<size_t>(m_height) + 1));
+   const uint32_t *topRow = table + (static_cast<size_t>(insideTop) * tableStride);
+   const uint32_t *bottomRow = table + ((static_cast<size_t>(insideBottom) + 1) * tableStride);
+
+   return bottomRow[lastColumn] - bottomRow[firstColumn] - topRow[lastColumn] + topRow[firstColumn];
+}
+
+} // namespace ldtkimport
@@ -1,11 +1,15 @@
 #include "ldtkimport/LdtkDefFile.h"
 
+#include <algorithm>
+#include <atomic>
 #include <climits>
 #include <cstring>
 #include <cmath>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
+#include <vector>
 #include <iomanip>
 
 #define __STDC_WANT_LIB_EXT1__ 1
@@ -15,6 +19,10 @@
 
 #include "ldtkimport/MiscUtility.h"
 #include "ldtkimport/AssertUtility.h"
+#include "ldtkimport/GridUtility.h"
+#include "ldtkimport/IntGridPlanes.h"
+#include "ldtkimport/MatchMemo.h"
+#include "ldtkimport/ParallelUtility.h"
 
 
 namespace ldtkimport
@@ -590,6 +598,153 @@ void LdtkDefFile::loadFromText(
       loadDeactivatedContent);
 }
 
+/**
+ *  @brief Give each tile of a stamp Rule its offset from the cell the Rule matched (Rule::stampTileOffsets).
+ *  Rules that aren't stamps are left as they are.
+ */
+static void computeStampOffsets(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RuleLog &ruleLog,
+#endif
+   Rule &rule, const TileSet &tileset)
+{
+   if (rule.tileMode != Rule::TileMode::Stamp)
+   {
+      // non-stamp rule, then we don't need to process the offsets
+      return;
+   }
+
+   if (rule.tileIds.size() == 0)
+   {
+      // no tiles for this rule, no point in processing
+      return;
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   std::stringstream stampDebugLog;
+#endif
+
+   // get stamp bounds (within the tilesheet's space)
+   int16_t top = SHRT_MAX;
+   int16_t left = SHRT_MAX;
+   int16_t right = SHRT_MIN;
+   int16_t bottom = SHRT_MIN;
+   for (auto tileId = rule.tileIds.begin(), tileIdEnd = rule.tileIds.end(); tileId != tileIdEnd; ++tileId)
+   {
+      int16_t x, y;
+      tileset.getCoordinates(*tileId, x, y);
+
+      top = std::min(top, y);
+      left = std::min(left, x);
+      bottom = std::max(bottom, y);
+      right = std::max(right, x);
+   }
+
+   ASSERT(top >= 0, "top should not be negative. top: " << top);
+   ASSERT(left >= 0, "left should not be negative. left: " << left);
+   ASSERT(bottom >= 0, "bottom should not be negative. bottom: " << bottom);
+   ASSERT(right >= 0, "right should not be negative. right: " << right);
+
+   ASSERT(top < tileset.tileCountHeight, "top should not be beyond height. top: " << top << " height: " << tileset.tileCountHeight);
+   ASSERT(left < tileset.tileCountWidth, "left should not be beyond width. left: " << left << " width: " << tileset.tileCountWidth);
+   ASSERT(bottom < tileset.tileCountHeight, "top should not be beyond height. bottom: " << bottom << " height: " << tileset.tileCountHeight);
+   ASSERT(right < tileset.tileCountWidth, "right should not be beyond width. right: " << right << " width: " << tileset.tileCountWidth);
+
+   ASSERT(top <= bottom, "top should be <= bottom. top: " << top << " bottom: " << bottom);
+   ASSERT(left <= right, "left should be <= right. left: " << left << " right: " << right);
+
+   // Note: The width and height values are zero-based
+   // (ex. width of 3 tiles will actually have a stampWidth value of 2),
+   // which works out fine in the end for the stamp pivot calculations.
+   int stampWidth = right - left, stampHeight = bottom - top;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   stampDebugLog << "stamp size: " << stampWidth + 1 << "x" << stampHeight + 1 << std::endl;
+#endif
+
+   // now each tile in the stamp needs to be given their local offset
+   rule.stampTileOffsets.clear();
+   rule.stampTileOffsets.reserve(rule.tileIds.size());
+
+   for (auto tileId = rule.tileIds.begin(), tileIdEnd = rule.tileIds.end(); tileId != tileIdEnd; ++tileId)
+   {
+      int16_t x, y;
+      tileset.getCoordinates(*tileId, x, y);
+
+      uint8_t flags = TileFlags::NoFlags;
+
+      // The x and y offsets are measured in "grid-space", not pixels.
+      // So if a pivot is 0.5 and causes the tiles to be in-between the grid,
+      // we can't store that in the offsets, which can only be whole numbers (ints).
+      //
+      // Instead, we mark that in the flag instead using TILE_OFFSET_LEFT and/or TILE_OFFSET_UP.
+      //
+      // For the code that will draw the tiles on-screen,
+      // it will need to convert the offsets into pixels,
+      // and those flags will be checked if a 0.5 adjustment is needed.
+      //
+      // This is only ever a problem when the pivot is 0.5 and the width/height is even-numbered.
+      // For example:
+      //
+      // width of 3 tiles and pivot X of 0.5 won't be a problem, because it'll still be aligned to the grid:
+      // (width of 3 tiles, whose stampWidth will come out as 2 since our values are zero-based) * (assigned pivot x of 0.5) = 2 * 0.5 = 1 (which means move entire stamp 1 tile to the left)
+      //
+      // but width of 2 tiles and pivot X of 0.5 won't be aligned to the grid:
+      // (width of 2 tiles, whose stampWidth is actually 1) * (assigned pivot x of 0.5) = 1 * 0.5 = 0.5 (keep the entire stamp where it is but later on during rendering, move half tile size to the left)
+      //
+      auto horizontalAlignmentOffset = (rule.stampPivotX * stampWidth);
+      auto verticalAlignmentOffset = (rule.stampPivotY * stampHeight);
+
+      // ------------------------------
+
+      float horizontalAlignmentWhole;
+      float horizontalAlignmentFraction = std::modf(horizontalAlignmentOffset, &horizontalAlignmentWhole);
+
+      if (horizontalAlignmentFraction > 0.0f)
+      {
+         flags |= TileFlags::LeftOffset;
+      }
+
+      float verticalAlignmentOffsetWhole;
+      float verticalAlignmentOffsetFraction = std::modf(verticalAlignmentOffset, &verticalAlignmentOffsetWhole);
+
+      if (verticalAlignmentOffsetFraction > 0.0f)
+      {
+         flags |= TileFlags::UpOffset;
+      }
+
+      // ------------------------------
+
+      Rule::Offset o
+      {
+         (x - left) - static_cast<int16_t>(horizontalAlignmentWhole),
+         (y - top) - static_cast<int16_t>(verticalAlignmentOffsetWhole),
+         flags
+      };
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      stampDebugLog << "for tile id " << *tileId << ": offset: (" << o.x << ", " << o.y << ")";
+      if (TileFlags::hasOffsetLeft(flags))
+      {
+         stampDebugLog << " offsetX (h align: " << horizontalAlignmentWhole << " f: " << horizontalAlignmentFraction << ")";
+      }
+      if (TileFlags::hasOffsetUp(flags))
+      {
+         stampDebugLog << " offsetY (v align: " << verticalAlignmentOffsetWhole << " f: " << verticalAlignmentOffsetFraction << ")";
+      }
+      stampDebugLog << std::endl;
+#endif
+      rule.stampTileOffsets.push_back(o);
+   }
+
+   ASSERT(rule.stampTileOffsets.size() == rule.tileIds.size(),
+      "For rule " << rule.uid << ", stampTileOffsets size should match tileIds size at this point. stampTileOffsets.size(): " << rule.stampTileOffsets.size() << " tileIds.size(): " << rule.tileIds.size());
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   ruleLog.stampDebugInfo = stampDebugLog.str();
+#endif
+}
+
 void LdtkDefFile::preProcess(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
    RulesLog &rulesLog,
@@ -625,6 +780,8 @@ void LdtkDefFile::preProcess(
 
    for (auto layer = m_layers.begin(), layerEnd = m_layers.end(); layer != layerEnd; ++layer)
    {
+      compileRules(*layer, getIntGridValuesOfLayer(*layer), layer->compiledRules);
+
       TileSet *tileset = getTileset(layer->tilesetDefUid);
       if (tileset == nullptr)
       {
@@ -657,147 +814,17 @@ void LdtkDefFile::preProcess(
                continue;
             }
 
-            if (rule->tileMode != Rule::TileMode::Stamp)
-            {
-               // non-stamp rule, then we don't need to process the offsets
-               continue;
-            }
-
-            if (rule->tileIds.size() == 0)
-            {
-               // no tiles for this rule, no point in processing
-               continue;
-            }
-
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-            std::stringstream stampDebugLog;
-#endif
-
-            // get stamp bounds (within the tilesheet's space)
-            int16_t top = SHRT_MAX;
-            int16_t left = SHRT_MAX;
-            int16_t right = SHRT_MIN;
-            int16_t bottom = SHRT_MIN;
-            for (auto tileId = rule->tileIds.begin(), tileIdEnd = rule->tileIds.end(); tileId != tileIdEnd; ++tileId)
-            {
-               int16_t x, y;
-               tileset->getCoordinates(*tileId, x, y);
-
-               top = std::min(top, y);
-               left = std::min(left, x);
-               bottom = std::max(bottom, y);
-               right = std::max(right, x);
-            }
-
-            ASSERT(top >= 0, "top should not be negative. top: " << top);
-            ASSERT(left >= 0, "left should not be negative. left: " << left);
-            ASSERT(bottom >= 0, "bottom should not be negative. bottom: " << bottom);
-            ASSERT(right >= 0, "right should not be negative. right: " << right);
-
-            ASSERT(top < tileset->tileCountHeight, "top should not be beyond height. top: " << top << " height: " << tileset->tileCountHeight);
-            ASSERT(left < tileset->tileCountWidth, "left should not be beyond width. left: " << left << " width: " << tileset->tileCountWidth);
-            ASSERT(bottom < tileset->tileCountHeight, "top should not be beyond height. bottom: " << bottom << " height: " << tileset->tileCountHeight);
-            ASSERT(right < tileset->tileCountWidth, "right should not be beyond width. right: " << right << " width: " << tileset->tileCountWidth);
-
-            ASSERT(top <= bottom, "top should be <= bottom. top: " << top << " bottom: " << bottom);
-            ASSERT(left <= right, "left should be <= right. left: " << left << " right: " << right);
-
-            // Note: The width and height values are zero-based
-            // (ex. width of 3 tiles will actually have a stampWidth value of 2),
-            // which works out fine in the end for the stamp pivot calculations.
-            int stampWidth = right - left, stampHeight = bottom - top;
-
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-            stampDebugLog << "stamp size: " << stampWidth + 1 << "x" << stampHeight + 1 << std::endl;
-#endif
-
-            // now each tile in the stamp needs to be given their local offset
-            rule->stampTileOffsets.clear();
-            rule->stampTileOffsets.reserve(rule->tileIds.size());
-
-            for (auto tileId = rule->tileIds.begin(), tileIdEnd = rule->tileIds.end(); tileId != tileIdEnd; ++tileId)
-            {
-               int16_t x, y;
-               tileset->getCoordinates(*tileId, x, y);
-
-               uint8_t flags = TileFlags::NoFlags;
-
-               // The x and y offsets are measured in "grid-space", not pixels.
-               // So if a pivot is 0.5 and causes the tiles to be in-between the grid,
-               // we can't store that in the offsets, which can only be whole numbers (ints).
-               //
-               // Instead, we mark that in the flag instead using TILE_OFFSET_LEFT and/or TILE_OFFSET_UP.
-               //
-               // For the code that will draw the tiles on-screen,
-               // it will need to convert the offsets into pixels,
-               // and those flags will be checked if a 0.5 adjustment is needed.
-               //
-               // This is only ever a problem when the pivot is 0.5 and the width/height is even-numbered.
-               // For example:
-               //
-               // width of 3 tiles and pivot X of 0.5 won't be a problem, because it'll still be aligned to the grid:
-               // (width of 3 tiles, whose stampWidth will come out as 2 since our values are zero-based) * (assigned pivot x of 0.5) = 2 * 0.5 = 1 (which means move entire stamp 1 tile to the left)
-               //
-               // but width of 2 tiles and pivot X of 0.5 won't be aligned to the grid:
-               // (width of 2 tiles, whose stampWidth is actually 1) * (assigned pivot x of 0.5) = 1 * 0.5 = 0.5 (keep the entire stamp where it is but later on during rendering, move half tile size to the left)
-               //
-               auto horizontalAlignmentOffset = (rule->stampPivotX * stampWidth);
-               auto verticalAlignmentOffset = (rule->stampPivotY * stampHeight);
-
-               // ------------------------------
-
-               float horizontalAlignmentWhole;
-               float horizontalAlignmentFraction = std::modf(horizontalAlignmentOffset, &horizontalAlignmentWhole);
-
-               if (horizontalAlignmentFraction > 0.0f)
-               {
-                  flags |= TileFlags::LeftOffset;
-               }
-
-               float verticalAlignmentOffsetWhole;
-               float verticalAlignmentOffsetFraction = std::modf(verticalAlignmentOffset, &verticalAlignmentOffsetWhole);
-
-               if (verticalAlignmentOffsetFraction > 0.0f)
-               {
-                  flags |= TileFlags::UpOffset;
-               }
-
-               // ------------------------------
-
-               Rule::Offset o
-               {
-                  (x - left) - static_cast<int16_t>(horizontalAlignmentWhole),
-                  (y - top) - static_cast<int16_t>(verticalAlignmentOffsetWhole),
-                  flags
-               };
-
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-               stampDebugLog << "for tile id " << *tileId << ": offset: (" << o.x << ", " << o.y << ")";
-               if (TileFlags::hasOffsetLeft(flags))
-               {
-                  stampDebugLog << " offsetX (h align: " << horizontalAlignmentWhole << " f: " << horizontalAlignmentFraction << ")";
-               }
-               if (TileFlags::hasOffsetUp(flags))
-               {
-                  stampDebugLog << " offsetY (v align: " << verticalAlignmentOffsetWhole << " f: " << verticalAlignmentOffsetFraction << ")";
-               }
-               stampDebugLog << std::endl;
-#endif
-               rule->stampTileOffsets.push_back(o);
-            }
-
-            ASSERT(rule->stampTileOffsets.size() == rule->tileIds.size(),
-               "For rule " << rule->uid << ", stampTileOffsets size should match tileIds size at this point. stampTileOffsets.size(): " << rule->stampTileOffsets.size() << " tileIds.size(): " << rule->tileIds.size());
-
+            computeStampOffsets(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-            rulesLog.rule[rule->uid].stampDebugInfo = stampDebugLog.str();
+               rulesLog.rule[rule->uid],
 #endif
+               *rule, *tileset);
          } // for Rule
       } // for RuleGroup
    } // for Layer
 }
 
-bool LdtkDefFile::isValid() const
+bool LdtkDefFile::isValid(std::ostream *outReason) const
 {
    for (auto layer = m_layers.cbegin(), layerEnd = m_layers.cend(); layer != layerEnd; ++layer)
    {
@@ -821,7 +848,7 @@ bool LdtkDefFile::isValid() const
                continue;
             }
 
-            if (!rule->isValid())
+            if (!rule->isValid(outReason))
             {
                return false;
             }
@@ -838,6 +865,19 @@ void LdtkDefFile::runRules(
    RulesLog &rulesLog,
 #endif
    Level &level, const uint8_t runSettings) const
+{
+   runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level, runSettings, 1);
+}
+
+void LdtkDefFile::runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const uint8_t runSettings, const unsigned int threadCount) const
 {
    auto &intGrid = level.getIntGrid();
 
@@ -847,43 +887,208 @@ void LdtkDefFile::runRules(
       return;
    }
 
+   // pick all random seeds first, in layer order, so that they're
+   // the same no matter which order the layers end up running in
+   std::vector<uint32_t> randomSeeds(m_layers.size());
+   for (size_t layerIdx = 0, end = m_layers.size(); layerIdx < end; ++layerIdx)
+   {
+      if (RunSettings::hasRandomizeSeeds(runSettings))
+      {
+         randomSeeds[layerIdx] = rand();
+      }
+      else
+      {
+         randomSeeds[layerIdx] = m_layers[layerIdx].initialRandomSeed;
+      }
+   }
+
+   runRulesWithSeeds(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level, randomSeeds, runSettings, threadCount);
+}
+
+void LdtkDefFile::runRulesBatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   const std::vector<RunRulesJob> &jobs, const uint8_t runSettings, const unsigned int threadCount) const
+{
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   // all jobs write to the same RulesLog, so don't run them at the same time
+   (void)threadCount;
+   const unsigned int jobThreadCount = 1;
+#else
+   const unsigned int jobThreadCount = threadCount;
+#endif
+
+   ParallelUtility::parallelFor(jobs.size(), jobThreadCount, [&](const size_t jobIdx)
+   {
+      const RunRulesJob &job = jobs[jobIdx];
+
+      ASSERT(job.level != nullptr, "RunRulesJob " << jobIdx << " has no Level");
+
+      auto &intGrid = job.level->getIntGrid();
+      if (intGrid.getWidth() == 0 || intGrid.getHeight() == 0)
+      {
+         // can't proceed, level size is wrong
+         return;
+      }
+
+      // seeds only depend on the job, never on which thread runs it
+      std::vector<uint32_t> randomSeeds(m_layers.size());
+      for (size_t layerIdx = 0, end = m_layers.size(); layerIdx < end; ++layerIdx)
+      {
+         if (RunSettings::hasRandomizeSeeds(runSettings))
+         {
+            randomSeeds[layerIdx] = GridUtility::getCounterSeed(job.seed, static_cast<uint32_t>(layerIdx));
+         }
+         else
+         {
+            randomSeeds[layerIdx] = m_layers[layerIdx].initialRandomSeed;
+         }
+      }
+
+      // the jobs are already spread over the threads, so each job's layers run one after another
+      runRulesWithSeeds(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         *job.level, randomSeeds, runSettings, 1);
+   });
+}
+
+uint32_t LdtkDefFile::getJobSeed(const uint32_t baseSeed, const size_t jobIdx)
+{
+   return GridUtility::getCounterSeed(baseSeed, static_cast<uint32_t>(jobIdx));
+}
+
+void LdtkDefFile::runRulesVariants(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const std::vector<uint32_t> &variantSeeds, std::vector<std::vector<TileGrid>> &outVariants,
+   const uint8_t runSettings, const unsigned int threadCount) const
+{
+   outVariants.clear();
+   outVariants.resize(variantSeeds.size(), std::vector<TileGrid>(m_layers.size()));
+
+   auto &intGrid = level.getIntGrid();
+   if (intGrid.getWidth() == 0 || intGrid.getHeight() == 0)
+   {
+      // can't proceed, level size is wrong
+      return;
+   }
+
    // ensure level has same amount of TileGrids as there are layers
    level.setTileGridCount(m_layers.size());
-   level.cleanUpTileGrids();
 
-   ASSERT(level.getTileGridCount() == m_layers.size(), "TileGrid count of Level should match count of Layers after calling Level::setTileGridCount");
+   const unsigned int totalThreadCount = (threadCount == 0) ? ParallelUtility::getDefaultThreadCount() : threadCount;
 
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
    rulesLog.tileGrid.resize(m_layers.size(), RulesLog::RulesInGrid_t());
+   for (size_t layerIdx = 0, end = m_layers.size(); layerIdx < end; ++layerIdx)
+   {
+      rulesLog.tileGrid[layerIdx].resize(intGrid.size(), RulesLog::RulesInCell_t());
+   }
+
+   // all layers write to the same RulesLog, so don't run them at the same time
+   const unsigned int layerThreadCount = 1;
+#else
+   const unsigned int layerThreadCount = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(totalThreadCount, m_layers.size())));
 #endif
+   const unsigned int ruleThreadCount = std::max(1u, totalThreadCount / layerThreadCount);
 
+   // count them now, so the layers only read them
+   level.getIntGridValueCounts();
 
-   for (size_t layerIdx = 0, end = m_layers.size(); layerIdx < end; ++layerIdx)
+   ParallelUtility::parallelFor(m_layers.size(), layerThreadCount, [&](const size_t layerIdx)
    {
-      uint32_t randomSeed;
-      if (RunSettings::hasRandomizeSeeds(runSettings))
+      // filled in by the first variant (unless the Level already kept them), and only read by the rest
+      MatchCache localMatchCache;
+      MatchCache *matchCache = level.getMatchCache(layerIdx);
+      if (matchCache == nullptr)
       {
-         randomSeed = rand();
+         matchCache = &localMatchCache;
       }
-      else
+
+      TileGrid &tileGrid = level.getTileGridByIdx(layerIdx);
+      for (size_t variantIdx = 0; variantIdx < variantSeeds.size(); ++variantIdx)
       {
-         randomSeed = m_layers[layerIdx].initialRandomSeed;
+         tileGrid.cleanUp();
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         for (auto cell = rulesLog.tileGrid[layerIdx].begin(), end = rulesLog.tileGrid[layerIdx].end(); cell != end; ++cell)
+         {
+            cell->clear();
+         }
+#endif
+
+         runRulesOnLayer(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            rulesLog,
+#endif
+            level, layerIdx, GridUtility::getCounterSeed(variantSeeds[variantIdx], static_cast<uint32_t>(layerIdx)),
+            runSettings | RunSettings::RandomizeSeeds, ruleThreadCount, matchCache);
+
+         outVariants[variantIdx][layerIdx] = tileGrid;
       }
+   });
+}
+
+void LdtkDefFile::runRulesWithSeeds(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const std::vector<uint32_t> &randomSeeds, const uint8_t runSettings, const unsigned int threadCount) const
+{
+   ASSERT(randomSeeds.size() == m_layers.size(), "Random seed count should match count of Layers. randomSeeds.size(): " << randomSeeds.size() << " layer count: " << m_layers.size());
+
+   // ensure level has same amount of TileGrids as there are layers
+   level.setTileGridCount(m_layers.size());
+   level.cleanUpTileGrids();
+
+   ASSERT(level.getTileGridCount() == m_layers.size(), "TileGrid count of Level should match count of Layers after calling Level::setTileGridCount");
+
+   // Give each layer a thread first. If there are more threads than layers,
+   // the rest are used to run the Rules within each layer.
+   const unsigned int totalThreadCount = (threadCount == 0) ? ParallelUtility::getDefaultThreadCount() : threadCount;
 
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   rulesLog.tileGrid.resize(m_layers.size(), RulesLog::RulesInGrid_t());
+   for (size_t layerIdx = 0, end = m_layers.size(); layerIdx < end; ++layerIdx)
+   {
       rulesLog.tileGrid[layerIdx].resize(level.getIntGrid().size(), RulesLog::RulesInCell_t());
+   }
+
+   // all layers write to the same RulesLog, so don't run them at the same time
+   const unsigned int layerThreadCount = 1;
+#else
+   const unsigned int layerThreadCount = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(totalThreadCount, m_layers.size())));
 #endif
+   const unsigned int ruleThreadCount = std::max(1u, totalThreadCount / layerThreadCount);
+
+   // count them now, so the layers only read them
+   level.getIntGridValueCounts();
 
+   // Each layer only reads the IntGrid and only writes to its own TileGrid,
+   // so they can safely run at the same time.
+   ParallelUtility::parallelFor(m_layers.size(), layerThreadCount, [&](const size_t layerIdx)
+   {
       runRulesOnLayer(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
          rulesLog,
 #endif
-         level, layerIdx, randomSeed, runSettings);
+         level, layerIdx, randomSeeds[layerIdx], runSettings, ruleThreadCount, level.getMatchCache(layerIdx));
 
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
       std::cout << "Finished running rules for layer idx " << layerIdx << std::endl;
 #endif
-   } // for Layer
+   });
+
+   // the whole IntGrid was just run, so nothing is dirty anymore
+   level.clearDirtyAreas();
 
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
    std::cout << "Finished running all rules on all layers" << std::endl;
@@ -916,74 +1121,1457 @@ bool LdtkDefFile::ensureValidForRules(Level &level) const
    return true;
 }
 
-void LdtkDefFile::runRulesOnLayer(
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-   RulesLog &rulesLog,
-#endif
-   Level &level, const size_t layerIdx, const uint32_t randomSeed, const uint8_t runSettings) const
+const std::vector<IntGridValue> &LdtkDefFile::getIntGridValuesOfLayer(const Layer &layer) const
 {
-   auto &intGrid = level.getIntGrid();
-   auto &layer = m_layers[layerIdx];
-   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+   if (layer.useAutoSourceLayerDefUid)
+   {
+      const Layer *sourceLayer = getLayerByUid(layer.autoSourceLayerDefUid);
+      if (sourceLayer != nullptr)
+      {
+         return sourceLayer->intGridValues;
+      }
+   }
+   return layer.intGridValues;
+}
 
-   tileGrid.setRandomSeed(randomSeed);
-   tileGrid.setLayerUid(layer.uid);
+/**
+ *  @brief Make a new number for CompiledRules::ruleRevisions, different from all the ones given before.
+ */
+static uint64_t getNextRuleRevision()
+{
+   static std::atomic<uint64_t> nextRevision(1);
+   return nextRevision++;
+}
 
-   uint8_t rulePriority = 0;
+/**
+ *  @brief Add the IntGridValues a Rule checks for to CompiledRules::planeValues (since each of those will need a bitplane),
+ *  and grow CompiledRules::haloSize to fit its pattern.
+ */
+static void addPlaneValues(const Rule &rule, CompiledRules &outCompiledRules)
+{
+   outCompiledRules.haloSize = std::max(outCompiledRules.haloSize, rule.patternSize / 2);
 
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-   for (int cellY = 0; cellY < intGrid.getHeight(); ++cellY)
+   for (auto patternValue = rule.pattern.cbegin(), patternEnd = rule.pattern.cend(); patternValue != patternEnd; ++patternValue)
    {
-      for (int cellX = 0; cellX < intGrid.getWidth(); ++cellX)
+      if (*patternValue == 0 || *patternValue == RULE_PATTERN_ANYTHING || *patternValue == RULE_PATTERN_NOTHING)
       {
-         rulesLog.tileGrid[layerIdx][GridUtility::getIndex(cellX, cellY, intGrid.getWidth())].clear();
+         continue;
       }
-   }
-#endif
 
-   for (auto ruleGroup = layer.ruleGroups.begin(), ruleGroupEnd = layer.ruleGroups.end(); ruleGroup != ruleGroupEnd; ++ruleGroup)
-   {
-      if (!ruleGroup->active)
+      pattern_t value = *patternValue > 0 ? *patternValue : -*patternValue;
+      if (value > INT_GRID_VALUE_MAX)
       {
+         // no cell can have this value
          continue;
       }
 
-      for (auto rule = ruleGroup->rules.begin(), ruleEnd = ruleGroup->rules.end(); rule != ruleEnd; ++rule)
+      auto &planeValues = outCompiledRules.planeValues;
+      if (std::find(planeValues.cbegin(), planeValues.cend(), value) == planeValues.cend())
       {
-         if (!rule->active)
-         {
-            continue;
-         }
+         planeValues.push_back(static_cast<intgridvalue_t>(value));
+      }
+   }
+}
 
-         if (rule->tileIds.size() == 0)
+/**
+ *  @brief Fill in the parts of CompiledRules that look at all the Rules of a Layer together:
+ *  centerCandidates, deadRules, and the neighbourhoodTable. The checks of each Rule have to be compiled already.
+ */
+static void compileRuleLookups(const Layer &layer, const std::vector<IntGridValue> &intGridValues, CompiledRules &outCompiledRules)
+{
+   outCompiledRules.centerCandidateStarts.clear();
+   outCompiledRules.centerCandidates.clear();
+
+   // List the Rules that could match each IntGridValue, going by the center of their pattern.
+   // Every IntGridValue past the largest one a center checks for gives the same list, so they share the last one.
+   pattern_t largestCenterValue = 0;
+   for (auto ruleGroup = layer.ruleGroups.cbegin(), ruleGroupEnd = layer.ruleGroups.cend(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+   {
+      for (auto rule = ruleGroup->rules.cbegin(), ruleEnd = ruleGroup->rules.cend(); rule != ruleEnd; ++rule)
+      {
+         pattern_t center = rule->getPatternCenter();
+         if (center != RULE_PATTERN_ANYTHING && center != RULE_PATTERN_NOTHING)
          {
-            // no tiles for this rule, no point in processing
-            continue;
+            largestCenterValue = std::max(largestCenterValue, center > 0 ? center : -center);
+         }
+      }
+   }
+
+   // with IntGridValues that large, the lists would take too much memory, so just have one list with all Rules
+   const size_t centerListCount = (largestCenterValue > CompiledRules::CENTER_CANDIDATE_VALUE_MAX) ? 1 : static_cast<size_t>(largestCenterValue) + 2;
+
+   for (size_t listIdx = 0; listIdx < centerListCount; ++listIdx)
+   {
+      outCompiledRules.centerCandidateStarts.push_back(static_cast<uint32_t>(outCompiledRules.centerCandidates.size()));
+
+      uint32_t ruleIdx = 0;
+      for (auto ruleGroup = layer.ruleGroups.cbegin(), ruleGroupEnd = layer.ruleGroups.cend(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+      {
+         for (auto rule = ruleGroup->rules.cbegin(), ruleEnd = ruleGroup->rules.cend(); rule != ruleEnd; ++rule, ++ruleIdx)
+         {
+            if (centerListCount == 1 || rule->passesPatternCenter(static_cast<intgridvalue_t>(listIdx)))
+            {
+               outCompiledRules.centerCandidates.push_back(ruleIdx);
+            }
+         }
+      }
+   }
+
+   outCompiledRules.centerCandidateStarts.push_back(static_cast<uint32_t>(outCompiledRules.centerCandidates.size()));
+
+   // Look for Rules that can never place a tile, so they can be skipped and reported.
+   // When the Layer doesn't list its IntGridValues (e.g. it was made procedurally), they're not checked for.
+   std::vector<uint32_t> definedValueCounts;
+   if (!intGridValues.empty())
+   {
+      // one cell for each IntGridValue, plus an empty one
+      definedValueCounts.push_back(1);
+      for (auto intGridValue = intGridValues.cbegin(), intGridValueEnd = intGridValues.cend(); intGridValue != intGridValueEnd; ++intGridValue)
+      {
+         if (intGridValue->id >= definedValueCounts.size())
+         {
+            definedValueCounts.resize(intGridValue->id + 1, 0);
+         }
+         definedValueCounts[intGridValue->id] = 1;
+      }
+   }
+   const size_t definedValueCount = intGridValues.size() + 1;
+
+   const size_t ruleCount = outCompiledRules.ruleCheckStarts.size() - 1;
+   outCompiledRules.deadRules.assign(ruleCount, DeadRule::None);
+   outCompiledRules.shadowingRules.assign(ruleCount, 0);
+
+   // Rules that could shadow the ones after them, with their index
+   std::vector<std::pair<const Rule *, uint32_t>> shadowingCandidates;
+
+   uint32_t ruleIdx = 0;
+   for (auto ruleGroup = layer.ruleGroups.cbegin(), ruleGroupEnd = layer.ruleGroups.cend(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+   {
+      for (auto rule = ruleGroup->rules.cbegin(), ruleEnd = ruleGroup->rules.cend(); rule != ruleEnd; ++rule, ++ruleIdx)
+      {
+         if (!ruleGroup->active || !rule->active || rule->tileIds.size() == 0 || rule->chance <= 0)
+         {
+            // runRulesOnLayer skips these anyway
+            continue;
+         }
+
+         if (!definedValueCounts.empty() && !rule->canMatchValueCounts(definedValueCounts, definedValueCount))
+         {
+            outCompiledRules.deadRules[ruleIdx] = DeadRule::NeedsMissingValue;
+            continue;
+         }
+
+         for (auto shadowing = shadowingCandidates.cbegin(), shadowingEnd = shadowingCandidates.cend(); shadowing != shadowingEnd; ++shadowing)
+         {
+            if (shadowing->first->shadows(*rule))
+            {
+               outCompiledRules.deadRules[ruleIdx] = DeadRule::Shadowed;
+               outCompiledRules.shadowingRules[ruleIdx] = shadowing->second;
+               break;
+            }
+         }
+
+         if (outCompiledRules.deadRules[ruleIdx] == DeadRule::None && rule->isCellLocal())
+         {
+            shadowingCandidates.push_back(std::make_pair(&(*rule), ruleIdx));
+         }
+      }
+   }
+
+   // classic 3x3 autotiling layers can skip the checks and use a lookup table instead
+   outCompiledRules.neighbourhoodTable.build(layer.ruleGroups);
+}
+
+void LdtkDefFile::compileRules(const Layer &layer, const std::vector<IntGridValue> &intGridValues, CompiledRules &outCompiledRules)
+{
+   outCompiledRules.clear();
+
+   // collect all IntGridValues the Rules check for
+   for (auto ruleGroup = layer.ruleGroups.cbegin(), ruleGroupEnd = layer.ruleGroups.cend(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+   {
+      for (auto rule = ruleGroup->rules.cbegin(), ruleEnd = ruleGroup->rules.cend(); rule != ruleEnd; ++rule)
+      {
+         addPlaneValues(*rule, outCompiledRules);
+      } // for Rule
+   } // for RuleGroup
+
+   for (auto ruleGroup = layer.ruleGroups.cbegin(), ruleGroupEnd = layer.ruleGroups.cend(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+   {
+      for (auto rule = ruleGroup->rules.cbegin(), ruleEnd = ruleGroup->rules.cend(); rule != ruleEnd; ++rule)
+      {
+         outCompiledRules.ruleCheckStarts.push_back(static_cast<uint32_t>(outCompiledRules.checks.size()));
+         outCompiledRules.ruleRevisions.push_back(getNextRuleRevision());
+         outCompiledRules.ruleHashes.push_back(rule->getCompileHash());
+         rule->compileChecks(outCompiledRules.planeValues, outCompiledRules.checks);
+      } // for Rule
+   } // for RuleGroup
+
+   outCompiledRules.ruleCheckStarts.push_back(static_cast<uint32_t>(outCompiledRules.checks.size()));
+
+   compileRuleLookups(layer, intGridValues, outCompiledRules);
+}
+
+bool LdtkDefFile::replaceRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   int ruleUid, const Rule &newRule)
+{
+   for (auto layer = m_layers.begin(), layerEnd = m_layers.end(); layer != layerEnd; ++layer)
+   {
+      size_t ruleIdx = 0;
+      size_t ruleCount = 0;
+      Rule *replaced = nullptr;
+      for (auto ruleGroup = layer->ruleGroups.begin(), ruleGroupEnd = layer->ruleGroups.end(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+      {
+         for (auto rule = ruleGroup->rules.begin(), ruleEnd = ruleGroup->rules.end(); rule != ruleEnd; ++rule, ++ruleCount)
+         {
+            if (replaced == nullptr && rule->uid == ruleUid)
+            {
+               replaced = &(*rule);
+               ruleIdx = ruleCount;
+            }
+         }
+      }
+
+      if (replaced == nullptr)
+      {
+         continue;
+      }
+
+      // checked before the Rule is replaced, since the checks of all the other Rules are kept as they are
+      const bool wasCompiled = layer->compiledRules.isCompiledFrom(layer->ruleGroups);
+
+      *replaced = newRule;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog.rule[replaced->uid].stampDebugInfo = "";
+#endif
+
+      const TileSet *tileset = getTileset(layer->tilesetDefUid);
+      if (tileset != nullptr)
+      {
+         computeStampOffsets(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            rulesLog.rule[replaced->uid],
+#endif
+            *replaced, *tileset);
+      }
+
+      const std::vector<IntGridValue> &intGridValues = getIntGridValuesOfLayer(*layer);
+      CompiledRules &compiledRules = layer->compiledRules;
+
+      if (!wasCompiled)
+      {
+         // preProcess wasn't called yet, or other Rules were edited since, so everything has to be compiled
+         compileRules(*layer, intGridValues, compiledRules);
+         return true;
+      }
+
+      // New IntGridValues go after the ones already there, so the other Rules' checks still point to the right bitplanes.
+      addPlaneValues(*replaced, compiledRules);
+
+      std::vector<Rule::PlaneCheck> newChecks;
+      replaced->compileChecks(compiledRules.planeValues, newChecks);
+
+      // swap out the old checks, and move the start of every Rule after it
+      auto &checks = compiledRules.checks;
+      auto &ruleCheckStarts = compiledRules.ruleCheckStarts;
+      const uint32_t oldCheckCount = ruleCheckStarts[ruleIdx + 1] - ruleCheckStarts[ruleIdx];
+      const uint32_t newCheckCount = static_cast<uint32_t>(newChecks.size());
+      checks.erase(checks.begin() + ruleCheckStarts[ruleIdx], checks.begin() + ruleCheckStarts[ruleIdx + 1]);
+      checks.insert(checks.begin() + ruleCheckStarts[ruleIdx], newChecks.cbegin(), newChecks.cend());
+      for (size_t n = ruleIdx + 1; n < ruleCheckStarts.size(); ++n)
+      {
+         ruleCheckStarts[n] = ruleCheckStarts[n] - oldCheckCount + newCheckCount;
+      }
+
+      compiledRules.ruleRevisions[ruleIdx] = getNextRuleRevision();
+      compiledRules.ruleHashes[ruleIdx] = replaced->getCompileHash();
+
+      compileRuleLookups(*layer, intGridValues, compiledRules);
+      return true;
+   }
+
+   return false;
+}
+
+const CompiledRules &LdtkDefFile::getCompiledRules(const Layer &layer, CompiledRules &compiledNow) const
+{
+   if (!layer.compiledRules.isCompiledFrom(layer.ruleGroups))
+   {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      if (!layer.compiledRules.ruleCheckStarts.empty())
+      {
+         std::cout << "Rules of layer " << layer.uid << " were edited since preProcess, compiling them again. Call preProcess or replaceRule after editing Rules to avoid this." << std::endl;
+      }
+#endif
+      compileRules(layer, getIntGridValuesOfLayer(layer), compiledNow);
+      return compiledNow;
+   }
+   return layer.compiledRules;
+}
+
+void LdtkDefFile::getRulesToRun(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   const Layer &layer, std::vector<RuleToRun> &outRulesToRun)
+{
+   outRulesToRun.clear();
+
+   uint8_t rulePriority = 0;
+   size_t nextRuleIdx = 0;
+
+   for (auto ruleGroup = layer.ruleGroups.begin(), ruleGroupEnd = layer.ruleGroups.end(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+   {
+      // index of this RuleGroup's first Rule in compiledRules
+      size_t firstRuleIdx = nextRuleIdx;
+      nextRuleIdx += ruleGroup->rules.size();
+
+      if (!ruleGroup->active)
+      {
+         continue;
+      }
+
+      for (auto rule = ruleGroup->rules.begin(), ruleEnd = ruleGroup->rules.end(); rule != ruleEnd; ++rule)
+      {
+         size_t ruleIdx = firstRuleIdx + (rule - ruleGroup->rules.begin());
+
+         if (!rule->active)
+         {
+            continue;
+         }
+
+         if (rule->tileIds.size() == 0)
+         {
+            // no tiles for this rule, no point in processing
+            continue;
          }
 
          if (rule->chance <= 0)
          {
-            // no chance for this rule to occur, no point in processing
-            continue;
+            // no chance for this rule to occur, no point in processing
+            continue;
+         }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         if (rulesLog.rule.count(rule->uid) == 0)
+         {
+            rulesLog.rule.insert(std::make_pair(rule->uid, RuleLog()));
+         }
+         outRulesToRun.push_back(RuleToRun{ &(*rule), &(*ruleGroup), ruleIdx, rulePriority, &rulesLog.rule[rule->uid] });
+#else
+         outRulesToRun.push_back(RuleToRun{ &(*rule), &(*ruleGroup), ruleIdx, rulePriority });
+#endif
+
+         ++rulePriority;
+      } // for Rule
+   } // for RuleGroup
+}
+
+bool LdtkDefFile::findRulesThatCanMatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   const size_t layerIdx,
+#endif
+   const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+   const std::vector<uint32_t> &valueCounts, const size_t cellCount, std::vector<bool> &outCanMatch)
+{
+   const size_t ruleCount = compiledRules.ruleCheckStarts.size() - 1;
+   std::vector<const Rule *> runningRules(ruleCount, nullptr);
+   for (auto toRun = rulesToRun.cbegin(), end = rulesToRun.cend(); toRun != end; ++toRun)
+   {
+      runningRules[toRun->ruleIdx] = toRun->rule;
+   }
+
+   outCanMatch.assign(rulesToRun.size(), false);
+   bool canAnyMatch = false;
+   for (size_t n = 0; n < rulesToRun.size(); ++n)
+   {
+      bool canMatch = rulesToRun[n].rule->canMatchValueCounts(valueCounts, cellCount);
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      if (!canMatch)
+      {
+         std::cout << "Skipping Rule " << rulesToRun[n].rule->uid << " on layer idx " << layerIdx << ", the IntGrid doesn't have the values it needs" << std::endl;
+      }
+#endif
+
+      const size_t ruleIdx = rulesToRun[n].ruleIdx;
+      if (canMatch && compiledRules.deadRules[ruleIdx] == DeadRule::Shadowed)
+      {
+         // The Rules could have been changed since preProcess (e.g. the shadowing Rule was turned off), so check again
+         const Rule *shadowing = runningRules[compiledRules.shadowingRules[ruleIdx]];
+         canMatch = shadowing == nullptr || !shadowing->shadows(*rulesToRun[n].rule);
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         if (!canMatch)
+         {
+            std::cout << "Skipping Rule " << rulesToRun[n].rule->uid << " on layer idx " << layerIdx << ", Rule " << shadowing->uid << " always matches before it" << std::endl;
+         }
+#endif
+      }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      if (!canMatch)
+      {
+         rulesToRun[n].ruleLog->matchedCells.clear();
+      }
+#endif
+
+      outCanMatch[n] = canMatch;
+      canAnyMatch = canAnyMatch || canMatch;
+   }
+
+   return canAnyMatch;
+}
+
+void LdtkDefFile::removeRulesThatCantMatch(std::vector<RuleToRun> &rulesToRun, const std::vector<bool> &canMatch)
+{
+   size_t kept = 0;
+   for (size_t n = 0; n < rulesToRun.size(); ++n)
+   {
+      if (canMatch[n])
+      {
+         rulesToRun[kept] = rulesToRun[n];
+         ++kept;
+      }
+   }
+   rulesToRun.resize(kept);
+}
+
+void LdtkDefFile::runRulesOnLayer(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const uint32_t randomSeed, const uint8_t runSettings, const unsigned int threadCount,
+   MatchCache *matchCache) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+
+   tileGrid.setRandomSeed(randomSeed);
+   tileGrid.setLayerUid(layer.uid);
+
+   // the TileGrid won't match what runRulesIncremental noted down anymore
+   PlacementHistory *history = level.getPlacementHistory(layerIdx);
+   if (history != nullptr)
+   {
+      history->clear();
+   }
+
+   CompiledRules compiledNow;
+   const CompiledRules *compiledRules = &getCompiledRules(layer, compiledNow);
+   const size_t ruleCount = compiledRules->ruleCheckStarts.size() - 1;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   for (int cellY = 0; cellY < intGrid.getHeight(); ++cellY)
+   {
+      for (int cellX = 0; cellX < intGrid.getWidth(); ++cellX)
+      {
+         rulesLog.tileGrid[layerIdx][GridUtility::getIndex(cellX, cellY, intGrid.getWidth())].clear();
+      }
+   }
+#endif
+
+   std::vector<RuleToRun> rulesToRun;
+   getRulesToRun(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      layer, rulesToRun);
+
+   RuleCheckpoints *checkpoints = (matchCache == nullptr) ? level.getRuleCheckpoints(layerIdx) : nullptr;
+   if (checkpoints != nullptr)
+   {
+      runRulesOnLayerFromCheckpoints(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level, layerIdx, *compiledRules, rulesToRun, randomSeed, runSettings, threadCount, *checkpoints);
+      return;
+   }
+
+   // Rules that can't match keep their place in the priority order, they just don't get run.
+   std::vector<bool> canMatch;
+   const bool canAnyMatch = findRulesThatCanMatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      layerIdx,
+#endif
+      *compiledRules, rulesToRun, level.getIntGridValueCounts(), intGrid.size(), canMatch);
+
+   if (!canAnyMatch)
+   {
+      // nothing in this layer would place a tile
+      return;
+   }
+
+   // The NeighbourhoodTable can only be used if it was built for the exact same Rules
+   // (e.g. a Rule could have been deactivated after preProcess). It already handles the
+   // Rules that can't match, so they're only left out for the other ways of running the Rules.
+   const NeighbourhoodTable &neighbourhoodTable = compiledRules->neighbourhoodTable;
+   bool useNeighbourhoodTable = matchCache == nullptr && neighbourhoodTable.isBuilt() && neighbourhoodTable.getRuleIdxs().size() == rulesToRun.size();
+   for (size_t n = 0; useNeighbourhoodTable && n < rulesToRun.size(); ++n)
+   {
+      useNeighbourhoodTable = neighbourhoodTable.getRuleIdxs()[n] == rulesToRun[n].ruleIdx;
+   }
+
+   if (!useNeighbourhoodTable)
+   {
+      removeRulesThatCantMatch(rulesToRun, canMatch);
+   }
+
+   // Where each Rule is in rulesToRun (or -1 if it isn't there), so that
+   // cells checked one by one only go through the Rules that could match their IntGridValue.
+   std::vector<int32_t> runIdxOfRule(ruleCount, -1);
+   for (size_t n = 0; n < rulesToRun.size(); ++n)
+   {
+      runIdxOfRule[rulesToRun[n].ruleIdx] = static_cast<int32_t>(n);
+   }
+
+   // Remembering matches only works if nothing but the cells around each cell decides what it gets.
+   bool useMatchMemo = RunSettings::hasMemoizeMatches(runSettings) &&
+      !rulesToRun.empty() && rulesToRun.size() < NeighbourhoodTable::CHECK_CELL;
+   int memoPatternSize = 1;
+   for (auto toRun = rulesToRun.cbegin(), end = rulesToRun.cend(); useMatchMemo && toRun != end; ++toRun)
+   {
+      useMatchMemo = toRun->rule->isCellLocal();
+      memoPatternSize = std::max(memoPatternSize, static_cast<int>(toRun->rule->patternSize));
+   }
+
+   if (matchCache != nullptr)
+   {
+      runRulesOnLayerWithMatchCache(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level, layerIdx, *compiledRules, rulesToRun, randomSeed, runSettings, threadCount, *matchCache);
+   }
+   else if (useNeighbourhoodTable)
+   {
+      runRulesOnLayerWithNeighbourhoodTable(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level, layerIdx, *compiledRules, rulesToRun, runIdxOfRule, randomSeed, runSettings);
+   }
+   else if (useMatchMemo)
+   {
+      runRulesOnLayerWithMatchMemo(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level, layerIdx, *compiledRules, rulesToRun, runIdxOfRule, memoPatternSize, randomSeed, runSettings);
+   }
+   else
+   {
+      // Split the IntGrid into bitplanes, but only for the IntGridValues
+      // that the Rules of this Layer actually check for. The halo around it
+      // needs to fit the largest pattern.
+      IntGridPlanes planes;
+      planes.build(intGrid, compiledRules->planeValues, compiledRules->haloSize);
+
+      // lets the Rules skip over blocks of cells that don't have what their patterns need
+      planes.buildAreaSums();
+
+      const unsigned int ruleThreadCount = (threadCount == 0) ? ParallelUtility::getDefaultThreadCount() : threadCount;
+
+      if (ruleThreadCount <= 1)
+      {
+         runRulesOnLayerOneByOne(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            rulesLog,
+#endif
+            level, layerIdx, *compiledRules, rulesToRun, planes, randomSeed, runSettings);
+      }
+      else
+      {
+         runRulesOnLayerInBatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            rulesLog,
+#endif
+            level, layerIdx, *compiledRules, rulesToRun, planes, randomSeed, runSettings, ruleThreadCount);
+      }
+   }
+
+   // move all placed tiles to their cells in one go
+   tileGrid.compact();
+}
+
+void LdtkDefFile::runRulesOnLayerWithMatchCache(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+   const uint32_t randomSeed, const uint8_t runSettings, const unsigned int threadCount, MatchCache &matchCache) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+
+   std::vector<uint32_t> runRuleIdxs(rulesToRun.size());
+   std::vector<uint64_t> runRuleRevisions(rulesToRun.size());
+   for (size_t n = 0; n < rulesToRun.size(); ++n)
+   {
+      runRuleIdxs[n] = static_cast<uint32_t>(rulesToRun[n].ruleIdx);
+      runRuleRevisions[n] = compiledRules.ruleRevisions[rulesToRun[n].ruleIdx];
+   }
+
+   if (!matchCache.isFilledFor(runRuleIdxs, runRuleRevisions))
+   {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      std::cout << "Matching " << rulesToRun.size() << " Rules on layer idx " << layerIdx << " to keep in the MatchCache" << std::endl;
+#endif
+      IntGridPlanes planes;
+      planes.build(intGrid, compiledRules.planeValues, compiledRules.haloSize);
+      planes.buildAreaSums();
+
+      matchCache.ruleIdxs = std::move(runRuleIdxs);
+      matchCache.ruleRevisions = std::move(runRuleRevisions);
+      matchCache.matches.clear();
+      matchCache.matches.resize(rulesToRun.size());
+
+      // Nothing is left out for cells that are already finalized, since that depends on
+      // the tiles placed, which are different for each seed. placeMatches takes care of that.
+      const unsigned int ruleThreadCount = (threadCount == 0) ? ParallelUtility::getDefaultThreadCount() : threadCount;
+      ParallelUtility::parallelFor(rulesToRun.size(), ruleThreadCount, [&](const size_t n)
+      {
+         const RuleToRun &toRun = rulesToRun[n];
+         toRun.rule->matchRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            *toRun.ruleLog,
+#endif
+            intGrid, planes, compiledRules.getChecks(toRun.ruleIdx), compiledRules.getCheckCount(toRun.ruleIdx),
+            randomSeed, matchCache.matches[n], 1);
+      });
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   std::cout << "Running " << rulesToRun.size() << " Rules on layer idx " << layerIdx << " with cached matches, random seed is " << randomSeed << std::endl;
+#endif
+
+   for (size_t n = 0; n < rulesToRun.size(); ++n)
+   {
+      if (tileGrid.getOpenCellCount() == 0)
+      {
+         // every cell is finalized, the remaining Rules can't place anything
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         std::cout << "Every cell of layer idx " << layerIdx << " is finalized, skipping the remaining " << (rulesToRun.size() - n) << " Rules" << std::endl;
+         for (; n < rulesToRun.size(); ++n)
+         {
+            rulesToRun[n].ruleLog->matchedCells.clear();
+         }
+#endif
+         break;
+      }
+
+      const RuleToRun &toRun = rulesToRun[n];
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      std::cout << "Running Rule " << toRun.rule->uid << " of RuleGroup \"" << toRun.ruleGroup->name << "\" on layer idx " << layerIdx << " with random seed is " << randomSeed << std::endl;
+
+      // matchRule clears the log, but it may not have been called for this seed
+      toRun.ruleLog->matchedCells.clear();
+#endif
+
+      toRun.rule->placeMatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         *toRun.ruleLog, rulesLog.tileGrid[layerIdx],
+#endif
+         tileGrid, matchCache.matches[n], randomSeed, layer.cellPixelSize, toRun.rulePriority, runSettings);
+   }
+}
+
+void LdtkDefFile::runRulesOnLayerWithNeighbourhoodTable(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+   const std::vector<int32_t> &runIdxOfRule, const uint32_t randomSeed, const uint8_t runSettings) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+   const NeighbourhoodTable &neighbourhoodTable = compiledRules.neighbourhoodTable;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   std::cout << "Running " << rulesToRun.size() << " Rules on layer idx " << layerIdx << " with a lookup table, random seed is " << randomSeed << std::endl;
+   for (auto toRun = rulesToRun.cbegin(), end = rulesToRun.cend(); toRun != end; ++toRun)
+   {
+      toRun->ruleLog->matchedCells.clear();
+   }
+#endif
+
+   std::vector<NeighbourhoodTable::Match> cellMatches;
+   neighbourhoodTable.lookUp(intGrid, cellMatches);
+
+   // Every Rule in the table has breakOnMatch, and places its tile on the cell it matched,
+   // so each cell only ever gets the tile of the first Rule that matches it.
+   // That means it doesn't matter that this goes one cell at a time instead of one Rule at a time.
+   for (int cellY = 0; cellY < intGrid.getHeight(); ++cellY)
+   {
+      for (int cellX = 0; cellX < intGrid.getWidth(); ++cellX)
+      {
+         const NeighbourhoodTable::Match &match = cellMatches[GridUtility::getIndex(cellX, cellY, intGrid.getWidth())];
+         if (match.ruleNum == NeighbourhoodTable::NO_MATCH || !tileGrid.canStillPlaceTiles(cellX, cellY))
+         {
+            continue;
+         }
+
+         if (match.ruleNum == NeighbourhoodTable::CHECK_CELL)
+         {
+            // the table can't tell, so check each Rule on this cell until one matches
+            const uint32_t *candidate;
+            const uint32_t *candidateEnd;
+            compiledRules.getCenterCandidates(intGrid(cellX, cellY), candidate, candidateEnd);
+            for (; candidate != candidateEnd; ++candidate)
+            {
+               const int32_t runIdx = runIdxOfRule[*candidate];
+               if (runIdx < 0)
+               {
+                  continue;
+               }
+
+               const RuleToRun *toRun = &rulesToRun[runIdx];
+               if (toRun->rule->applyRuleOnCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+                  *toRun->ruleLog, rulesLog.tileGrid[layerIdx],
+#endif
+                  tileGrid, intGrid, cellX, cellY, randomSeed, layer.cellPixelSize, toRun->rulePriority, runSettings))
+               {
+                  break;
+               }
+            }
+            continue;
+         }
+
+         const RuleToRun &toRun = rulesToRun[match.ruleNum];
+         toRun.rule->placeMatchedCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            *toRun.ruleLog, rulesLog.tileGrid[layerIdx],
+#endif
+            tileGrid, cellX, cellY, match.flags, randomSeed, layer.cellPixelSize, toRun.rulePriority, runSettings);
+      } // for cellX
+   } // for cellY
+}
+
+void LdtkDefFile::runRulesOnLayerWithMatchMemo(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+   const std::vector<int32_t> &runIdxOfRule, const int memoPatternSize, const uint32_t randomSeed, const uint8_t runSettings) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   std::cout << "Running " << rulesToRun.size() << " Rules on layer idx " << layerIdx << " with remembered matches, random seed is " << randomSeed << std::endl;
+   for (auto toRun = rulesToRun.cbegin(), end = rulesToRun.cend(); toRun != end; ++toRun)
+   {
+      toRun->ruleLog->matchedCells.clear();
+   }
+#endif
+
+   MatchMemo memo;
+   memo.begin(intGrid, memoPatternSize);
+
+   // Same as with the NeighbourhoodTable, each cell only ever gets the tile of the first Rule that matches it,
+   // so this can go one cell at a time.
+   for (int cellY = 0; cellY < intGrid.getHeight(); ++cellY)
+   {
+      memo.beginRow(cellY);
+
+      for (int cellX = 0; cellX < intGrid.getWidth(); ++cellX)
+      {
+         // the memo has to be moved along even for cells that get skipped
+         MatchMemo::Match match;
+         const bool known = memo.next(match);
+
+         if (!tileGrid.canStillPlaceTiles(cellX, cellY))
+         {
+            continue;
+         }
+
+         if (!known)
+         {
+            match = MatchMemo::Match{ NeighbourhoodTable::NO_MATCH, 0 };
+
+            const uint32_t *candidate;
+            const uint32_t *candidateEnd;
+            compiledRules.getCenterCandidates(intGrid(cellX, cellY), candidate, candidateEnd);
+            for (; candidate != candidateEnd; ++candidate)
+            {
+               const int32_t n = runIdxOfRule[*candidate];
+               if (n < 0)
+               {
+                  continue;
+               }
+
+               const int8_t result = rulesToRun[n].rule->passesRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+                  *rulesToRun[n].ruleLog,
+#endif
+                  intGrid, cellX, cellY, randomSeed);
+
+               if (result != RuleResult::Fail)
+               {
+                  match = MatchMemo::Match{ static_cast<uint16_t>(n), static_cast<uint8_t>(result) };
+                  break;
+               }
+            }
+            memo.remember(match);
+         }
+
+         if (match.ruleNum == NeighbourhoodTable::NO_MATCH)
+         {
+            continue;
+         }
+
+         const RuleToRun &toRun = rulesToRun[match.ruleNum];
+         toRun.rule->placeMatchedCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            *toRun.ruleLog, rulesLog.tileGrid[layerIdx],
+#endif
+            tileGrid, cellX, cellY, match.flags, randomSeed, layer.cellPixelSize, toRun.rulePriority, runSettings);
+      } // for cellX
+   } // for cellY
+}
+
+void LdtkDefFile::runRulesOnLayerOneByOne(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+   const IntGridPlanes &planes, const uint32_t randomSeed, const uint8_t runSettings) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+
+   for (auto toRun = rulesToRun.cbegin(), end = rulesToRun.cend(); toRun != end; ++toRun)
+   {
+      if (tileGrid.getOpenCellCount() == 0)
+      {
+         // every cell is finalized, the remaining Rules can't place anything
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         std::cout << "Every cell of layer idx " << layerIdx << " is finalized, skipping the remaining " << (end - toRun) << " Rules" << std::endl;
+         for (; toRun != end; ++toRun)
+         {
+            toRun->ruleLog->matchedCells.clear();
+         }
+#endif
+         break;
+      }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      std::cout << "Running Rule " << toRun->rule->uid << " of RuleGroup \"" << toRun->ruleGroup->name << "\" on layer idx " << layerIdx << " with random seed is " << randomSeed << std::endl;
+#endif
+
+      toRun->rule->applyRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         *toRun->ruleLog, rulesLog.tileGrid[layerIdx],
+#endif
+         tileGrid, intGrid, planes, compiledRules.getChecks(toRun->ruleIdx), compiledRules.getCheckCount(toRun->ruleIdx),
+         randomSeed, layer.cellPixelSize, toRun->rulePriority, runSettings);
+   }
+}
+
+void LdtkDefFile::runRulesOnLayerInBatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+   const IntGridPlanes &planes, const uint32_t randomSeed, const uint8_t runSettings, const unsigned int ruleThreadCount) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+
+   // Matching a Rule only reads the IntGrid (and which cells were finalized before the batch),
+   // so that's done for a batch of Rules at the same time.
+   // Placing the tiles depends on what the previous Rules placed, so that's done afterwards,
+   // one Rule after another, in the same order as above. The batch size limits how much memory the matches take.
+   const size_t batchSize = static_cast<size_t>(ruleThreadCount) * 4;
+   std::vector<Rule::Matches> matches(std::min(batchSize, rulesToRun.size()));
+
+   for (size_t batchStart = 0; batchStart < rulesToRun.size(); batchStart += batchSize)
+   {
+      if (tileGrid.getOpenCellCount() == 0)
+      {
+         // every cell is finalized, the remaining Rules can't place anything
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         std::cout << "Every cell of layer idx " << layerIdx << " is finalized, skipping the remaining " << (rulesToRun.size() - batchStart) << " Rules" << std::endl;
+         for (size_t n = batchStart; n < rulesToRun.size(); ++n)
+         {
+            rulesToRun[n].ruleLog->matchedCells.clear();
+         }
+#endif
+         break;
+      }
+
+      const size_t batchLen = std::min(batchSize, rulesToRun.size() - batchStart);
+
+      // when there are fewer Rules than threads (like in the last batch), use the extra threads on the rows of each Rule
+      const unsigned int bandThreadCount = static_cast<unsigned int>(std::max<size_t>(1, ruleThreadCount / batchLen));
+
+      ParallelUtility::parallelFor(batchLen, ruleThreadCount, [&](const size_t n)
+      {
+         const RuleToRun &toRun = rulesToRun[batchStart + n];
+         toRun.rule->matchRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            *toRun.ruleLog,
+#endif
+            intGrid, planes, compiledRules.getChecks(toRun.ruleIdx), compiledRules.getCheckCount(toRun.ruleIdx),
+            randomSeed, matches[n], bandThreadCount, &tileGrid);
+      });
+
+      for (size_t n = 0; n < batchLen; ++n)
+      {
+         const RuleToRun &toRun = rulesToRun[batchStart + n];
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         std::cout << "Running Rule " << toRun.rule->uid << " of RuleGroup \"" << toRun.ruleGroup->name << "\" on layer idx " << layerIdx << " with random seed is " << randomSeed << std::endl;
+#endif
+
+         toRun.rule->placeMatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            *toRun.ruleLog, rulesLog.tileGrid[layerIdx],
+#endif
+            tileGrid, matches[n], randomSeed, layer.cellPixelSize, toRun.rulePriority, runSettings);
+      }
+   }
+}
+
+void LdtkDefFile::runRulesIncremental(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const uint8_t runSettings, const unsigned int threadCount) const
+{
+   auto &intGrid = level.getIntGrid();
+
+   if (intGrid.getWidth() == 0 || intGrid.getHeight() == 0)
+   {
+      // can't proceed, level size is wrong
+      return;
+   }
+
+   level.setTileGridCount(m_layers.size());
+
+   // RandomizeSeeds only decides which seed a layer starts with, not where the tiles go
+   const uint8_t historyRunSettings = runSettings & ~RunSettings::RandomizeSeeds;
+
+   // Layers that have a history keep the seed they had. The rest pick theirs the
+   // same way runRules does, in layer order, before any layer starts.
+   std::vector<uint32_t> randomSeeds(m_layers.size());
+   for (size_t layerIdx = 0, end = m_layers.size(); layerIdx < end; ++layerIdx)
+   {
+      const PlacementHistory *history = level.getPlacementHistory(layerIdx);
+      if (!history->placed.empty())
+      {
+         randomSeeds[layerIdx] = history->randomSeed;
+      }
+      else if (RunSettings::hasRandomizeSeeds(runSettings))
+      {
+         randomSeeds[layerIdx] = rand();
+      }
+      else
+      {
+         randomSeeds[layerIdx] = m_layers[layerIdx].initialRandomSeed;
+      }
+   }
+
+   const unsigned int totalThreadCount = (threadCount == 0) ? ParallelUtility::getDefaultThreadCount() : threadCount;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   rulesLog.tileGrid.resize(m_layers.size(), RulesLog::RulesInGrid_t());
+   for (size_t layerIdx = 0, end = m_layers.size(); layerIdx < end; ++layerIdx)
+   {
+      rulesLog.tileGrid[layerIdx].resize(intGrid.size(), RulesLog::RulesInCell_t());
+   }
+
+   // all layers write to the same RulesLog, so don't run them at the same time
+   const unsigned int layerThreadCount = 1;
+#else
+   const unsigned int layerThreadCount = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(totalThreadCount, m_layers.size())));
+#endif
+   const unsigned int ruleThreadCount = std::max(1u, totalThreadCount / layerThreadCount);
+
+   // count them now, so the layers only read them
+   level.getIntGridValueCounts();
+
+   const std::vector<CellArea> &dirtyAreas = level.getDirtyAreas();
+
+   ParallelUtility::parallelFor(m_layers.size(), layerThreadCount, [&](const size_t layerIdx)
+   {
+      auto &tileGrid = level.getTileGridByIdx(layerIdx);
+      PlacementHistory &history = *level.getPlacementHistory(layerIdx);
+
+      tileGrid.setLayerUid(m_layers[layerIdx].uid);
+
+      std::vector<RuleToRun> rulesToRun;
+      getRulesToRun(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         m_layers[layerIdx], rulesToRun);
+
+      if (rulesToRun.size() > UINT8_MAX)
+      {
+         // The rule priorities wrap around, so a later Rule could look like it was placed
+         // before an earlier one. The history can't tell those apart, so don't keep one.
+         tileGrid.cleanUp();
+         runRulesOnLayer(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            rulesLog,
+#endif
+            level, layerIdx, randomSeeds[layerIdx], historyRunSettings, ruleThreadCount);
+         return;
+      }
+
+      CompiledRules compiledNow;
+      const CompiledRules &compiledRules = getCompiledRules(m_layers[layerIdx], compiledNow);
+
+      std::vector<uint32_t> runRuleIdxs(rulesToRun.size());
+      std::vector<uint64_t> runRuleRevisions(rulesToRun.size());
+      for (size_t n = 0; n < rulesToRun.size(); ++n)
+      {
+         runRuleIdxs[n] = static_cast<uint32_t>(rulesToRun[n].ruleIdx);
+         runRuleRevisions[n] = compiledRules.ruleRevisions[rulesToRun[n].ruleIdx];
+      }
+
+      if (history.isFilledFor(runRuleIdxs, runRuleRevisions, randomSeeds[layerIdx], historyRunSettings, intGrid.getWidth(), intGrid.getHeight()))
+      {
+         if (dirtyAreas.empty())
+         {
+            // nothing changed since last time
+            return;
          }
 
+         if (rebuildDirtyAreas(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-         if (rulesLog.rule.count(rule->uid) == 0)
+            rulesLog,
+#endif
+            level, layerIdx, rulesToRun, historyRunSettings, dirtyAreas, history))
          {
-            rulesLog.rule.insert(std::make_pair(rule->uid, RuleLog()));
+            return;
          }
-         std::cout << "Running Rule " << rule->uid << " of RuleGroup \"" << ruleGroup->name << "\" on layer idx " << layerIdx << " with random seed is " << randomSeed << std::endl;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         std::cout << "Changes on layer idx " << layerIdx << " spread too far, running the Rules on the whole layer" << std::endl;
 #endif
+      }
 
-         rule->applyRule(
+      runRulesOnLayerWithHistory(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-            rulesLog.rule[rule->uid], rulesLog.tileGrid[layerIdx],
+         rulesLog,
 #endif
-            tileGrid, intGrid, randomSeed, layer.cellPixelSize, rulePriority, runSettings);
+         level, layerIdx, compiledRules, rulesToRun, randomSeeds[layerIdx], historyRunSettings, ruleThreadCount, history);
+   });
 
-         ++rulePriority;
+   level.clearDirtyAreas();
+}
+
+void LdtkDefFile::runRulesOnLayerFromCheckpoints(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+   const uint32_t randomSeed, const uint8_t runSettings, const unsigned int threadCount, RuleCheckpoints &checkpoints) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+
+   std::vector<uint32_t> runRuleIdxs(rulesToRun.size());
+   std::vector<uint64_t> runRuleRevisions(rulesToRun.size());
+   for (size_t n = 0; n < rulesToRun.size(); ++n)
+   {
+      runRuleIdxs[n] = static_cast<uint32_t>(rulesToRun[n].ruleIdx);
+      runRuleRevisions[n] = compiledRules.ruleRevisions[rulesToRun[n].ruleIdx];
+   }
+
+   const size_t reusedCount = checkpoints.getReusableRuleCount(runRuleIdxs, runRuleRevisions, randomSeed, runSettings, intGrid.getWidth(), intGrid.getHeight());
+   checkpoints.resume(reusedCount, runRuleIdxs, runRuleRevisions, randomSeed, runSettings, intGrid.getWidth(), intGrid.getHeight());
+
+   // Nothing changed before the first edited Rule, so the TileGrid is brought back to how it was right before it.
+   tileGrid.cleanUp();
+   for (size_t n = 0; n < reusedCount; ++n)
+   {
+      for (uint32_t tileIdx = checkpoints.tileStarts[n], tileEnd = checkpoints.tileStarts[n + 1]; tileIdx < tileEnd; ++tileIdx)
+      {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog.tileGrid[layerIdx][checkpoints.cellIdxs[tileIdx]].push_back(rulesToRun[n].rule->uid);
+#endif
+         tileGrid.putTile(checkpoints.cellIdxs[tileIdx], checkpoints.tiles[tileIdx]);
+      }
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   std::cout << "Running " << (rulesToRun.size() - reusedCount) << " of " << rulesToRun.size() << " Rules on layer idx " << layerIdx <<
+      " from the checkpoints, random seed is " << randomSeed << std::endl;
+#endif
+
+   if (reusedCount < rulesToRun.size())
+   {
+      IntGridPlanes planes;
+      planes.build(intGrid, compiledRules.planeValues, compiledRules.haloSize);
+      planes.buildAreaSums();
+
+      const std::vector<uint32_t> &valueCounts = level.getIntGridValueCounts();
+      const unsigned int bandThreadCount = (threadCount == 0) ? ParallelUtility::getDefaultThreadCount() : threadCount;
+
+      // Same as running the Rules one after another in runRulesOnLayer, noting down the tiles of each one.
+      // Rules that don't get run still get their (empty) place in the checkpoints.
+      Rule::Matches matches;
+      for (size_t n = reusedCount; n < rulesToRun.size(); ++n)
+      {
+         const RuleToRun &toRun = rulesToRun[n];
+         const size_t firstTileIdx = tileGrid.getPendingTileCount();
+
+         if (tileGrid.getOpenCellCount() == 0)
+         {
+            // every cell is finalized, the remaining Rules can't place anything
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            toRun.ruleLog->matchedCells.clear();
+#endif
+         }
+         else if (!toRun.rule->canMatchValueCounts(valueCounts, intGrid.size()))
+         {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            toRun.ruleLog->matchedCells.clear();
+#endif
+         }
+         else
+         {
+            toRun.rule->matchRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+               *toRun.ruleLog,
+#endif
+               intGrid, planes, compiledRules.getChecks(toRun.ruleIdx), compiledRules.getCheckCount(toRun.ruleIdx),
+               randomSeed, matches, bandThreadCount, &tileGrid);
+
+            toRun.rule->placeMatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+               *toRun.ruleLog, rulesLog.tileGrid[layerIdx],
+#endif
+               tileGrid, matches, randomSeed, layer.cellPixelSize, toRun.rulePriority, runSettings);
+         }
+
+         tileGrid.copyPendingTiles(firstTileIdx, checkpoints.cellIdxs, checkpoints.tiles);
+         checkpoints.endRule();
+      }
+   }
+
+   tileGrid.compact();
+}
+
+void LdtkDefFile::runRulesOnLayerWithHistory(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const CompiledRules &compiledRules, const std::vector<RuleToRun> &rulesToRun,
+   const uint32_t randomSeed, const uint8_t runSettings, const unsigned int threadCount, PlacementHistory &history) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+
+   tileGrid.cleanUp();
+   tileGrid.setRandomSeed(randomSeed);
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   for (auto cell = rulesLog.tileGrid[layerIdx].begin(), end = rulesLog.tileGrid[layerIdx].end(); cell != end; ++cell)
+   {
+      cell->clear();
+   }
+   std::cout << "Running " << rulesToRun.size() << " Rules on layer idx " << layerIdx << " and keeping where they placed tiles, random seed is " << randomSeed << std::endl;
+#endif
+
+   std::vector<uint32_t> runRuleIdxs(rulesToRun.size());
+   std::vector<uint64_t> runRuleRevisions(rulesToRun.size());
+   for (size_t n = 0; n < rulesToRun.size(); ++n)
+   {
+      runRuleIdxs[n] = static_cast<uint32_t>(rulesToRun[n].ruleIdx);
+      runRuleRevisions[n] = compiledRules.ruleRevisions[rulesToRun[n].ruleIdx];
+   }
+   history.reset(runRuleIdxs, runRuleRevisions, randomSeed, runSettings, intGrid.getWidth(), intGrid.getHeight());
+
+   IntGridPlanes planes;
+   planes.build(intGrid, compiledRules.planeValues, compiledRules.haloSize);
+   planes.buildAreaSums();
+
+   const std::vector<uint32_t> &valueCounts = level.getIntGridValueCounts();
+   const unsigned int bandThreadCount = (threadCount == 0) ? ParallelUtility::getDefaultThreadCount() : threadCount;
+
+   // Same as running the Rules one after another in runRulesOnLayer. Every Rule in rulesToRun
+   // has its own place in the history, even the ones that end up not being run.
+   Rule::Matches matches;
+   for (size_t n = 0; n < rulesToRun.size(); ++n)
+   {
+      const RuleToRun &toRun = rulesToRun[n];
+
+      if (tileGrid.getOpenCellCount() == 0)
+      {
+         // every cell is finalized, the remaining Rules can't place anything
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         for (; n < rulesToRun.size(); ++n)
+         {
+            rulesToRun[n].ruleLog->matchedCells.clear();
+         }
+#endif
+         break;
+      }
+
+      if (!toRun.rule->canMatchValueCounts(valueCounts, intGrid.size()))
+      {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         toRun.ruleLog->matchedCells.clear();
+#endif
+         continue;
+      }
+
+      toRun.rule->matchRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         *toRun.ruleLog,
+#endif
+         intGrid, planes, compiledRules.getChecks(toRun.ruleIdx), compiledRules.getCheckCount(toRun.ruleIdx),
+         randomSeed, matches, bandThreadCount, &tileGrid);
+
+      toRun.rule->placeMatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         *toRun.ruleLog, rulesLog.tileGrid[layerIdx],
+#endif
+         tileGrid, matches, randomSeed, layer.cellPixelSize, toRun.rulePriority, runSettings, history.getRow(n, 0));
+   }
+
+   tileGrid.compact();
+}
+
+bool LdtkDefFile::rebuildDirtyAreas(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   Level &level, const size_t layerIdx, const std::vector<RuleToRun> &rulesToRun, const uint8_t runSettings,
+   const std::vector<CellArea> &dirtyAreas, PlacementHistory &history) const
+{
+   auto &intGrid = level.getIntGrid();
+   auto &layer = m_layers[layerIdx];
+   auto &tileGrid = level.getTileGridByIdx(layerIdx);
+
+   const int width = intGrid.getWidth();
+   const int height = intGrid.getHeight();
+   const int randomSeed = static_cast<int>(history.randomSeed);
+
+   // Changing a cell changes what the patterns see up to patternRadius cells away from it,
+   // and the tiles of a matched cell can land up to placementReach cells away from it.
+   int patternRadius = 0;
+   int placementReach = 1;
+   for (auto toRun = rulesToRun.cbegin(), end = rulesToRun.cend(); toRun != end; ++toRun)
+   {
+      patternRadius = std::max(patternRadius, static_cast<int>(toRun->rule->patternSize / 2));
+      placementReach = std::max(placementReach, toRun->rule->getPlacementReach(layer.cellPixelSize));
+   }
+
+   // Cells this close to the edge of an area (unless it's the edge of the grid) are run again like the rest,
+   // but they're also checked against the history. If they all come out the same, nothing outside the area changes.
+   const int border = 2 * placementReach;
+
+   std::vector<CellArea> areas;
+   for (auto dirtyArea = dirtyAreas.cbegin(), end = dirtyAreas.cend(); dirtyArea != end; ++dirtyArea)
+   {
+      areas.push_back(dirtyArea->getExpanded(patternRadius + border).getClamped(width, height));
+   }
+
+   std::vector<uint8_t> oldPriority(intGrid.size());
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   // what's logged while running the areas isn't complete for the cells outside them
+   RuleLog areaRuleLog;
+   RulesLog::RulesInGrid_t areaTileGridLog;
+#endif
+
+   while (true)
+   {
+      // Areas that are close enough for their borders to reach each other are merged,
+      // so each area's border only has cells from outside any area next to it.
+      for (bool merged = true; merged;)
+      {
+         merged = false;
+         for (size_t a = 0; a < areas.size() && !merged; ++a)
+         {
+            for (size_t b = a + 1; b < areas.size(); ++b)
+            {
+               if (areas[a].getExpanded(border + 1).overlaps(areas[b]))
+               {
+                  areas[a].add(areas[b]);
+                  areas.erase(areas.begin() + b);
+                  merged = true;
+                  break;
+               }
+            }
+         }
+      }
+
+      size_t areaCellCount = 0;
+      for (auto area = areas.cbegin(), end = areas.cend(); area != end; ++area)
+      {
+         areaCellCount += static_cast<size_t>(area->getWidth()) * area->getHeight();
+      }
+      if (areaCellCount * 2 >= intGrid.size())
+      {
+         // it'd be faster to just run the whole layer
+         return false;
+      }
+
+      auto isInBorder = [&](const CellArea &area, const int cellX, const int cellY)
+      {
+         return (area.left > 0 && cellX < area.left + border) || (area.right < width - 1 && cellX > area.right - border) ||
+            (area.top > 0 && cellY < area.top + border) || (area.bottom < height - 1 && cellY > area.bottom - border);
+      };
+
+      for (auto area = areas.cbegin(), end = areas.cend(); area != end; ++area)
+      {
+         for (int cellY = area->top; cellY <= area->bottom; ++cellY)
+         {
+            for (int cellX = area->left; cellX <= area->right; ++cellX)
+            {
+               if (isInBorder(*area, cellX, cellY))
+               {
+                  oldPriority[GridUtility::getIndex(cellX, cellY, width)] = tileGrid.getHighestPriority(cellX, cellY);
+               }
+            }
+         }
+         tileGrid.cleanUpArea(*area);
+      }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      std::cout << "Running " << rulesToRun.size() << " Rules on " << areas.size() << " areas of layer idx " << layerIdx << ", " << areaCellCount << " cells in total" << std::endl;
+      areaTileGridLog.assign(intGrid.size(), RulesLog::RulesInCell_t());
+#endif
+
+      // Go through the Rules in order, the same as runRulesOnLayer would, but only on the cells
+      // that can place tiles in the areas. Inside the areas, the Rules are checked again.
+      // Outside, the cells are placed on exactly like the history says, so that the tiles they put
+      // in the areas are there again (the ones outside the areas are still there from last time).
+      bool isSame = true;
+      for (size_t n = 0; n < rulesToRun.size() && isSame; ++n)
+      {
+         const RuleToRun &toRun = rulesToRun[n];
+
+         for (auto area = areas.cbegin(), end = areas.cend(); area != end && isSame; ++area)
+         {
+            const CellArea sources = area->getExpanded(placementReach).getClamped(width, height);
+            for (int cellY = sources.top; cellY <= sources.bottom && isSame; ++cellY)
+            {
+               for (int cellX = sources.left; cellX <= sources.right; ++cellX)
+               {
+                  int8_t result = RuleResult::Fail;
+                  if (area->contains(cellX, cellY))
+                  {
+                     if (tileGrid.canStillPlaceTiles(cellX, cellY))
+                     {
+                        result = toRun.rule->passesRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+                           areaRuleLog,
+#endif
+                           intGrid, cellX, cellY, randomSeed);
+                     }
+
+                     const bool isPlaced = result != RuleResult::Fail;
+                     if (isInBorder(*area, cellX, cellY) && isPlaced != history.wasPlaced(n, cellX, cellY))
+                     {
+                        isSame = false;
+                        break;
+                     }
+                     history.setPlaced(n, cellX, cellY, isPlaced);
+                  }
+                  else if (history.wasPlaced(n, cellX, cellY))
+                  {
+                     // only for the flags, it's already known that it passes
+                     result = toRun.rule->passesRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+                        areaRuleLog,
+#endif
+                        intGrid, cellX, cellY, randomSeed);
+
+                     ASSERT(result != RuleResult::Fail, "For Rule " << toRun.rule->uid << ", cell (" << cellX << ", " << cellY << ") outside of the changed areas doesn't pass the Rule anymore");
+                  }
+
+                  if (result == RuleResult::Fail)
+                  {
+                     continue;
+                  }
+
+                  toRun.rule->placeMatchedCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+                     areaRuleLog, areaTileGridLog,
+#endif
+                     tileGrid, cellX, cellY, static_cast<uint8_t>(result), randomSeed, layer.cellPixelSize, toRun.rulePriority, runSettings);
+               } // for cellX
+            } // for cellY
+         } // for area
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         areaRuleLog.matchedCells.clear();
+#endif
       } // for Rule
-   } // for RuleGroup
+
+      // The stamp tiles outside the areas were moved (or not) depending on the priority of the cells next to them.
+      for (auto area = areas.cbegin(), end = areas.cend(); area != end && isSame; ++area)
+      {
+         for (int cellY = area->top; cellY <= area->bottom && isSame; ++cellY)
+         {
+            for (int cellX = area->left; cellX <= area->right; ++cellX)
+            {
+               if (isInBorder(*area, cellX, cellY) && tileGrid.getHighestPriority(cellX, cellY) != oldPriority[GridUtility::getIndex(cellX, cellY, width)])
+               {
+                  isSame = false;
+                  break;
+               }
+            }
+         }
+      }
+
+      if (isSame)
+      {
+         // the tiles placed outside the areas are already there
+         tileGrid.discardPendingTiles(areas);
+         tileGrid.compact();
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         for (auto area = areas.cbegin(), end = areas.cend(); area != end; ++area)
+         {
+            for (int cellY = area->top; cellY <= area->bottom; ++cellY)
+            {
+               for (int cellX = area->left; cellX <= area->right; ++cellX)
+               {
+                  const size_t cellIdx = GridUtility::getIndex(cellX, cellY, width);
+                  rulesLog.tileGrid[layerIdx][cellIdx] = std::move(areaTileGridLog[cellIdx]);
+               }
+            }
+         }
+#endif
+         return true;
+      }
+
+      // The change spread past the border. Try again with bigger areas, far enough out
+      // that the cells the failed try changed (up to 2 * placementReach outside the areas) are cleaned up,
+      // and aren't in the new border either. The history inside the old areas gets filled in again.
+      tileGrid.discardPendingTiles(std::vector<CellArea>());
+      for (auto area = areas.begin(), end = areas.end(); area != end; ++area)
+      {
+         const int growth = std::max((2 * border) + 1, std::max(area->getWidth(), area->getHeight()));
+         *area = area->getExpanded(growth).getClamped(width, height);
+      }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      std::cout << "Changes on layer idx " << layerIdx << " spread past the border, trying again with bigger areas" << std::endl;
+#endif
+   }
 }
 
 void LdtkDefFile::debugPrintRule(std::ostream &outStream, int ruleUid) const
@@ -1006,4 +2594,50 @@ void LdtkDefFile::debugPrintRule(std::ostream &outStream, int ruleUid) const
    } // for Layer
 }
 
+size_t LdtkDefFile::debugPrintDeadRules(std::ostream &outStream) const
+{
+   size_t deadCount = 0;
+   for (auto layer = m_layers.cbegin(), layerEnd = m_layers.cend(); layer != layerEnd; ++layer)
+   {
+      const std::vector<uint8_t> &deadRules = layer->compiledRules.deadRules;
+
+      size_t ruleIdx = 0;
+      for (auto ruleGroup = layer->ruleGroups.cbegin(), ruleGroupEnd = layer->ruleGroups.cend(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+      {
+         for (auto rule = ruleGroup->rules.cbegin(), ruleEnd = ruleGroup->rules.cend(); rule != ruleEnd; ++rule, ++ruleIdx)
+         {
+            if (ruleIdx >= deadRules.size() || deadRules[ruleIdx] == DeadRule::None)
+            {
+               continue;
+            }
+
+            outStream << "Layer \"" << layer->name << "\", RuleGroup \"" << ruleGroup->name << "\", Rule " << rule->uid << ": ";
+            if (deadRules[ruleIdx] == DeadRule::Shadowed)
+            {
+               // find the Rule that shadows it, for its uid
+               size_t shadowingIdx = layer->compiledRules.shadowingRules[ruleIdx];
+               for (auto otherGroup = layer->ruleGroups.cbegin(); otherGroup != ruleGroupEnd; ++otherGroup)
+               {
+                  if (shadowingIdx < otherGroup->rules.size())
+                  {
+                     outStream << "always shadowed by Rule " << otherGroup->rules[shadowingIdx].uid;
+                     break;
+                  }
+                  shadowingIdx -= otherGroup->rules.size();
+               }
+            }
+            else
+            {
+               outStream << "needs an IntGridValue that the layer doesn't have";
+            }
+            outStream << std::endl;
+
+            ++deadCount;
+         } // for Rule
+      } // for RuleGroup
+   } // for Layer
+
+   return deadCount;
+}
+
 } // namespace ldtkimport
@@ -0,0 +1,187 @@
+#include "ldtkimport/MatchMemo.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "ldtkimport/AssertUtility.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief What a cell outside the IntGrid is stored as in a window, if it's to the left or right of the IntGrid.
+ *  The same as how Rule::passesRule tells them apart for horizontalOutOfBoundsValue.
+ */
+static constexpr uint32_t OUT_OF_BOUNDS_HORIZONTAL = 0;
+
+/**
+ *  @brief What a cell outside the IntGrid is stored as in a window, if it's above, below, or diagonal to the IntGrid.
+ *  The same as how Rule::passesRule tells them apart for verticalOutOfBoundsValue.
+ */
+static constexpr uint32_t OUT_OF_BOUNDS_VERTICAL = 1;
+
+static constexpr uint64_t HASH_ROW_BASE = 0x9E3779B97F4A7C15ull;
+static constexpr uint64_t HASH_COLUMN_BASE = 0xC2B2AE3D27D4EB4Full;
+
+/**
+ *  @brief Spread out the bits of the rolled hash, so that windows that only differ a little don't end up
+ *  next to each other in the hash map.
+ */
+static uint64_t mixHash(uint64_t hash)
+{
+   hash ^= hash >> 33;
+   hash *= 0xFF51AFD7ED558CCDull;
+   hash ^= hash >> 33;
+   hash *= 0xC4CEB9FE1A85EC53ull;
+   hash ^= hash >> 33;
+   return hash;
+}
+
+void MatchMemo::begin(const IntGrid &cells, const int patternSize)
+{
+   ASSERT(patternSize > 0 && (patternSize % 2) == 1, "patternSize should be an odd number, got: " << patternSize);
+
+   m_cells = &cells;
+   m_width = cells.getWidth();
+   m_height = cells.getHeight();
+   m_patternSize = patternSize;
+   m_paddedWidth = m_width + (patternSize - 1);
+
+   m_rows.resize(static_cast<size_t>(m_paddedWidth) * patternSize);
+   m_columnHashes.resize(m_paddedWidth);
+
+   m_highestPower = 1;
+   for (int n = 1; n < patternSize; ++n)
+   {
+      m_highestPower *= HASH_ROW_BASE;
+   }
+
+   m_nextX = 0;
+   m_hash = 0;
+
+   m_lookup.clear();
+   m_windows.clear();
+   m_matches.clear();
+}
+
+void MatchMemo::beginRow(const int cellY)
+{
+   ASSERT(m_cells != nullptr, "begin() should be called first");
+
+   const int radius = m_patternSize / 2;
+
+   for (int windowY = 0; windowY < m_patternSize; ++windowY)
+   {
+      const int y = cellY - radius + windowY;
+      const bool withinVertical = m_cells->isWithinVerticalBounds(y);
+      uint32_t *row = m_rows.data() + (static_cast<size_t>(windowY) * m_paddedWidth);
+
+      for (int column = 0; column < m_paddedWidth; ++column)
+      {
+         const int x = column - radius;
+         if (!withinVertical)
+         {
+            row[column] = OUT_OF_BOUNDS_VERTICAL;
+         }
+         else if (!m_cells->isWithinHorizontalBounds(x))
+         {
+            row[column] = OUT_OF_BOUNDS_HORIZONTAL;
+         }
+         else
+         {
+            row[column] = static_cast<uint32_t>((*m_cells)(x, y)) + 2;
+         }
+      }
+   }
+
+   for (int column = 0; column < m_paddedWidth; ++column)
+   {
+      uint64_t columnHash = 0;
+      for (int windowY = 0; windowY < m_patternSize; ++windowY)
+      {
+         columnHash = (columnHash * HASH_COLUMN_BASE) + m_rows[(static_cast<size_t>(windowY) * m_paddedWidth) + column] + 1;
+      }
+      m_columnHashes[column] = columnHash;
+   }
+
+   m_hash = 0;
+   for (int column = 0; column < m_patternSize; ++column)
+   {
+      m_hash = (m_hash * HASH_ROW_BASE) + m_columnHashes[column];
+   }
+
+   m_nextX = 0;
+}
+
+bool MatchMemo::isSameWindow(const uint32_t *window, const uint32_t *stored) const
+{
+   for (int windowY = 0; windowY < m_patternSize; ++windowY)
+   {
+      if (!std::equal(stored, stored + m_patternSize, window))
+      {
+         return false;
+      }
+      window += m_paddedWidth;
+      stored += m_patternSize;
+   }
+   return true;
+}
+
+bool MatchMemo::next(Match &outMatch)
+{
+   ASSERT(m_nextX < m_width, "went past the end of the row");
+
+   const int cellX = m_nextX;
+   if (cellX > 0)
+   {
+      // roll the leftmost column out, and the new column in
+      m_hash = ((m_hash - (m_columnHashes[cellX - 1] * m_highestPower)) * HASH_ROW_BASE) +
+         m_columnHashes[cellX + m_patternSize - 1];
+   }
+   ++m_nextX;
+
+   auto found = m_lookup.find(mixHash(m_hash));
+   if (found == m_lookup.end())
+   {
+      return false;
+   }
+
+   const size_t windowSize = static_cast<size_t>(m_patternSize) * m_patternSize;
+   if (!isSameWindow(getWindow(cellX), m_windows.data() + (found->second * windowSize)))
+   {
+      // hash collision
+      return false;
+   }
+
+   outMatch = m_matches[found->second];
+   return true;
+}
+
+void MatchMemo::remember(const Match &match)
+{
+   ASSERT(m_nextX > 0, "next() should be called first");
+
+   if (m_matches.size() >= m_maxEntries)
+   {
+      return;
+   }
+
+   // if the key is already taken, this is a window that collided with another one,
+   // and it'll just have its Rules checked each time
+   auto inserted = m_lookup.try_emplace(mixHash(m_hash), static_cast<uint32_t>(m_matches.size()));
+   if (!inserted.second)
+   {
+      return;
+   }
+
+   const uint32_t *window = getWindow(m_nextX - 1);
+   for (int windowY = 0; windowY < m_patternSize; ++windowY)
+   {
+      m_windows.insert(m_windows.end(), window, window + m_patternSize);
+      window += m_paddedWidth;
+   }
+   m_matches.push_back(match);
+}
+
+} // namespace ldtkimport
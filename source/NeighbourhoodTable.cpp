@@ -0,0 +1,268 @@
+#include "ldtkimport/NeighbourhoodTable.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "ldtkimport/AssertUtility.h"
+#include "ldtkimport/GridUtility.h"
+#include "ldtkimport/TileFlags.h"
+
+
+namespace ldtkimport
+{
+
+/**
+ *  @brief Whether a Rule's settings (aside from its pattern values) allow it to be put in a NeighbourhoodTable.
+ */
+static bool fitsTable(const Rule &rule)
+{
+   return (rule.patternSize == 1 || rule.patternSize == 3) &&
+      rule.pattern.size() == static_cast<size_t>(rule.patternSize) * rule.patternSize &&
+      rule.isCellLocal();
+}
+
+/**
+ *  @brief Same rules as in Rule::matchesCell.
+ */
+static bool passesPatternValue(const pattern_t patternValue, const intgridvalue_t intGridValue)
+{
+   if (patternValue == RULE_PATTERN_ANYTHING)
+   {
+      return intGridValue != 0;
+   }
+   else if (patternValue == RULE_PATTERN_NOTHING)
+   {
+      return intGridValue == 0;
+   }
+   else if (patternValue > 0)
+   {
+      return intGridValue == patternValue;
+   }
+   return intGridValue != -patternValue;
+}
+
+bool NeighbourhoodTable::build(const std::vector<RuleGroup> &ruleGroups)
+{
+   clear();
+
+   std::vector<const Rule *> rules;
+
+   uint32_t ruleIdx = 0;
+   for (auto ruleGroup = ruleGroups.cbegin(), ruleGroupEnd = ruleGroups.cend(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+   {
+      for (auto rule = ruleGroup->rules.cbegin(), ruleEnd = ruleGroup->rules.cend(); rule != ruleEnd; ++rule, ++ruleIdx)
+      {
+         // same Rules that LdtkDefFile::runRulesOnLayer skips
+         if (!ruleGroup->active || !rule->active || rule->tileIds.size() == 0 || rule->chance <= 0)
+         {
+            continue;
+         }
+
+         if (!fitsTable(*rule))
+         {
+            clear();
+            return false;
+         }
+
+         for (auto patternValue = rule->pattern.cbegin(), patternEnd = rule->pattern.cend(); patternValue != patternEnd; ++patternValue)
+         {
+            if (*patternValue == 0)
+            {
+               continue;
+            }
+
+            if (*patternValue == RULE_PATTERN_ANYTHING || *patternValue == RULE_PATTERN_NOTHING)
+            {
+               m_checksNonZero = true;
+               continue;
+            }
+
+            pattern_t value = *patternValue > 0 ? *patternValue : -*patternValue;
+            if (value > INT_GRID_VALUE_MAX || (m_checksValue && value != m_value))
+            {
+               // more than one IntGridValue
+               clear();
+               return false;
+            }
+
+            m_value = static_cast<intgridvalue_t>(value);
+            m_checksValue = true;
+         }
+
+         m_radius = std::max(m_radius, rule->patternSize / 2);
+         rules.push_back(&*rule);
+         m_ruleIdxs.push_back(ruleIdx);
+      } // for Rule
+   } // for RuleGroup
+
+   if (rules.size() >= CHECK_CELL)
+   {
+      // ruleNum can't hold that many
+      clear();
+      return false;
+   }
+
+   // What a cell whose bit is set stands for. If the patterns don't check for a specific IntGridValue,
+   // the bit only says the cell isn't empty, and any value other than 0 will do.
+   const intgridvalue_t setValue = m_checksValue ? m_value : 1;
+
+   // The flipped versions of the pattern, in the same order as Rule::passesRule checks them.
+   const int8_t directionX[] = { 1, -1, -1, 1 };
+   const int8_t directionY[] = { 1, -1, 1, -1 };
+
+   m_entries.resize(ENTRY_COUNT);
+   for (size_t neighbourhood = 0; neighbourhood < ENTRY_COUNT; ++neighbourhood)
+   {
+      Match &entry = m_entries[neighbourhood];
+      entry.ruleNum = NO_MATCH;
+      entry.flags = TileFlags::NoFlags;
+
+      for (size_t ruleNum = 0, ruleLen = rules.size(); ruleNum < ruleLen && entry.ruleNum == NO_MATCH; ++ruleNum)
+      {
+         const Rule &rule = *rules[ruleNum];
+         const int radius = rule.patternSize / 2;
+
+         for (int orientation = 0; orientation < Rule::ORIENTATION_COUNT; ++orientation)
+         {
+            if ((orientation == 1 && !(rule.flipX && rule.flipY)) || (orientation == 2 && !rule.flipX) || (orientation == 3 && !rule.flipY))
+            {
+               continue;
+            }
+
+            bool matches = true;
+            for (int py = 0; py < rule.patternSize && matches; ++py)
+            {
+               for (int px = 0; px < rule.patternSize && matches; ++px)
+               {
+                  pattern_t patternValue = rule.pattern[px + (py * rule.patternSize)];
+                  if (patternValue == 0)
+                  {
+                     continue;
+                  }
+
+                  int offsetX = (px - radius) * directionX[orientation];
+                  int offsetY = (py - radius) * directionY[orientation];
+                  bool isSet = (neighbourhood & (size_t(1) << ((offsetX + 1) + ((offsetY + 1) * 3)))) != 0;
+
+                  matches = passesPatternValue(patternValue, isSet ? setValue : 0);
+               }
+            }
+
+            if (matches)
+            {
+               entry.ruleNum = static_cast<uint16_t>(ruleNum);
+               entry.flags = static_cast<uint8_t>((directionX[orientation] < 0 ? TileFlags::FlippedX : 0) | (directionY[orientation] < 0 ? TileFlags::FlippedY : 0));
+               break;
+            }
+         } // for orientation
+      } // for Rule
+   } // for neighbourhood
+
+   return true;
+}
+
+NeighbourhoodTable::CellClass NeighbourhoodTable::getCellClass(const intgridvalue_t value) const
+{
+   if (value == 0)
+   {
+      return CLASS_UNSET;
+   }
+
+   if (m_checksValue && value == m_value)
+   {
+      return CLASS_SET;
+   }
+
+   if (m_checksValue && m_checksNonZero)
+   {
+      // not the IntGridValue, but not empty either
+      return CLASS_UNKNOWN;
+   }
+
+   // If only the IntGridValue is checked, any other value is the same as being empty.
+   // If only RULE_PATTERN_ANYTHING/NOTHING are checked, any value other than 0 counts.
+   return m_checksNonZero ? CLASS_SET : CLASS_UNSET;
+}
+
+void NeighbourhoodTable::lookUp(const IntGrid &cells, std::vector<Match> &outMatches) const
+{
+   ASSERT(isBuilt(), "NeighbourhoodTable::lookUp called without being built");
+
+   const int width = cells.getWidth();
+   const int height = cells.getHeight();
+
+   outMatches.resize(static_cast<size_t>(width) * height);
+
+   std::vector<uint8_t> classes(static_cast<size_t>(width) * height);
+   for (size_t idx = 0, len = classes.size(); idx < len; ++idx)
+   {
+      classes[idx] = getCellClass(cells(idx));
+   }
+
+   // Get one column of the 3x3 window, as bits 0, 3, and 6 (for the rows above, at, and below y),
+   // so it can be shifted into the column it goes in. Out-of-bounds cells are left unset.
+   auto getColumn = [&](const int x, const int y, uint32_t &outSet, uint32_t &outUnknown)
+   {
+      outSet = 0;
+      outUnknown = 0;
+      for (int row = 0; row < 3; ++row)
+      {
+         int checkY = y + row - 1;
+         if (x < 0 || x >= width || checkY < 0 || checkY >= height)
+         {
+            continue;
+         }
+
+         uint8_t cellClass = classes[GridUtility::getIndex(x, checkY, width)];
+         if (cellClass == CLASS_SET)
+         {
+            outSet |= 1 << (row * 3);
+         }
+         else if (cellClass == CLASS_UNKNOWN)
+         {
+            outUnknown |= 1 << (row * 3);
+         }
+      }
+   };
+
+   constexpr uint32_t KEEP_RIGHT_COLUMNS = 0b011011011;
+
+   for (int cellY = 0; cellY < height; ++cellY)
+   {
+      const bool rowNearEdge = cellY < m_radius || cellY >= height - m_radius;
+
+      // slide the 3x3 window from left to right, one column at a time
+      uint32_t neighbourhood = 0;
+      uint32_t unknown = 0;
+      for (int column = -1; column <= 0; ++column)
+      {
+         uint32_t columnSet, columnUnknown;
+         getColumn(column, cellY, columnSet, columnUnknown);
+         neighbourhood = ((neighbourhood >> 1) & KEEP_RIGHT_COLUMNS) | (columnSet << 2);
+         unknown = ((unknown >> 1) & KEEP_RIGHT_COLUMNS) | (columnUnknown << 2);
+      }
+
+      for (int cellX = 0; cellX < width; ++cellX)
+      {
+         uint32_t columnSet, columnUnknown;
+         getColumn(cellX + 1, cellY, columnSet, columnUnknown);
+         neighbourhood = ((neighbourhood >> 1) & KEEP_RIGHT_COLUMNS) | (columnSet << 2);
+         unknown = ((unknown >> 1) & KEEP_RIGHT_COLUMNS) | (columnUnknown << 2);
+
+         Match &match = outMatches[GridUtility::getIndex(cellX, cellY, width)];
+
+         const bool nearEdge = rowNearEdge || cellX < m_radius || cellX >= width - m_radius;
+         if (nearEdge || (unknown & (m_radius > 0 ? 0b111111111 : 0b000010000)) != 0)
+         {
+            // out-of-bounds values are per Rule, and unknown cells don't fit the index
+            match.ruleNum = CHECK_CELL;
+            match.flags = TileFlags::NoFlags;
+            continue;
+         }
+
+         match = m_entries[neighbourhood];
+      } // for cellX
+   } // for cellY
+}
+
+} // namespace ldtkimport
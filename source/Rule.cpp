@@ -1,5 +1,9 @@
 #include "ldtkimport/Rule.h"
+#include "ldtkimport/ParallelUtility.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -8,6 +12,8 @@
 #include "ldtkimport/GridUtility.h"
 #include "ldtkimport/LdtkDefFile.h"
 #include "ldtkimport/IntGrid.h"
+#include "ldtkimport/IntGridPlanes.h"
+#include "ldtkimport/ParallelUtility.h"
 
 
 namespace ldtkimport
@@ -15,6 +21,122 @@ namespace ldtkimport
 
 const int16_t CHANCE_MAX = 100;
 
+static bool passesPatternValue(const pattern_t patternValue, const intgridvalue_t intGridValue)
+{
+   // same rules as in Rule::matchesCell
+   if (patternValue == RULE_PATTERN_ANYTHING)
+   {
+      return intGridValue != 0;
+   }
+   else if (patternValue == RULE_PATTERN_NOTHING)
+   {
+      return intGridValue == 0;
+   }
+   else if (patternValue > 0)
+   {
+      return intGridValue == patternValue;
+   }
+   return intGridValue != -patternValue;
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+/**
+ *  @brief Same check as the loop in Rule::matchesCell, but with the pattern size and the
+ *  direction of the flip known at compile time, so that the loops can be unrolled.
+ */
+template <int PATTERN_SIZE, int DIRECTION_X, int DIRECTION_Y>
+static bool matchesPattern(const Rule &rule, const IntGrid &cells, const int cellX, const int cellY)
+{
+   constexpr int RADIUS = PATTERN_SIZE / 2;
+   const pattern_t *pattern = rule.pattern.data();
+
+   if (cellX >= RADIUS && cellX + RADIUS < cells.getWidth() &&
+      cellY >= RADIUS && cellY + RADIUS < cells.getHeight())
+   {
+      // the whole pattern is inside the IntGrid, so there's no need to check for out-of-bounds
+      for (int py = 0; py < PATTERN_SIZE; ++py)
+      {
+         const intgridvalue_t *row = cells.getRow(cellY + ((py - RADIUS) * DIRECTION_Y)) + cellX;
+         for (int px = 0; px < PATTERN_SIZE; ++px)
+         {
+            const pattern_t patternValue = pattern[px + (py * PATTERN_SIZE)];
+            if (patternValue != 0 && !passesPatternValue(patternValue, row[(px - RADIUS) * DIRECTION_X]))
+            {
+               return false;
+            }
+         }
+      }
+      return true;
+   }
+
+   for (int py = 0; py < PATTERN_SIZE; ++py)
+   {
+      for (int px = 0; px < PATTERN_SIZE; ++px)
+      {
+         const pattern_t patternValue = pattern[px + (py * PATTERN_SIZE)];
+         if (patternValue == 0)
+         {
+            continue;
+         }
+
+         const int checkX = cellX + ((px - RADIUS) * DIRECTION_X);
+         const int checkY = cellY + ((py - RADIUS) * DIRECTION_Y);
+
+         intgridvalue_t intGridValue;
+         const bool withinHorizontal = cells.isWithinHorizontalBounds(checkX);
+         const bool withinVertical = cells.isWithinVerticalBounds(checkY);
+         if (withinHorizontal && withinVertical)
+         {
+            intGridValue = cells(checkX, checkY);
+         }
+         else if (withinVertical)
+         {
+            // outside the IntGrid, but horizontally only
+            if (rule.horizontalOutOfBoundsValue == -1)
+            {
+               return false;
+            }
+            intGridValue = rule.horizontalOutOfBoundsValue;
+         }
+         else
+         {
+            // outside the IntGrid vertically, or diagonally
+            if (rule.verticalOutOfBoundsValue == -1)
+            {
+               return false;
+            }
+            intGridValue = rule.verticalOutOfBoundsValue;
+         }
+
+         if (!passesPatternValue(patternValue, intGridValue))
+         {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+/**
+ *  @brief Pick the version of matchesPattern for the given flip.
+ */
+template <int PATTERN_SIZE>
+static bool matchesPatternFlipped(const Rule &rule, const IntGrid &cells, const int cellX, const int cellY, const int8_t directionX, const int8_t directionY)
+{
+   if (directionX > 0)
+   {
+      return (directionY > 0) ?
+         matchesPattern<PATTERN_SIZE, 1, 1>(rule, cells, cellX, cellY) :
+         matchesPattern<PATTERN_SIZE, 1, -1>(rule, cells, cellX, cellY);
+   }
+   return (directionY > 0) ?
+      matchesPattern<PATTERN_SIZE, -1, 1>(rule, cells, cellX, cellY) :
+      matchesPattern<PATTERN_SIZE, -1, -1>(rule, cells, cellX, cellY);
+}
+
+// -----------------------------------------------------------------------------------------------------
+
 bool Rule::matchesCell(
 #if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
    std::ostream &debugLog,
@@ -36,6 +158,27 @@ bool Rule::matchesCell(
 
    /// @todo check perlin noise data here
 
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+   // the loop below logs each check it does, so it's always used here
+#else
+   // the usual pattern sizes get their own version of the loop below, that the compiler can unroll
+   switch (patternSize)
+   {
+      case 1:
+         return matchesPatternFlipped<1>(*this, cells, cellX, cellY, directionX, directionY);
+      case 3:
+         return matchesPatternFlipped<3>(*this, cells, cellX, cellY, directionX, directionY);
+      case 5:
+         return matchesPatternFlipped<5>(*this, cells, cellX, cellY, directionX, directionY);
+      case 7:
+         return matchesPatternFlipped<7>(*this, cells, cellX, cellY, directionX, directionY);
+      case 9:
+         return matchesPatternFlipped<9>(*this, cells, cellX, cellY, directionX, directionY);
+      default:
+         break;
+   }
+#endif
+
    // radius serves as an offset so that when px = 0 (in the for loop below),
    // we start with checking the cell that is to the left of the cell we're trying to match
    uint8_t radius = patternSize / 2;
@@ -165,19 +308,90 @@ bool Rule::matchesCell(
 
 // -----------------------------------------------------------------------------------------------------
 
-namespace RuleResult
+bool Rule::canMatchValueCounts(const std::vector<uint32_t> &valueCounts, const size_t cellCount) const
 {
+   auto getCount = [&](const pattern_t value) -> size_t
+   {
+      if (value < 0 || static_cast<size_t>(value) >= valueCounts.size())
+      {
+         return 0;
+      }
+      return valueCounts[value];
+   };
 
-/**
- *  @brief Return value given by passesRule to indicate that the Rule did not match.
- */
-static const int8_t Fail = -1;
+   // whether a cell outside the IntGrid could pass the pattern value,
+   // since the out-of-bounds values are used in place of actual cells there
+   auto outOfBoundsPasses = [&](const pattern_t patternValue)
+   {
+      for (const int outOfBoundsValue : { horizontalOutOfBoundsValue, verticalOutOfBoundsValue })
+      {
+         if (outOfBoundsValue == -1)
+         {
+            // the Rule fails there instead
+            continue;
+         }
 
-/**
- *  @brief Return value given by passesRule to indicate that the non-flipped version of the Rule matched.
- */
-static const int8_t Success = 0;
+         if (patternValue == RULE_PATTERN_ANYTHING)
+         {
+            if (outOfBoundsValue != 0)
+            {
+               return true;
+            }
+         }
+         else if (patternValue == RULE_PATTERN_NOTHING)
+         {
+            if (outOfBoundsValue == 0)
+            {
+               return true;
+            }
+         }
+         else if (patternValue > 0)
+         {
+            if (outOfBoundsValue == patternValue)
+            {
+               return true;
+            }
+         }
+         else if (outOfBoundsValue != -patternValue)
+         {
+            return true;
+         }
+      }
+      return false;
+   };
 
+   for (auto patternValue = pattern.cbegin(), patternEnd = pattern.cend(); patternValue != patternEnd; ++patternValue)
+   {
+      if (*patternValue == 0)
+      {
+         continue;
+      }
+
+      bool inIntGrid;
+      if (*patternValue == RULE_PATTERN_ANYTHING)
+      {
+         inIntGrid = getCount(0) < cellCount;
+      }
+      else if (*patternValue == RULE_PATTERN_NOTHING)
+      {
+         inIntGrid = getCount(0) > 0;
+      }
+      else if (*patternValue > 0)
+      {
+         inIntGrid = getCount(*patternValue) > 0;
+      }
+      else
+      {
+         inIntGrid = getCount(-*patternValue) < cellCount;
+      }
+
+      if (!inIntGrid && !outOfBoundsPasses(*patternValue))
+      {
+         return false;
+      }
+   }
+
+   return true;
 }
 
 // -----------------------------------------------------------------------------------------------------
@@ -279,197 +493,1297 @@ int8_t Rule::passesRule(
 
 // -----------------------------------------------------------------------------------------------------
 
-void Rule::applyRule(
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-   RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
-#endif
-   TileGrid &tileGrid, const IntGrid &cells, const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings) const
+/**
+ *  @brief Whether every IntGridValue that passes laterValue also passes patternValue. Both shouldn't be 0.
+ */
+static bool patternValueImplies(const pattern_t laterValue, const pattern_t patternValue)
 {
-   if (tileIds.size() == 0)
+   if (laterValue == patternValue)
    {
-      // no tile to apply
-      return;
+      return true;
    }
 
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-   ruleLog.matchedCells.clear();
-#endif
+   if (patternValue == RULE_PATTERN_ANYTHING)
+   {
+      // any specific IntGridValue is never empty
+      return laterValue > 0;
+   }
+   else if (patternValue == RULE_PATTERN_NOTHING || patternValue > 0)
+   {
+      return false;
+   }
+
+   // patternValue is "anything but" an IntGridValue, so an empty cell or a different IntGridValue is fine
+   return laterValue == RULE_PATTERN_NOTHING || (laterValue > 0 && laterValue != RULE_PATTERN_ANYTHING && laterValue != -patternValue);
+}
+
+bool Rule::shadows(const Rule &laterRule) const
+{
+   if (!isCellLocal() || tileIds.size() == 0)
+   {
+      return false;
+   }
+
+   if ((laterRule.flipX && !flipX) || (laterRule.flipY && !flipY))
+   {
+      // the later Rule could match a flipped version that this one doesn't check
+      return false;
+   }
 
-   for (int cellY = 0; cellY < cells.getHeight(); ++cellY)
+   if (pattern.size() != static_cast<size_t>(patternSize) * patternSize ||
+      laterRule.pattern.size() != static_cast<size_t>(laterRule.patternSize) * laterRule.patternSize)
    {
-      uint8_t breakOnMatchFlag = breakOnMatch ? TileFlags::Final : TileFlags::NoFlags;
+      return false;
+   }
+
+   const int radius = patternSize / 2;
+   const int laterRadius = laterRule.patternSize / 2;
 
-      for (int cellX = 0; cellX < cells.getWidth(); ++cellX)
+   for (int py = 0; py < patternSize; ++py)
+   {
+      for (int px = 0; px < patternSize; ++px)
       {
-         if (!tileGrid.canStillPlaceTiles(cellX, cellY))
+         const pattern_t patternValue = pattern[px + (py * patternSize)];
+         if (patternValue == 0)
          {
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-            ruleLog.matchedCells.push_back(DebugMatchCell{ cellX, cellY, 0, "skipping. cell already finalized." });
-#endif
             continue;
          }
 
-         // return value can either be a RuleResult,
-         // or one of the Flipped values in TileFlags
-         int8_t ruleMatchResult = passesRule(
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
-            ruleLog,
-#endif
-            cells, cellX, cellY, randomSeed);
-
-         if (ruleMatchResult == RuleResult::Fail)
+         // same spot in the later Rule's pattern, relative to the cell being matched
+         const int offsetX = px - radius;
+         const int offsetY = py - radius;
+         if (std::abs(offsetX) > laterRadius || std::abs(offsetY) > laterRadius)
          {
-            continue;
+            // the later Rule doesn't care about this spot, but this one does
+            return false;
          }
 
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-         ruleLog.matchedCells.push_back(DebugMatchCell{ cellX, cellY, 0, "success" });
-#endif
+         const pattern_t laterValue = laterRule.pattern[(offsetX + laterRadius) + ((offsetY + laterRadius) * laterRule.patternSize)];
+         if (laterValue == 0 || !patternValueImplies(laterValue, patternValue))
+         {
+            return false;
+         }
 
-         // -----------------------------------------------------
-         // Compute position offsets
+         // Outside the IntGrid, each Rule uses its own out-of-bounds values instead.
+         // Only a spot with an x offset can be out-of-bounds horizontally only,
+         // and only a spot with a y offset can be out-of-bounds vertically (or diagonally).
+         auto outOfBoundsImplies = [&](const int laterOutOfBoundsValue, const int outOfBoundsValue)
+         {
+            if (laterOutOfBoundsValue == -1 || !passesPatternValue(laterValue, static_cast<intgridvalue_t>(laterOutOfBoundsValue)))
+            {
+               // the later Rule fails there anyway
+               return true;
+            }
+            return outOfBoundsValue != -1 && passesPatternValue(patternValue, static_cast<intgridvalue_t>(outOfBoundsValue));
+         };
 
-         int cellXOffset = 0;
-         int8_t excessPixelPosXOffset = 0;
-         int16_t finalXOffset = GridUtility::getRandomIndex(randomSeed + uid, cellX, cellY, randomPosXOffsetMin, randomPosXOffsetMax) + posXOffset;
-         if (finalXOffset != 0)
+         if (offsetX != 0 && !outOfBoundsImplies(laterRule.horizontalOutOfBoundsValue, horizontalOutOfBoundsValue))
+         {
+            return false;
+         }
+         if (offsetY != 0 && !outOfBoundsImplies(laterRule.verticalOutOfBoundsValue, verticalOutOfBoundsValue))
          {
-            // convert pixel values to cell values, add that to the locationX,
-            // and any excess value will be stored in excessPixelPosXOffset
-            cellXOffset = finalXOffset / cellPixelSize;
-            excessPixelPosXOffset = finalXOffset % cellPixelSize;
+            return false;
          }
+      }
+   }
+
+   return true;
+}
+
+uint64_t Rule::getCompileHash() const
+{
+   // FNV-1a, one value at a time instead of one byte at a time
+   uint64_t hash = 14695981039346656037ULL;
+   auto add = [&hash](const uint64_t value)
+   {
+      hash ^= value;
+      hash *= 1099511628211ULL;
+      hash ^= hash >> 32;
+   };
+
+   add(uid);
+   add(std::bit_cast<uint32_t>(chance));
+   add(breakOnMatch);
+   add(flipX);
+   add(flipY);
+   add(opacity);
+   add(static_cast<uint16_t>(posXOffset));
+   add(static_cast<uint16_t>(posYOffset));
+   add(static_cast<uint16_t>(randomPosXOffsetMin));
+   add(static_cast<uint16_t>(randomPosXOffsetMax));
+   add(static_cast<uint16_t>(randomPosYOffsetMin));
+   add(static_cast<uint16_t>(randomPosYOffsetMax));
+   add(static_cast<uint32_t>(xModulo));
+   add(static_cast<uint32_t>(xModuloOffset));
+   add(static_cast<uint32_t>(yModulo));
+   add(static_cast<uint32_t>(yModuloOffset));
+   add(static_cast<uint32_t>(checker));
+   add(static_cast<uint32_t>(verticalOutOfBoundsValue));
+   add(static_cast<uint32_t>(horizontalOutOfBoundsValue));
+   add(patternSize);
+   add(pattern.size());
+   for (auto patternValue = pattern.cbegin(), patternEnd = pattern.cend(); patternValue != patternEnd; ++patternValue)
+   {
+      add(static_cast<uint32_t>(*patternValue));
+   }
+   add(tileIds.size());
+   for (auto tileId = tileIds.cbegin(), tileIdEnd = tileIds.cend(); tileId != tileIdEnd; ++tileId)
+   {
+      add(static_cast<uint32_t>(*tileId));
+   }
+   add(static_cast<uint32_t>(tileMode));
+   add(std::bit_cast<uint32_t>(stampPivotX));
+   add(std::bit_cast<uint32_t>(stampPivotY));
+
+   return hash;
+}
+
+bool Rule::passesPatternCenter(const intgridvalue_t value) const
+{
+   const pattern_t center = getPatternCenter();
+   if (center == 0)
+   {
+      // doesn't care about the cell being matched
+      return true;
+   }
+   return passesPatternValue(center, value);
+}
+
+int Rule::getPlacementReach(const dimensions_t cellPixelSize) const
+{
+   // same as in placeTiles, the pixel offsets turn into whole cells, the rest stays as a pixel offset
+   const int pixelSize = std::max<int>(1, cellPixelSize);
+   const int xOffsetReach = std::max(std::abs(randomPosXOffsetMin + posXOffset), std::abs(randomPosXOffsetMax + posXOffset)) / pixelSize;
+   const int yOffsetReach = std::max(std::abs(randomPosYOffsetMin + posYOffset), std::abs(randomPosYOffsetMax + posYOffset)) / pixelSize;
+
+   int stampReach = 0;
+   if (tileMode == TileMode::Stamp)
+   {
+      for (auto offset = stampTileOffsets.cbegin(), end = stampTileOffsets.cend(); offset != end; ++offset)
+      {
+         stampReach = std::max(stampReach, std::max<int>(std::abs(offset->x), std::abs(offset->y)));
+      }
+   }
 
-         int cellYOffset = 0;
-         int8_t excessPixelPosYOffset = 0;
-         int16_t finalYOffset = GridUtility::getRandomIndex(randomSeed + uid + 1, cellX, cellY, randomPosYOffsetMin, randomPosYOffsetMax) + posYOffset;
-         if (finalYOffset != 0)
+   // plus one for the stamp tiles that get moved to the cell to their left or above
+   return std::max(xOffsetReach, yOffsetReach) + stampReach + 1;
+}
+
+uint16_t Rule::compileChecks(const std::vector<intgridvalue_t> &planeValues, std::vector<PlaneCheck> &outChecks) const
+{
+   size_t firstCheckIdx = outChecks.size();
+
+   uint8_t radius = patternSize / 2;
+
+   // the non-flipped version first
+   for (uint8_t py = 0; py < patternSize; ++py)
+   {
+      for (uint8_t px = 0; px < patternSize; ++px)
+      {
+         auto patternValue = pattern[px + (py * patternSize)];
+         if (patternValue == 0)
          {
-            // convert pixel values to cell values, add that to the locationY,
-            // and any excess value will be stored in excessPixelPosYOffset
-            cellYOffset = finalYOffset / cellPixelSize;
-            excessPixelPosYOffset = finalYOffset % cellPixelSize;
+            // pattern doesn't care about this cell, skip it
+            continue;
          }
 
-         // -----------------------------------------------------
+         PlaneCheck check;
+         check.x = static_cast<int8_t>(px - radius);
+         check.y = static_cast<int8_t>(py - radius);
 
-         switch (tileMode)
+         if (patternValue == RULE_PATTERN_ANYTHING || patternValue == RULE_PATTERN_NOTHING)
          {
-            case TileMode::Single:
-            {
-               int locationX = cellX + cellXOffset;
-               int locationY = cellY + cellYOffset;
+            check.planeIdx = IntGridPlanes::PLANE_NON_ZERO;
+            check.negate = patternValue == RULE_PATTERN_NOTHING;
+         }
+         else
+         {
+            pattern_t value = patternValue > 0 ? patternValue : -patternValue;
 
-               if (locationX < 0 || locationX >= cells.getWidth() || locationY < 0 || locationY >= cells.getHeight())
+            // no cell can have this value unless it's in planeValues
+            check.planeIdx = IntGridPlanes::PLANE_EMPTY;
+            for (size_t n = 0, len = planeValues.size(); n < len; ++n)
+            {
+               if (planeValues[n] == value)
                {
-                  // Tile went over the map (probably due to offsets), skip it.
-                  // This is fine, since that tile is effectively at off-screen area.
+                  check.planeIdx = static_cast<uint16_t>(IntGridPlanes::PLANE_FIRST_VALUE + n);
                   break;
                }
+            }
+            check.negate = patternValue < 0;
+         }
 
-               // -----------------------------------------------------
+         check.passesHorizontalOutOfBounds = horizontalOutOfBoundsValue != -1 &&
+            passesPatternValue(patternValue, static_cast<intgridvalue_t>(horizontalOutOfBoundsValue));
 
-               // choose one tile at random
-               tileid_t tileId;
-               if (tileIds.size() > 1)
-               {
-                  tileId = tileIds[GridUtility::getRandomIndex(randomSeed + uid, cellX, cellY, tileIds.size())];
-               }
-               else
-               {
-                  tileId = tileIds[0];
-               }
+         check.passesVerticalOutOfBounds = verticalOutOfBoundsValue != -1 &&
+            passesPatternValue(patternValue, static_cast<intgridvalue_t>(verticalOutOfBoundsValue));
 
-               uint8_t flags = static_cast<uint8_t>(ruleMatchResult) | breakOnMatchFlag;
+         outChecks.push_back(check);
+      }
+   }
 
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-               tileGridLog[GridUtility::getIndex(locationX, locationY, cells.getWidth())].push_back(uid);
-#endif
+   uint16_t checkCount = static_cast<uint16_t>(outChecks.size() - firstCheckIdx);
 
-               tileGrid.putTile(tileId, locationX, locationY, excessPixelPosXOffset, excessPixelPosYOffset, opacity, flags, rulePriority);
-               break;
-            }
-            case TileMode::Stamp:
-            {
-               ASSERT(stampTileOffsets.size() == tileIds.size(),
-                  "For Rule " << uid << ", stampTileOffsets size should match tileIds size at this point. stampTileOffsets.size(): " << stampTileOffsets.size() << " tileIds.size(): " << tileIds.size());
+   // Then the flipped versions, in the same order as passesRule checks them.
+   // Instead of flipping the pattern, matchesCell flips the way it looks at the IntGrid.
+   // Here, we flip the offsets ahead of time.
+   const int8_t directionX[] = { -1, -1, 1 };
+   const int8_t directionY[] = { -1, 1, -1 };
+   for (int orientation = 0; orientation < ORIENTATION_COUNT - 1; ++orientation)
+   {
+      for (uint16_t n = 0; n < checkCount; ++n)
+      {
+         PlaneCheck check = outChecks[firstCheckIdx + n];
+         check.x *= directionX[orientation];
+         check.y *= directionY[orientation];
+         outChecks.push_back(check);
+      }
+   }
 
-               // go through each tile in the stamp
-               for (size_t tileIdx = 0, tileLen = tileIds.size(); tileIdx < tileLen; ++tileIdx)
-               {
-                  const Rule::Offset &offset = stampTileOffsets[tileIdx];
-
-                  int locationX = cellX + cellXOffset + (offset.x * (TileFlags::isFlippedX(ruleMatchResult) ? -1 : 1));
-                  int locationY = cellY + cellYOffset + (offset.y * (TileFlags::isFlippedY(ruleMatchResult) ? -1 : 1));
-
-                  if (locationX < 0 || locationX >= cells.getWidth() || locationY < 0 || locationY >= cells.getHeight())
-                  {
-                     // Tile of stamp went over the map, skip it.
-                     // It's ok if part of the stamp is cut-off,
-                     // since that part is effectively at off-screen area.
-                     continue;
-                  }
-
-                  // -----------------------------------------------------
-
-                  uint8_t flags;
-                  bool giveBreakOnMatch;
-                  if (RunSettings::hasFasterStampBreakOnMatch(runSettings))
-                  {
-                     // at this point, the offsets don't have any right or down offset so we only specifically check for left or up
-                     giveBreakOnMatch = (offset.x == 0 && offset.y == 0) || !offset.hasEitherLeftOrUpOffset();
-                  }
-                  else
-                  {
-                     giveBreakOnMatch = (offset.x == 0 && offset.y == 0) && !offset.hasEitherLeftOrUpOffset();
-                  }
-                  if (giveBreakOnMatch)
-                  {
-                     /// @todo to properly implement breakOnMatch for tiles that are not exactly on the matched cell,
-                     /// we'll need to check if there are no more transparent areas left in the cell
-                     flags = static_cast<uint8_t>(ruleMatchResult) | offset.flags | breakOnMatchFlag;
-                  }
-                  else
-                  {
-                     // do not finalize for cells that aren't the current one
-                     flags = static_cast<uint8_t>(ruleMatchResult) | offset.flags;
-                  }
-
-                  // If we have left offset, check if (locationX-1, locationY) has a higher priority rule placed on it.
-                  // If so, we need to move the tile there and switch the left offset to a right offset.
-                  // Visually, it will be in the same position, it's just that we need to do this to properly
-                  // enforce z-order, so that a higher priority rule shows up on top of this rule.
-                  if (TileFlags::hasOffsetLeft(flags) && locationX > 0 && tileGrid.getHighestPriority(locationX - 1, locationY) < rulePriority)
-                  {
-                     --locationX;
-                     flags &= ~TileFlags::LeftOffset;
-                     flags |= TileFlags::RightOffset;
-                  }
-
-                  // Do the same in the Y-axis.
-                  if (TileFlags::hasOffsetUp(flags) && locationY > 0 && tileGrid.getHighestPriority(locationX, locationY - 1) < rulePriority)
-                  {
-                     --locationY;
-                     flags &= ~TileFlags::UpOffset;
-                     flags |= TileFlags::DownOffset;
-                  }
+   return checkCount;
+}
 
-#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
-                  tileGridLog[GridUtility::getIndex(locationX, locationY, cells.getWidth())].push_back(uid);
-#endif
+// -----------------------------------------------------------------------------------------------------
 
-                  tileGrid.putTile(tileIds[tileIdx], locationX, locationY, excessPixelPosXOffset, excessPixelPosYOffset, opacity, flags, rulePriority);
-               } // for tileId
-               break;
-            }
-            default:
-            {
-               ASSERT_THROW(false, std::runtime_error, "For Rule " << uid << ", unknown tileMode property. ");
-               break;
-            }
-         } // switch tileMode
-      } // for cellX
-   } // for cellY
+void Rule::matchRow(
+   const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount, const int cellY,
+   IntGridPlanes::word_t *matched) const
+{
+   using word_t = IntGridPlanes::word_t;
+
+   const PlaneCheck *checkEnd = checks + checkCount;
+
+   for (size_t wordIdx = 0, wordLen = planes.getWordsPerRow(); wordIdx < wordLen; ++wordIdx)
+   {
+      word_t result = matched[wordIdx];
+
+      for (const PlaneCheck *check = checks; check != checkEnd && result != 0; ++check)
+      {
+         // The planes have a halo around the IntGrid as wide as the largest pattern radius,
+         // so none of these need bounds checks. Cells in the halo are never set in the IntGridValue
+         // bitplanes, they're only set in the out-of-bounds ones.
+         //
+         // The offsets of the flipped versions of the pattern have already been mirrored in compileChecks.
+         int checkY = cellY + check->y;
+         int shift = check->x;
+
+         word_t bits = planes.getShiftedWord(check->planeIdx, checkY, wordIdx, shift);
+         if (check->negate)
+         {
+            // halo cells need to stay unset here too
+            bits = ~(bits | planes.getShiftedWord(IntGridPlanes::PLANE_OUT_OF_BOUNDS, checkY, wordIdx, shift));
+         }
+
+         if (check->passesHorizontalOutOfBounds)
+         {
+            bits |= planes.getShiftedWord(IntGridPlanes::PLANE_HORIZONTAL_OUT_OF_BOUNDS, checkY, wordIdx, shift);
+         }
+
+         if (check->passesVerticalOutOfBounds)
+         {
+            bits |= planes.getShiftedWord(IntGridPlanes::PLANE_VERTICAL_OUT_OF_BOUNDS, checkY, wordIdx, shift);
+         }
+
+         result &= bits;
+      }
+
+      matched[wordIdx] = result;
+   }
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+bool Rule::passesModulo(const int cellX, const int cellY) const
+{
+   // same as the modulo checks in passesRule
+   if (checker != CheckerMode::Vertical && ((cellY - yModuloOffset) % yModulo) != 0)
+   {
+      return false;
+   }
+
+   if (checker == CheckerMode::Vertical && ((cellY + ((cellX / xModulo) % 2)) % yModulo) != 0)
+   {
+      return false;
+   }
+
+   if (checker != CheckerMode::Horizontal && ((cellX - xModuloOffset) % xModulo) != 0)
+   {
+      return false;
+   }
+
+   if (checker == CheckerMode::Horizontal && ((cellX + ((cellY / yModulo) % 2)) % xModulo) != 0)
+   {
+      return false;
+   }
+
+   return true;
+}
+
+/**
+ *  @brief Same as value % divisor, but always gives a non-negative result. divisor should be positive.
+ */
+static int getPositiveModulo(const int value, const int divisor)
+{
+   return ((value % divisor) + divisor) % divisor;
+}
+
+bool Rule::getModuloColumns(const IntGridPlanes &planes, const int cellY, IntGridPlanes::word_t *outColumns) const
+{
+   using word_t = IntGridPlanes::word_t;
+
+   const size_t wordLen = planes.getWordsPerRow();
+   const int width = planes.getWidth();
+   const int columnStep = std::abs(xModulo);
+
+   if (columnStep == 1 && checker != CheckerMode::Vertical)
+   {
+      // every column passes
+      for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+      {
+         outColumns[wordIdx] = planes.getValidMask(wordIdx);
+      }
+      return true;
+   }
+
+   for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+   {
+      outColumns[wordIdx] = 0;
+   }
+
+   // Only step through the columns that can pass the X modulo.
+   int columnStart;
+   if (checker == CheckerMode::Horizontal)
+   {
+      // (cellX + ((cellY / yModulo) % 2)) % xModulo == 0
+      columnStart = getPositiveModulo(-((cellY / yModulo) % 2), columnStep);
+   }
+   else
+   {
+      // (cellX - xModuloOffset) % xModulo == 0
+      columnStart = getPositiveModulo(xModuloOffset, columnStep);
+   }
+
+   bool hasAny = false;
+   for (int cellX = columnStart; cellX < width; cellX += columnStep)
+   {
+      // the vertical checker's row test depends on the column
+      if (checker == CheckerMode::Vertical && !passesModulo(cellX, cellY))
+      {
+         continue;
+      }
+
+      outColumns[cellX / IntGridPlanes::WORD_BITS] |= word_t(1) << (cellX % IntGridPlanes::WORD_BITS);
+      hasAny = true;
+   }
+
+   return hasAny;
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+bool Rule::canMatchBlock(const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+   const int left, const int top, const int right, const int bottom) const
+{
+   // a check fails on every cell of the block if none of the cells it looks at can pass it
+   auto failsWholeBlock = [&](const PlaneCheck &check)
+   {
+      int checkLeft = left + check.x;
+      int checkRight = right + check.x;
+      const int checkTop = top + check.y;
+      const int checkBottom = bottom + check.y;
+
+      // this widens the area the check looks at, so the counts below
+      // can only ever say the check fails when it really does
+      IntGridPlanes::alignAreaColumns(checkLeft, checkRight);
+
+      uint32_t passingOutOfBounds = 0;
+      if (check.passesHorizontalOutOfBounds)
+      {
+         passingOutOfBounds += planes.getAreaSum(IntGridPlanes::PLANE_HORIZONTAL_OUT_OF_BOUNDS, checkLeft, checkTop, checkRight, checkBottom);
+      }
+      if (check.passesVerticalOutOfBounds)
+      {
+         passingOutOfBounds += planes.getAreaSum(IntGridPlanes::PLANE_VERTICAL_OUT_OF_BOUNDS, checkLeft, checkTop, checkRight, checkBottom);
+      }
+      if (passingOutOfBounds > 0)
+      {
+         return false;
+      }
+
+      uint32_t setCount = planes.getAreaSum(check.planeIdx, checkLeft, checkTop, checkRight, checkBottom);
+      if (!check.negate)
+      {
+         // needs the value, but it isn't anywhere here
+         return setCount == 0;
+      }
+
+      // needs anything but the value (halo cells included), but it's everywhere here
+      setCount += planes.getAreaSum(IntGridPlanes::PLANE_OUT_OF_BOUNDS, checkLeft, checkTop, checkRight, checkBottom);
+      const uint32_t area = static_cast<uint32_t>(checkRight - checkLeft + 1) * static_cast<uint32_t>(checkBottom - checkTop + 1);
+      return setCount == area;
+   };
+
+   auto canMatchOrientation = [&](const int orientation)
+   {
+      const PlaneCheck *orientationChecks = checks + (orientation * checkCount);
+      for (uint16_t n = 0; n < checkCount; ++n)
+      {
+         if (failsWholeBlock(orientationChecks[n]))
+         {
+            return false;
+         }
+      }
+      return true;
+   };
+
+   // same versions of the pattern that matchRowOrientations checks
+   return canMatchOrientation(0) ||
+      (flipX && flipY && canMatchOrientation(1)) ||
+      (flipX && canMatchOrientation(2)) ||
+      (flipY && canMatchOrientation(3));
+}
+
+bool Rule::skipEmptyBlocks(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+   RuleLog &ruleLog,
+#endif
+   const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+   const int randomSeed, const int cellY, int &blockBottom, IntGridPlanes::word_t *blockColumns, IntGridPlanes::word_t *columns) const
+{
+   using word_t = IntGridPlanes::word_t;
+
+   if (!planes.hasAreaSums())
+   {
+      return true;
+   }
+
+   const size_t wordLen = planes.getWordsPerRow();
+
+   if (cellY > blockBottom)
+   {
+      // the block starts at this row, which is the first one the Rule needs in it
+      blockBottom = std::min(cellY + SKIP_BLOCK_ROWS - 1, static_cast<int>(planes.getHeight()) - 1);
+
+      for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+      {
+         const int left = static_cast<int>(wordIdx * IntGridPlanes::WORD_BITS);
+         const int right = std::min(left + IntGridPlanes::WORD_BITS, static_cast<int>(planes.getWidth())) - 1;
+         blockColumns[wordIdx] = canMatchBlock(planes, checks, checkCount, left, cellY, right, blockBottom) ? ~word_t(0) : 0;
+      }
+   }
+
+   word_t anyColumn = 0;
+   for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+   {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+      // double-check that the cells taken out really can't match
+      word_t skipped = columns[wordIdx] & ~blockColumns[wordIdx];
+      while (skipped != 0)
+      {
+         int cellX = static_cast<int>(wordIdx * IntGridPlanes::WORD_BITS) + std::countr_zero(skipped);
+         skipped &= skipped - 1;
+
+         ASSERT(passesRule(ruleLog, cells, cellX, cellY, randomSeed) == RuleResult::Fail,
+            "For Rule " << uid << ", cell (" << cellX << ", " << cellY << ") was skipped, but passesRule says it matches");
+      }
+#endif
+
+      columns[wordIdx] &= blockColumns[wordIdx];
+      anyColumn |= columns[wordIdx];
+   }
+
+#if defined(NDEBUG) || LDTK_IMPORT_DEBUG_RULE <= 1
+   (void)cells;
+   (void)randomSeed;
+#endif
+
+   return anyColumn != 0;
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+bool Rule::passesChance(const int cellX, const int cellY, const int randomSeed) const
+{
+   // same as the chance check in matchesCell
+   if (chance < 1.0f)
+   {
+      int16_t chance100 = static_cast<int16_t>(chance * 100);
+      if (GridUtility::getRandomIndex(randomSeed + uid, cellX, cellY, CHANCE_MAX) >= chance100)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::getRowRange(int &outRowStart, int &outRowStep) const
+{
+   // Only go through the rows that can pass the Y modulo.
+   // (cellY - yModuloOffset) % yModulo == 0 is the same as cellY being yModuloOffset plus a multiple of yModulo.
+   // With the vertical checker, which rows pass depends on the column, so that's handled in getModuloColumns.
+   outRowStart = 0;
+   outRowStep = 1;
+   if (checker != CheckerMode::Vertical)
+   {
+      outRowStep = std::abs(yModulo);
+      outRowStart = getPositiveModulo(yModuloOffset, outRowStep);
+   }
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::matchRowOrientations(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+   RuleLog &ruleLog,
+#endif
+   const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+   const int randomSeed, const int cellY, const IntGridPlanes::word_t *columns,
+   IntGridPlanes::word_t *matched, IntGridPlanes::word_t *matchedFlippedX, IntGridPlanes::word_t *matchedFlippedY,
+   IntGridPlanes::word_t *scratch) const
+{
+   const size_t wordLen = planes.getWordsPerRow();
+
+   // check the non-flipped version of the pattern on the entire row first
+   for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+   {
+      matched[wordIdx] = columns[wordIdx];
+      matchedFlippedX[wordIdx] = 0;
+      matchedFlippedY[wordIdx] = 0;
+   }
+   matchRow(planes, checks, checkCount, cellY, matched);
+
+   // then check the flipped versions, but only on the cells that haven't matched yet,
+   // in the same order as passesRule does
+   auto matchFlipped = [&](const int orientation, const uint8_t flippedFlags)
+   {
+      for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+      {
+         scratch[wordIdx] = columns[wordIdx] & ~matched[wordIdx];
+      }
+      matchRow(planes, checks + (orientation * checkCount), checkCount, cellY, scratch);
+      for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+      {
+         matched[wordIdx] |= scratch[wordIdx];
+         if (TileFlags::isFlippedX(flippedFlags))
+         {
+            matchedFlippedX[wordIdx] |= scratch[wordIdx];
+         }
+         if (TileFlags::isFlippedY(flippedFlags))
+         {
+            matchedFlippedY[wordIdx] |= scratch[wordIdx];
+         }
+      }
+   };
+
+   if (flipX && flipY)
+   {
+      matchFlipped(1, TileFlags::FlippedX | TileFlags::FlippedY);
+   }
+   if (flipX)
+   {
+      matchFlipped(2, TileFlags::FlippedX);
+   }
+   if (flipY)
+   {
+      matchFlipped(3, TileFlags::FlippedY);
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+   using word_t = IntGridPlanes::word_t;
+
+   // double-check the bitplane results against the cell-by-cell reference implementation
+   for (int cellX = 0; cellX < cells.getWidth(); ++cellX)
+   {
+      size_t wordIdx = cellX / IntGridPlanes::WORD_BITS;
+      word_t bit = word_t(1) << (cellX % IntGridPlanes::WORD_BITS);
+
+      if (passesModulo(cellX, cellY) && (columns[wordIdx] & bit) == 0)
+      {
+         // left out on purpose by the caller (e.g. already finalized), passesRule doesn't know about those
+         continue;
+      }
+
+      int8_t expected = RuleResult::Fail;
+      if ((matched[wordIdx] & bit) != 0 && passesModulo(cellX, cellY) && passesChance(cellX, cellY, randomSeed))
+      {
+         expected = RuleResult::Success;
+         if ((matchedFlippedX[wordIdx] & bit) != 0)
+         {
+            expected |= TileFlags::FlippedX;
+         }
+         if ((matchedFlippedY[wordIdx] & bit) != 0)
+         {
+            expected |= TileFlags::FlippedY;
+         }
+      }
+
+      int8_t ruleMatchResult = passesRule(ruleLog, cells, cellX, cellY, randomSeed);
+      ASSERT(ruleMatchResult == expected,
+         "For Rule " << uid << ", bitplane result doesn't match passesRule at (" << cellX << ", " << cellY << "). bitplane: " << +expected << " passesRule: " << +ruleMatchResult);
+   }
+#else
+   (void)cells;
+   (void)randomSeed;
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::placeRow(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+   TileGrid &tileGrid, const int cellY, const size_t wordLen, const IntGridPlanes::word_t *matched,
+   const IntGridPlanes::word_t *matchedFlippedX, const IntGridPlanes::word_t *matchedFlippedY,
+   const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings,
+   IntGridPlanes::word_t *outPlaced) const
+{
+   using word_t = IntGridPlanes::word_t;
+
+   // go through each cell that matched, from left to right
+   for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+   {
+      word_t bits = matched[wordIdx];
+      while (bits != 0)
+      {
+         int bitIdx = std::countr_zero(bits);
+         word_t bit = word_t(1) << bitIdx;
+         bits &= bits - 1;
+
+         int cellX = static_cast<int>(wordIdx * IntGridPlanes::WORD_BITS) + bitIdx;
+
+         ASSERT(passesModulo(cellX, cellY), "For Rule " << uid << ", cell (" << cellX << ", " << cellY << ") should have been filtered out by getModuloColumns");
+
+         // Tiles placed by this same Rule (e.g. from a stamp) can finalize cells
+         // we haven't visited yet, so this has to be checked right before placing.
+         if (!tileGrid.canStillPlaceTiles(cellX, cellY))
+         {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            ruleLog.matchedCells.push_back(DebugMatchCell{ cellX, cellY, 0, "skipping. cell already finalized." });
+#endif
+            continue;
+         }
+
+         if (!passesChance(cellX, cellY, randomSeed))
+         {
+            continue;
+         }
+
+         uint8_t matchFlags = TileFlags::NoFlags;
+         if ((matchedFlippedX[wordIdx] & bit) != 0)
+         {
+            matchFlags |= TileFlags::FlippedX;
+         }
+         if ((matchedFlippedY[wordIdx] & bit) != 0)
+         {
+            matchFlags |= TileFlags::FlippedY;
+         }
+
+         if (outPlaced != nullptr)
+         {
+            outPlaced[wordIdx] |= bit;
+         }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         ruleLog.matchedCells.push_back(DebugMatchCell{ cellX, cellY, matchFlags, "success" });
+#endif
+
+         placeTiles(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            tileGridLog,
+#endif
+            tileGrid, cellX, cellY, matchFlags, randomSeed, cellPixelSize, rulePriority, runSettings);
+      } // for each matched bit
+   } // for wordIdx
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::applyRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+   TileGrid &tileGrid, const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+   const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings,
+   const unsigned int threadCount) const
+{
+   static_assert(TileGrid::FINAL_WORD_BITS == IntGridPlanes::WORD_BITS, "TileGrid's final bits have to line up with the IntGridPlanes words");
+
+   if (tileIds.size() == 0)
+   {
+      // no tile to apply
+      return;
+   }
+
+   ASSERT_THROW(xModulo != 0 && yModulo != 0, std::logic_error,
+      "Modulo to be used as divisor is zero. xModulo: " << xModulo << " yModulo: " << yModulo);
+
+   ASSERT(planes.getWidth() == cells.getWidth() && planes.getHeight() == cells.getHeight(),
+      "For Rule " << uid << ", IntGridPlanes size doesn't match IntGrid size. planes: " << planes.getWidth() << "x" << planes.getHeight() <<
+      " cells: " << cells.getWidth() << "x" << cells.getHeight());
+
+   ASSERT(tileGrid.getWidth() == cells.getWidth() && tileGrid.getHeight() == cells.getHeight(),
+      "For Rule " << uid << ", TileGrid size doesn't match IntGrid size. tileGrid: " << tileGrid.getWidth() << "x" << tileGrid.getHeight() <<
+      " cells: " << cells.getWidth() << "x" << cells.getHeight());
+
+   ASSERT(planes.getHaloSize() >= patternSize / 2,
+      "For Rule " << uid << ", IntGridPlanes halo is too small for the pattern. halo: " << planes.getHaloSize() << " patternSize: " << +patternSize);
+
+   if (threadCount != 1)
+   {
+      // Match the rows in bands on multiple threads, then place the tiles one row after another,
+      // in the same order as below. Placing can't be split up the same way: whether a cell can
+      // still have tiles depends on what was placed on the rows before it (e.g. by a stamp).
+      Matches matches;
+      matchRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         ruleLog,
+#endif
+         cells, planes, checks, checkCount, randomSeed, matches, threadCount, &tileGrid);
+
+      placeMatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         ruleLog, tileGridLog,
+#endif
+         tileGrid, matches, randomSeed, cellPixelSize, rulePriority, runSettings);
+      return;
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   ruleLog.matchedCells.clear();
+#endif
+
+   applyRuleOnRows(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      ruleLog, tileGridLog,
+#endif
+      tileGrid, cells, planes, checks, checkCount, randomSeed, cellPixelSize, rulePriority, runSettings, 0, cells.getHeight());
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::applyRuleOnRows(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+   TileGrid &tileGrid, const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+   const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings,
+   const int rowBegin, const int rowEnd) const
+{
+   using word_t = IntGridPlanes::word_t;
+
+   if (tileIds.size() == 0)
+   {
+      // no tile to apply
+      return;
+   }
+
+   const size_t wordLen = planes.getWordsPerRow();
+
+   // one bit per cell of the current row
+   std::vector<word_t> columns(wordLen);
+   std::vector<word_t> matched(wordLen);
+   std::vector<word_t> matchedFlippedX(wordLen);
+   std::vector<word_t> matchedFlippedY(wordLen);
+   std::vector<word_t> scratch(wordLen);
+   std::vector<word_t> blockColumns(wordLen);
+   int blockBottom = -1;
+
+   int rowStart;
+   int rowStep;
+   getRowRange(rowStart, rowStep);
+
+   // first row at or after rowBegin that can pass the Y modulo
+   int firstRow = rowStart;
+   if (rowBegin > rowStart)
+   {
+      firstRow = rowStart + (((rowBegin - rowStart + rowStep - 1) / rowStep) * rowStep);
+   }
+
+   for (int cellY = firstRow; cellY < rowEnd; cellY += rowStep)
+   {
+      if (tileGrid.getOpenCellCount() == 0)
+      {
+         // every cell is finalized (maybe by this Rule's own stamps), nothing else can be placed
+         break;
+      }
+
+      if (tileGrid.getOpenCellCountInRow(cellY) == 0)
+      {
+         continue;
+      }
+
+      if (!getModuloColumns(planes, cellY, columns.data()))
+      {
+         // no cell in this row can pass the modulo
+         continue;
+      }
+
+      if (!skipEmptyBlocks(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+         ruleLog,
+#endif
+         cells, planes, checks, checkCount, randomSeed, cellY, blockBottom, blockColumns.data(), columns.data()))
+      {
+         // nowhere near anything the pattern needs
+         continue;
+      }
+
+      // don't bother matching cells that were already finalized by previous Rules
+      word_t anyColumn = 0;
+      for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+      {
+         columns[wordIdx] &= ~tileGrid.getFinalWord(wordIdx, cellY);
+         anyColumn |= columns[wordIdx];
+      }
+      if (anyColumn == 0)
+      {
+         continue;
+      }
+
+      matchRowOrientations(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+         ruleLog,
+#endif
+         cells, planes, checks, checkCount, randomSeed, cellY, columns.data(),
+         matched.data(), matchedFlippedX.data(), matchedFlippedY.data(), scratch.data());
+
+      placeRow(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         ruleLog, tileGridLog,
+#endif
+         tileGrid, cellY, wordLen, matched.data(), matchedFlippedX.data(), matchedFlippedY.data(),
+         randomSeed, cellPixelSize, rulePriority, runSettings, nullptr);
+   } // for cellY
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::matchRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RuleLog &ruleLog,
+#endif
+   const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+   const int randomSeed, Matches &outMatches, const unsigned int threadCount, const TileGrid *finalized) const
+{
+   ASSERT_THROW(xModulo != 0 && yModulo != 0, std::logic_error,
+      "Modulo to be used as divisor is zero. xModulo: " << xModulo << " yModulo: " << yModulo);
+
+   ASSERT(planes.getWidth() == cells.getWidth() && planes.getHeight() == cells.getHeight(),
+      "For Rule " << uid << ", IntGridPlanes size doesn't match IntGrid size. planes: " << planes.getWidth() << "x" << planes.getHeight() <<
+      " cells: " << cells.getWidth() << "x" << cells.getHeight());
+
+   ASSERT(planes.getHaloSize() >= patternSize / 2,
+      "For Rule " << uid << ", IntGridPlanes halo is too small for the pattern. halo: " << planes.getHaloSize() << " patternSize: " << +patternSize);
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   ruleLog.matchedCells.clear();
+#endif
+
+   const size_t wordLen = planes.getWordsPerRow();
+   const size_t totalWords = wordLen * cells.getHeight();
+
+   outMatches.wordsPerRow = wordLen;
+   outMatches.matched.assign(totalWords, 0);
+   outMatches.matchedFlippedX.assign(totalWords, 0);
+   outMatches.matchedFlippedY.assign(totalWords, 0);
+
+   if (tileIds.size() == 0)
+   {
+      // no tile to apply, so no point in matching
+      return;
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+   // passesRule writes to the RuleLog, so the bands can't run at the same time
+   (void)threadCount;
+   const unsigned int bandThreadCount = 1;
+#else
+   const unsigned int bandThreadCount = (threadCount == 0) ? ParallelUtility::getDefaultThreadCount() : threadCount;
+#endif
+
+   if (bandThreadCount <= 1)
+   {
+      matchRows(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+         ruleLog,
+#endif
+         cells, planes, checks, checkCount, randomSeed, 0, cells.getHeight(), finalized, outMatches);
+      return;
+   }
+
+   // Split the rows into horizontal bands. Each row's result only depends on the IntGrid,
+   // so the bands can be matched in any order. A few bands per thread helps even out
+   // bands that take longer (e.g. ones that have more cells that pass the modulo).
+   const int height = cells.getHeight();
+   const int bandCount = std::max(1, std::min(static_cast<int>(bandThreadCount) * 4, height / MATCH_BAND_MIN_ROWS));
+   const int rowsPerBand = (height + bandCount - 1) / bandCount;
+
+   ParallelUtility::parallelFor(bandCount, bandThreadCount, [&](const size_t bandIdx)
+   {
+      const int rowBegin = static_cast<int>(bandIdx) * rowsPerBand;
+      const int rowEnd = std::min(rowBegin + rowsPerBand, height);
+      matchRows(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+         ruleLog,
+#endif
+         cells, planes, checks, checkCount, randomSeed, rowBegin, rowEnd, finalized, outMatches);
+   });
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::matchRows(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+   RuleLog &ruleLog,
+#endif
+   const IntGrid &cells, const IntGridPlanes &planes, const PlaneCheck *checks, const uint16_t checkCount,
+   const int randomSeed, const int rowBegin, const int rowEnd, const TileGrid *finalized, Matches &outMatches) const
+{
+   using word_t = IntGridPlanes::word_t;
+
+   const size_t wordLen = planes.getWordsPerRow();
+
+   std::vector<word_t> columns(wordLen);
+   std::vector<word_t> scratch(wordLen);
+   std::vector<word_t> blockColumns(wordLen);
+   int blockBottom = -1;
+
+   int rowStart;
+   int rowStep;
+   getRowRange(rowStart, rowStep);
+
+   // first row at or after rowBegin that can pass the Y modulo
+   int firstRow = rowStart;
+   if (rowBegin > rowStart)
+   {
+      firstRow = rowStart + (((rowBegin - rowStart + rowStep - 1) / rowStep) * rowStep);
+   }
+
+   for (int cellY = firstRow; cellY < rowEnd; cellY += rowStep)
+   {
+      if (finalized != nullptr && finalized->getOpenCellCountInRow(cellY) == 0)
+      {
+         continue;
+      }
+
+      if (!getModuloColumns(planes, cellY, columns.data()))
+      {
+         // no cell in this row can pass the modulo
+         continue;
+      }
+
+      if (!skipEmptyBlocks(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+         ruleLog,
+#endif
+         cells, planes, checks, checkCount, randomSeed, cellY, blockBottom, blockColumns.data(), columns.data()))
+      {
+         // nowhere near anything the pattern needs
+         continue;
+      }
+
+      if (finalized != nullptr)
+      {
+         // don't bother matching cells that were already finalized by previous Rules
+         word_t anyColumn = 0;
+         for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+         {
+            columns[wordIdx] &= ~finalized->getFinalWord(wordIdx, cellY);
+            anyColumn |= columns[wordIdx];
+         }
+         if (anyColumn == 0)
+         {
+            continue;
+         }
+      }
+
+      size_t rowOffset = cellY * wordLen;
+      matchRowOrientations(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+         ruleLog,
+#endif
+         cells, planes, checks, checkCount, randomSeed, cellY, columns.data(),
+         outMatches.matched.data() + rowOffset, outMatches.matchedFlippedX.data() + rowOffset, outMatches.matchedFlippedY.data() + rowOffset,
+         scratch.data());
+   } // for cellY
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::placeMatches(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+   TileGrid &tileGrid, const Matches &matches,
+   const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings,
+   IntGridPlanes::word_t *outPlaced) const
+{
+   using word_t = IntGridPlanes::word_t;
+
+   if (tileIds.size() == 0)
+   {
+      // no tile to apply
+      return;
+   }
+
+   const size_t wordLen = matches.wordsPerRow;
+
+   ASSERT(matches.matched.size() == wordLen * tileGrid.getHeight(),
+      "For Rule " << uid << ", Matches size doesn't match TileGrid size. matches: " << matches.matched.size() << " words, tileGrid: " << tileGrid.getWidth() << "x" << tileGrid.getHeight());
+
+   std::vector<word_t> matched(wordLen);
+
+   int rowStart;
+   int rowStep;
+   getRowRange(rowStart, rowStep);
+
+   for (int cellY = rowStart; cellY < tileGrid.getHeight(); cellY += rowStep)
+   {
+      if (tileGrid.getOpenCellCount() == 0)
+      {
+         break;
+      }
+
+      if (tileGrid.getOpenCellCountInRow(cellY) == 0)
+      {
+         continue;
+      }
+
+      // leave out cells that were finalized by previous Rules
+      size_t rowOffset = cellY * wordLen;
+      word_t anyMatched = 0;
+      for (size_t wordIdx = 0; wordIdx < wordLen; ++wordIdx)
+      {
+         matched[wordIdx] = matches.matched[rowOffset + wordIdx] & ~tileGrid.getFinalWord(wordIdx, cellY);
+         anyMatched |= matched[wordIdx];
+      }
+      if (anyMatched == 0)
+      {
+         continue;
+      }
+
+      placeRow(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         ruleLog, tileGridLog,
+#endif
+         tileGrid, cellY, wordLen, matched.data(), matches.matchedFlippedX.data() + rowOffset, matches.matchedFlippedY.data() + rowOffset,
+         randomSeed, cellPixelSize, rulePriority, runSettings, (outPlaced != nullptr) ? (outPlaced + rowOffset) : nullptr);
+   } // for cellY
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+bool Rule::applyRuleOnCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+   TileGrid &tileGrid, const IntGrid &cells, const int cellX, const int cellY,
+   const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings) const
+{
+   if (tileIds.size() == 0)
+   {
+      // no tile to apply
+      return false;
+   }
+
+   int8_t ruleMatchResult = passesRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+      ruleLog,
+#endif
+      cells, cellX, cellY, randomSeed);
+
+   if (ruleMatchResult == RuleResult::Fail)
+   {
+      return false;
+   }
+
+   placeMatchedCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      ruleLog, tileGridLog,
+#endif
+      tileGrid, cellX, cellY, static_cast<uint8_t>(ruleMatchResult), randomSeed, cellPixelSize, rulePriority, runSettings);
+   return true;
+}
+
+void Rule::placeMatchedCell(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RuleLog &ruleLog, RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+   TileGrid &tileGrid, const int cellX, const int cellY, const uint8_t matchFlags,
+   const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings) const
+{
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   ruleLog.matchedCells.push_back(DebugMatchCell{ cellX, cellY, matchFlags, "success" });
+#endif
+
+   placeTiles(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      tileGridLog,
+#endif
+      tileGrid, cellX, cellY, matchFlags, randomSeed, cellPixelSize, rulePriority, runSettings);
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+void Rule::placeTiles(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog::RulesInGrid_t &tileGridLog,
+#endif
+   TileGrid &tileGrid, const int cellX, const int cellY, const uint8_t matchFlags,
+   const int randomSeed, const dimensions_t cellPixelSize, const uint8_t rulePriority, const uint8_t runSettings) const
+{
+   const int width = tileGrid.getWidth();
+   const int height = tileGrid.getHeight();
+
+   uint8_t breakOnMatchFlag = breakOnMatch ? TileFlags::Final : TileFlags::NoFlags;
+
+   // -----------------------------------------------------
+   // Compute position offsets
+
+   int cellXOffset = 0;
+   int8_t excessPixelPosXOffset = 0;
+   int16_t finalXOffset = GridUtility::getRandomIndex(randomSeed + uid, cellX, cellY, randomPosXOffsetMin, randomPosXOffsetMax) + posXOffset;
+   if (finalXOffset != 0)
+   {
+      // convert pixel values to cell values, add that to the locationX,
+      // and any excess value will be stored in excessPixelPosXOffset
+      cellXOffset = finalXOffset / cellPixelSize;
+      excessPixelPosXOffset = finalXOffset % cellPixelSize;
+   }
+
+   int cellYOffset = 0;
+   int8_t excessPixelPosYOffset = 0;
+   int16_t finalYOffset = GridUtility::getRandomIndex(randomSeed + uid + 1, cellX, cellY, randomPosYOffsetMin, randomPosYOffsetMax) + posYOffset;
+   if (finalYOffset != 0)
+   {
+      // convert pixel values to cell values, add that to the locationY,
+      // and any excess value will be stored in excessPixelPosYOffset
+      cellYOffset = finalYOffset / cellPixelSize;
+      excessPixelPosYOffset = finalYOffset % cellPixelSize;
+   }
+
+   // -----------------------------------------------------
+
+   switch (tileMode)
+   {
+      case TileMode::Single:
+      {
+         int locationX = cellX + cellXOffset;
+         int locationY = cellY + cellYOffset;
+
+         if (locationX < 0 || locationX >= width || locationY < 0 || locationY >= height)
+         {
+            // Tile went over the map (probably due to offsets), skip it.
+            // This is fine, since that tile is effectively at off-screen area.
+            break;
+         }
+
+         // -----------------------------------------------------
+
+         // choose one tile at random
+         tileid_t tileId;
+         if (tileIds.size() > 1)
+         {
+            tileId = tileIds[GridUtility::getRandomIndex(randomSeed + uid, cellX, cellY, tileIds.size())];
+         }
+         else
+         {
+            tileId = tileIds[0];
+         }
+
+         uint8_t flags = matchFlags | breakOnMatchFlag;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         tileGridLog[GridUtility::getIndex(locationX, locationY, width)].push_back(uid);
+#endif
+
+         tileGrid.putTile(tileId, locationX, locationY, excessPixelPosXOffset, excessPixelPosYOffset, opacity, flags, rulePriority);
+         break;
+      }
+      case TileMode::Stamp:
+      {
+         ASSERT(stampTileOffsets.size() == tileIds.size(),
+            "For Rule " << uid << ", stampTileOffsets size should match tileIds size at this point. stampTileOffsets.size(): " << stampTileOffsets.size() << " tileIds.size(): " << tileIds.size());
+
+         // go through each tile in the stamp
+         for (size_t tileIdx = 0, tileLen = tileIds.size(); tileIdx < tileLen; ++tileIdx)
+         {
+            const Rule::Offset &offset = stampTileOffsets[tileIdx];
+
+            int locationX = cellX + cellXOffset + (offset.x * (TileFlags::isFlippedX(matchFlags) ? -1 : 1));
+            int locationY = cellY + cellYOffset + (offset.y * (TileFlags::isFlippedY(matchFlags) ? -1 : 1));
+
+            if (locationX < 0 || locationX >= width || locationY < 0 || locationY >= height)
+            {
+               // Tile of stamp went over the map, skip it.
+               // It's ok if part of the stamp is cut-off,
+               // since that part is effectively at off-screen area.
+               continue;
+            }
+
+            // -----------------------------------------------------
+
+            uint8_t flags;
+            bool giveBreakOnMatch;
+            if (RunSettings::hasFasterStampBreakOnMatch(runSettings))
+            {
+               // at this point, the offsets don't have any right or down offset so we only specifically check for left or up
+               giveBreakOnMatch = (offset.x == 0 && offset.y == 0) || !offset.hasEitherLeftOrUpOffset();
+            }
+            else
+            {
+               giveBreakOnMatch = (offset.x == 0 && offset.y == 0) && !offset.hasEitherLeftOrUpOffset();
+            }
+            if (giveBreakOnMatch)
+            {
+               /// @todo to properly implement breakOnMatch for tiles that are not exactly on the matched cell,
+               /// we'll need to check if there are no more transparent areas left in the cell
+               flags = matchFlags | offset.flags | breakOnMatchFlag;
+            }
+            else
+            {
+               // do not finalize for cells that aren't the current one
+               flags = matchFlags | offset.flags;
+            }
+
+            // If we have left offset, check if (locationX-1, locationY) has a higher priority rule placed on it.
+            // If so, we need to move the tile there and switch the left offset to a right offset.
+            // Visually, it will be in the same position, it's just that we need to do this to properly
+            // enforce z-order, so that a higher priority rule shows up on top of this rule.
+            if (TileFlags::hasOffsetLeft(flags) && locationX > 0 && tileGrid.getHighestPriority(locationX - 1, locationY) < rulePriority)
+            {
+               --locationX;
+               flags &= ~TileFlags::LeftOffset;
+               flags |= TileFlags::RightOffset;
+            }
+
+            // Do the same in the Y-axis.
+            if (TileFlags::hasOffsetUp(flags) && locationY > 0 && tileGrid.getHighestPriority(locationX, locationY - 1) < rulePriority)
+            {
+               --locationY;
+               flags &= ~TileFlags::UpOffset;
+               flags |= TileFlags::DownOffset;
+            }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            tileGridLog[GridUtility::getIndex(locationX, locationY, width)].push_back(uid);
+#endif
+
+            tileGrid.putTile(tileIds[tileIdx], locationX, locationY, excessPixelPosXOffset, excessPixelPosYOffset, opacity, flags, rulePriority);
+         } // for tileId
+         break;
+      }
+      default:
+      {
+         ASSERT_THROW(false, std::runtime_error, "For Rule " << uid << ", unknown tileMode property. ");
+         break;
+      }
+   } // switch tileMode
 }
 
 } // namespace ldtkimport
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+#include <iostream>
+#endif
+
+#include "ldtkimport/RuleRunner.h"
+#include "ldtkimport/GridUtility.h"
+#include "ldtkimport/PlacementHistory.h"
+#include "ldtkimport/RuleCheckpoints.h"
+
+
+namespace ldtkimport
+{
+
+void RuleRunner::start(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog &rulesLog,
+#endif
+   const LdtkDefFile &ldtkDefFile, Level &level, const uint8_t runSettings)
+{
+   m_ldtkDefFile = &ldtkDefFile;
+   m_level = &level;
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   m_rulesLog = &rulesLog;
+#endif
+   m_runSettings = runSettings;
+   m_randomSeeds.clear();
+   m_layerIdx = 0;
+   m_isLayerStarted = false;
+   m_rulesToRun.clear();
+   m_runIdx = 0;
+   m_cellY = 0;
+
+   auto &intGrid = level.getIntGrid();
+   if (intGrid.getWidth() == 0 || intGrid.getHeight() == 0)
+   {
+      // can't proceed, level size is wrong
+      return;
+   }
+
+   // picked the same way as in LdtkDefFile::runRules
+   const size_t layerCount = ldtkDefFile.m_layers.size();
+   m_randomSeeds.resize(layerCount);
+   for (size_t layerIdx = 0; layerIdx < layerCount; ++layerIdx)
+   {
+      if (RunSettings::hasRandomizeSeeds(runSettings))
+      {
+         m_randomSeeds[layerIdx] = rand();
+      }
+      else
+      {
+         m_randomSeeds[layerIdx] = ldtkDefFile.m_layers[layerIdx].initialRandomSeed;
+      }
+   }
+
+   level.setTileGridCount(layerCount);
+   level.cleanUpTileGrids();
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   rulesLog.tileGrid.resize(layerCount, RulesLog::RulesInGrid_t());
+   for (size_t n = 0; n < layerCount; ++n)
+   {
+      rulesLog.tileGrid[n].resize(intGrid.size(), RulesLog::RulesInCell_t());
+   }
+#endif
+
+   // count them now, so each layer can leave out the Rules that can't match
+   level.getIntGridValueCounts();
+
+   if (layerCount == 0)
+   {
+      level.clearDirtyAreas();
+   }
+}
+
+bool RuleRunner::step(const size_t maxCells)
+{
+   size_t cellsDone = 0;
+   do
+   {
+      if (isFinished())
+      {
+         return true;
+      }
+      cellsDone += advance(maxCells - std::min(cellsDone, maxCells));
+   } while (cellsDone < maxCells);
+
+   return isFinished();
+}
+
+bool RuleRunner::stepFor(const uint32_t budgetMicroseconds)
+{
+   using clock = std::chrono::steady_clock;
+   const clock::time_point endTime = clock::now() + std::chrono::microseconds(budgetMicroseconds);
+
+   // always do at least some of the work, so that this gets closer to being finished
+   do
+   {
+      if (step(CELLS_PER_TIME_CHECK))
+      {
+         return true;
+      }
+   } while (clock::now() < endTime);
+
+   return false;
+}
+
+size_t RuleRunner::advance(const size_t maxCells)
+{
+   const IntGrid &intGrid = m_level->getIntGrid();
+   const size_t levelCellCount = intGrid.size();
+
+   if (!m_isLayerStarted)
+   {
+      startLayer();
+      return levelCellCount;
+   }
+
+   TileGrid &tileGrid = m_level->getTileGridByIdx(static_cast<int>(m_layerIdx));
+
+   if (m_runIdx < m_rulesToRun.size() && m_cellY == 0 && tileGrid.getOpenCellCount() == 0)
+   {
+      // every cell is finalized, the remaining Rules can't place anything
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      std::cout << "Every cell of layer idx " << m_layerIdx << " is finalized, skipping the remaining " << (m_rulesToRun.size() - m_runIdx) << " Rules" << std::endl;
+      for (; m_runIdx < m_rulesToRun.size(); ++m_runIdx)
+      {
+         m_rulesToRun[m_runIdx].ruleLog->matchedCells.clear();
+      }
+#endif
+      m_runIdx = m_rulesToRun.size();
+   }
+
+   if (m_runIdx >= m_rulesToRun.size())
+   {
+      finishLayer();
+      return levelCellCount;
+   }
+
+   const Layer &layer = m_ldtkDefFile->m_layers[m_layerIdx];
+   const CompiledRules &compiledRules = getCompiledRules();
+   const LdtkDefFile::RuleToRun &toRun = m_rulesToRun[m_runIdx];
+   const uint32_t randomSeed = m_randomSeeds[m_layerIdx];
+
+   if (m_cellY == 0)
+   {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      std::cout << "Running Rule " << toRun.rule->uid << " of RuleGroup \"" << toRun.ruleGroup->name << "\" on layer idx " << m_layerIdx << " with random seed is " << randomSeed << std::endl;
+      toRun.ruleLog->matchedCells.clear();
+#endif
+   }
+
+   const int height = intGrid.getHeight();
+   const size_t rowCount = std::max<size_t>(1, maxCells / intGrid.getWidth());
+   const int rowEnd = static_cast<int>(std::min<size_t>(height, m_cellY + rowCount));
+
+   toRun.rule->applyRuleOnRows(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      *toRun.ruleLog, m_rulesLog->tileGrid[m_layerIdx],
+#endif
+      tileGrid, intGrid, m_planes, compiledRules.getChecks(toRun.ruleIdx), compiledRules.getCheckCount(toRun.ruleIdx),
+      randomSeed, layer.cellPixelSize, toRun.rulePriority, m_runSettings, m_cellY, rowEnd);
+
+   const size_t cellsDone = static_cast<size_t>(rowEnd - m_cellY) * intGrid.getWidth();
+
+   if (rowEnd >= height)
+   {
+      ++m_runIdx;
+      m_cellY = 0;
+   }
+   else
+   {
+      m_cellY = rowEnd;
+   }
+
+   return cellsDone;
+}
+
+void RuleRunner::startLayer()
+{
+   const IntGrid &intGrid = m_level->getIntGrid();
+   const Layer &layer = m_ldtkDefFile->m_layers[m_layerIdx];
+   TileGrid &tileGrid = m_level->getTileGridByIdx(static_cast<int>(m_layerIdx));
+
+   tileGrid.setRandomSeed(m_randomSeeds[m_layerIdx]);
+   tileGrid.setLayerUid(layer.uid);
+
+   // the TileGrid won't match what runRulesIncremental or replaceRule noted down anymore
+   PlacementHistory *history = m_level->getPlacementHistory(m_layerIdx);
+   if (history != nullptr)
+   {
+      history->clear();
+   }
+   RuleCheckpoints *checkpoints = m_level->getRuleCheckpoints(m_layerIdx);
+   if (checkpoints != nullptr)
+   {
+      checkpoints->clear();
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   for (auto cell = m_rulesLog->tileGrid[m_layerIdx].begin(), end = m_rulesLog->tileGrid[m_layerIdx].end(); cell != end; ++cell)
+   {
+      cell->clear();
+   }
+#endif
+
+   const CompiledRules &compiledRules = m_ldtkDefFile->getCompiledRules(layer, m_compiledNow);
+   m_isCompiledNow = &compiledRules == &m_compiledNow;
+
+   LdtkDefFile::getRulesToRun(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      *m_rulesLog,
+#endif
+      layer, m_rulesToRun);
+
+   // leave out the same Rules as LdtkDefFile::runRulesOnLayer does
+   std::vector<bool> canMatch;
+   LdtkDefFile::findRulesThatCanMatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      m_layerIdx,
+#endif
+      compiledRules, m_rulesToRun, m_level->getIntGridValueCounts(), intGrid.size(), canMatch);
+   LdtkDefFile::removeRulesThatCantMatch(m_rulesToRun, canMatch);
+
+   m_runIdx = 0;
+   m_cellY = 0;
+   m_isLayerStarted = true;
+
+   if (m_rulesToRun.empty())
+   {
+      // nothing in this layer would place a tile
+      finishLayer();
+      return;
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   std::cout << "Running " << m_rulesToRun.size() << " Rules on layer idx " << m_layerIdx << " a few rows at a time, random seed is " << m_randomSeeds[m_layerIdx] << std::endl;
+#endif
+
+   m_planes.build(intGrid, compiledRules.planeValues, compiledRules.haloSize);
+   m_planes.buildAreaSums();
+}
+
+const CompiledRules &RuleRunner::getCompiledRules() const
+{
+   if (m_isCompiledNow)
+   {
+      return m_compiledNow;
+   }
+   return m_ldtkDefFile->m_layers[m_layerIdx].compiledRules;
+}
+
+void RuleRunner::finishLayer()
+{
+   // move all placed tiles to their cells in one go
+   m_level->getTileGridByIdx(static_cast<int>(m_layerIdx)).compact();
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   std::cout << "Finished running rules for layer idx " << m_layerIdx << std::endl;
+#endif
+
+   m_isLayerStarted = false;
+   m_rulesToRun.clear();
+   m_runIdx = 0;
+   m_cellY = 0;
+   ++m_layerIdx;
+
+   if (isFinished())
+   {
+      // the whole IntGrid was just run, so nothing is dirty anymore
+      m_level->clearDirtyAreas();
+      m_compiledNow = CompiledRules();
+      m_isCompiledNow = false;
+   }
+}
+
+} // namespace ldtkimport
@@ -0,0 +1,234 @@
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "ldtkimport/IntGrid.h"
+#include "ldtkimport/IntGridPlanes.h"
+
+using namespace ldtkimport;
+
+
+TEST_CASE("Int Grid Planes have a bit set for each cell with that value", "[Int Grid Planes]")
+{
+   IntGrid grid4x2(4, 2, {
+      1, 0, 2, 1,
+      0, 3, 1, 0
+      });
+
+   IntGridPlanes planes;
+   planes.build(grid4x2, { 1, 2 }, 1);
+
+   REQUIRE(planes.getWidth() == 4);
+   REQUIRE(planes.getHeight() == 2);
+   REQUIRE(planes.getWordsPerRow() == 1);
+
+   SECTION("Bitplanes of requested values")
+   {
+      uint16_t planeIdxOf1 = planes.getPlaneIdx(1);
+      REQUIRE(planes.getRow(planeIdxOf1, 0)[0] == 0b1001);
+      REQUIRE(planes.getRow(planeIdxOf1, 1)[0] == 0b0100);
+
+      uint16_t planeIdxOf2 = planes.getPlaneIdx(2);
+      REQUIRE(planes.getRow(planeIdxOf2, 0)[0] == 0b0100);
+      REQUIRE(planes.getRow(planeIdxOf2, 1)[0] == 0);
+   }
+
+   SECTION("Values that weren't requested use the empty bitplane")
+   {
+      REQUIRE(planes.getPlaneIdx(3) == IntGridPlanes::PLANE_EMPTY);
+      REQUIRE(planes.getPlaneIdx(500) == IntGridPlanes::PLANE_EMPTY);
+      REQUIRE(planes.getRow(IntGridPlanes::PLANE_EMPTY, 1)[0] == 0);
+   }
+
+   SECTION("Non-zero bitplane includes values that weren't requested")
+   {
+      REQUIRE(planes.getRow(IntGridPlanes::PLANE_NON_ZERO, 0)[0] == 0b1101);
+      REQUIRE(planes.getRow(IntGridPlanes::PLANE_NON_ZERO, 1)[0] == 0b0110);
+   }
+
+   SECTION("Shifted words")
+   {
+      uint16_t planeIdxOf1 = planes.getPlaneIdx(1);
+
+      // bit n is cell n+1, so cell 3 lands on bit 2
+      REQUIRE(planes.getShiftedWord(planeIdxOf1, 0, 0, 1) == 0b0100);
+
+      // bit n is cell n-1, so cell 0 lands on bit 1
+      REQUIRE(planes.getShiftedWord(planeIdxOf1, 0, 0, -1) == 0b10010);
+   }
+
+   SECTION("Halo")
+   {
+      // bit 0 is cell -1, bits 5 and up are past the right edge
+      REQUIRE(planes.getShiftedWord(IntGridPlanes::PLANE_HORIZONTAL_OUT_OF_BOUNDS, 0, 0, -1) == ~uint64_t(0b11110));
+      REQUIRE(planes.getShiftedWord(IntGridPlanes::PLANE_VERTICAL_OUT_OF_BOUNDS, 0, 0, -1) == 0);
+      REQUIRE(planes.getShiftedWord(IntGridPlanes::PLANE_OUT_OF_BOUNDS, 0, 0, -1) == ~uint64_t(0b11110));
+
+      // rows above and below are entirely out of bounds, vertically
+      REQUIRE(planes.getRow(IntGridPlanes::PLANE_VERTICAL_OUT_OF_BOUNDS, -1)[0] == ~uint64_t(0));
+      REQUIRE(planes.getRow(IntGridPlanes::PLANE_VERTICAL_OUT_OF_BOUNDS, 2)[0] == ~uint64_t(0));
+      REQUIRE(planes.getRow(IntGridPlanes::PLANE_HORIZONTAL_OUT_OF_BOUNDS, 2)[0] == 0);
+      REQUIRE(planes.getRow(IntGridPlanes::PLANE_OUT_OF_BOUNDS, 2)[0] == ~uint64_t(0));
+
+      // halo is never set in the other bitplanes
+      REQUIRE(planes.getRow(IntGridPlanes::PLANE_NON_ZERO, -1)[0] == 0);
+      REQUIRE(planes.getRow(planes.getPlaneIdx(1), 2)[0] == 0);
+   }
+}
+
+TEST_CASE("Int Grid Planes rows span multiple words", "[Int Grid Planes]")
+{
+   std::vector<intgridvalue_t> cells(70, 0);
+   cells[0] = 1;
+   cells[63] = 1;
+   cells[64] = 1;
+   cells[69] = 1;
+
+   IntGrid grid70x1(70, 1, std::move(cells));
+
+   IntGridPlanes planes;
+   planes.build(grid70x1, { 1 }, 1);
+
+   uint16_t planeIdxOf1 = planes.getPlaneIdx(1);
+
+   REQUIRE(planes.getWordsPerRow() == 2);
+   REQUIRE(planes.getRow(planeIdxOf1, 0)[0] == ((uint64_t(1) << 63) | 1));
+   REQUIRE(planes.getRow(planeIdxOf1, 0)[1] == 0b100001);
+   REQUIRE(planes.getValidMask(1) == 0b111111);
+
+   // cell 64 and 63 should come in from the neighbouring words
+   REQUIRE(planes.getShiftedWord(planeIdxOf1, 0, 0, 1) == ((uint64_t(1) << 63) | (uint64_t(1) << 62)));
+   REQUIRE(planes.getShiftedWord(planeIdxOf1, 0, 1, -1) == 0b1000011);
+}
+
+TEST_CASE("Int Grid Planes match the Int Grid cell by cell", "[Int Grid Planes]")
+{
+   // Wide enough that the SIMD versions (if the CPU has them)
+   // go through several chunks, plus a leftover at the end of each row.
+   const dimensions_t width = 150;
+   const dimensions_t height = 3;
+
+   std::vector<intgridvalue_t> cells(width * height);
+   for (size_t n = 0; n < cells.size(); ++n)
+   {
+      cells[n] = static_cast<intgridvalue_t>((n * 7 + n / 5) % 6);
+   }
+   cells[5] = INT_GRID_VALUE_MAX;
+
+   IntGrid grid(width, height, std::move(cells));
+
+   IntGridPlanes planes;
+   planes.build(grid, { 1, 3, 5, INT_GRID_VALUE_MAX }, 3);
+
+   for (int y = 0; y < height; ++y)
+   {
+      for (int x = 0; x < width; ++x)
+      {
+         intgridvalue_t value = grid(x, y);
+         uint64_t bit = uint64_t(1) << (x % IntGridPlanes::WORD_BITS);
+         size_t wordIdx = x / IntGridPlanes::WORD_BITS;
+
+         REQUIRE(((planes.getRow(IntGridPlanes::PLANE_NON_ZERO, y)[wordIdx] & bit) != 0) == (value != 0));
+
+         for (intgridvalue_t planeValue : { 1, 3, 5, INT_GRID_VALUE_MAX })
+         {
+            REQUIRE(((planes.getRow(planes.getPlaneIdx(planeValue), y)[wordIdx] & bit) != 0) == (value == planeValue));
+         }
+      }
+   }
+}
+
+TEST_CASE("Int Grid Planes area sums count the bits in a rectangle", "[Int Grid Planes]")
+{
+   const dimensions_t width = 75;
+   const dimensions_t height = 6;
+   const int haloSize = 2;
+
+   std::vector<intgridvalue_t> cells(width * height);
+   for (size_t n = 0; n < cells.size(); ++n)
+   {
+      cells[n] = static_cast<intgridvalue_t>((n * 5 + n / 3) % 4);
+   }
+
+   IntGrid grid(width, height, std::move(cells));
+
+   IntGridPlanes planes;
+   planes.build(grid, { 1, 3 }, haloSize);
+   REQUIRE_FALSE(planes.hasAreaSums());
+
+   planes.buildAreaSums();
+   REQUIRE(planes.hasAreaSums());
+
+   // count the bits one by one, going past the halo counts as being in the halo
+   auto countBits = [&](uint16_t planeIdx, int left, int top, int right, int bottom)
+   {
+      uint32_t count = 0;
+      for (int y = top; y <= bottom; ++y)
+      {
+         for (int x = left; x <= right; ++x)
+         {
+            bool isVerticalHalo = y < 0 || y >= height;
+            bool isHorizontalHalo = !isVerticalHalo && (x < 0 || x >= width);
+            bool isSet;
+            if (planeIdx == IntGridPlanes::PLANE_HORIZONTAL_OUT_OF_BOUNDS)
+            {
+               isSet = isHorizontalHalo;
+            }
+            else if (planeIdx == IntGridPlanes::PLANE_VERTICAL_OUT_OF_BOUNDS)
+            {
+               isSet = isVerticalHalo;
+            }
+            else if (planeIdx == IntGridPlanes::PLANE_OUT_OF_BOUNDS)
+            {
+               isSet = isVerticalHalo || isHorizontalHalo;
+            }
+            else if (isVerticalHalo || isHorizontalHalo || planeIdx == IntGridPlanes::PLANE_EMPTY)
+            {
+               isSet = false;
+            }
+            else
+            {
+               size_t wordIdx = x / IntGridPlanes::WORD_BITS;
+               isSet = (planes.getRow(planeIdx, y)[wordIdx] & (uint64_t(1) << (x % IntGridPlanes::WORD_BITS))) != 0;
+            }
+            count += isSet ? 1 : 0;
+         }
+      }
+      return count;
+   };
+
+   const uint16_t planeIdxs[] = {
+      IntGridPlanes::PLANE_NON_ZERO, IntGridPlanes::PLANE_EMPTY,
+      IntGridPlanes::PLANE_HORIZONTAL_OUT_OF_BOUNDS, IntGridPlanes::PLANE_VERTICAL_OUT_OF_BOUNDS, IntGridPlanes::PLANE_OUT_OF_BOUNDS,
+      planes.getPlaneIdx(1), planes.getPlaneIdx(3) };
+
+   for (uint16_t planeIdx : planeIdxs)
+   {
+      for (int left = -16; left < width + 8; left += 8)
+      {
+         for (int right = left + 7; right < width + 24; right += 24)
+         {
+            for (int top = -4; top < height + 2; top += 3)
+            {
+               for (int bottom = top; bottom < height + 4; bottom += 2)
+               {
+                  REQUIRE(planes.getAreaSum(planeIdx, left, top, right, bottom) == countBits(planeIdx, left, top, right, bottom));
+               }
+            }
+         }
+      }
+   }
+
+   // rectangles get widened to the edges of the columns
+   int left = 3;
+   int right = 17;
+   IntGridPlanes::alignAreaColumns(left, right);
+   REQUIRE(left == 0);
+   REQUIRE(right == 23);
+
+   left = -1;
+   right = -1;
+   IntGridPlanes::alignAreaColumns(left, right);
+   REQUIRE(left == -8);
+   REQUIRE(right == -1);
+}
@@ -5,6 +5,7 @@
 #include <catch2/matchers/catch_matchers_string.hpp>
 
 #include "ldtkimport/IntGrid.h"
+#include "ldtkimport/Level.h"
 
 using Catch::Matchers::ContainsSubstring;
 using namespace ldtkimport;
@@ -83,3 +84,29 @@ TEST_CASE("Int Grid indexing is correct", "[Int Grid]")
       REQUIRE_THROWS_MATCHES(grid5x5(0, 5), std::out_of_range, MessageMatches(ContainsSubstring("y index is beyond height")));
    }
 }
+
+TEST_CASE("Int Grid counts cells of each value", "[Int Grid]")
+{
+   IntGrid grid(4, 2, {
+      0, 3, 3, 1,
+      3, 0, 0, 3,
+      });
+
+   std::vector<uint32_t> counts;
+   grid.getValueCounts(counts);
+   REQUIRE(counts == std::vector<uint32_t>{ 3, 1, 0, 4 });
+
+   Level level;
+   level.setIntGrid(4, 2, {
+      0, 3, 3, 1,
+      3, 0, 0, 3,
+      });
+   REQUIRE(level.getIntGridValueCounts() == std::vector<uint32_t>{ 3, 1, 0, 4 });
+
+   // counted again after each change
+   level.setIntGrid(0, 0, 5);
+   REQUIRE(level.getIntGridValueCounts() == std::vector<uint32_t>{ 2, 1, 0, 4, 0, 1 });
+
+   level.cleanUpIntGrid();
+   REQUIRE(level.getIntGridValueCounts() == std::vector<uint32_t>{ 8 });
+}
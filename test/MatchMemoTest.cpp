@@ -0,0 +1,173 @@
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "ldtkimport/IntGrid.h"
+#include "ldtkimport/LdtkDefFile.h"
+#include "ldtkimport/Level.h"
+#include "ldtkimport/MatchMemo.h"
+#include "ldtkimport/Rule.h"
+#include "ldtkimport/RuleGroup.h"
+#include "ldtkimport/TileFlags.h"
+
+using namespace ldtkimport;
+
+
+TEST_CASE("Match memo remembers windows it has seen", "[Match Memo]")
+{
+   IntGrid cells(6, 4, {
+      1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 2, 1,
+      1, 1, 1, 1, 1, 1,
+      });
+
+   MatchMemo memo;
+   memo.begin(cells, 3);
+
+   MatchMemo::Match match;
+
+   memo.beginRow(1);
+
+   // (0, 1) is next to the left edge, nothing seen yet
+   REQUIRE_FALSE(memo.next(match));
+   memo.remember(MatchMemo::Match{ 0, TileFlags::NoFlags });
+
+   // (1, 1) has no cells outside the IntGrid around it, so it's a different window
+   REQUIRE_FALSE(memo.next(match));
+   memo.remember(MatchMemo::Match{ 1, TileFlags::FlippedX });
+
+   // (2, 1) has the same window as (1, 1)
+   REQUIRE(memo.next(match));
+   REQUIRE(match.ruleNum == 1);
+   REQUIRE(match.flags == TileFlags::FlippedX);
+
+   // (3, 1) has the 2 in the corner of its window
+   REQUIRE_FALSE(memo.next(match));
+
+   REQUIRE(memo.getEntryCount() == 2);
+
+   // windows are remembered across rows: (1, 2) is the same as (1, 1)
+   memo.beginRow(2);
+   REQUIRE(memo.next(match));
+   REQUIRE(match.ruleNum == 0);
+   REQUIRE(memo.next(match));
+   REQUIRE(match.ruleNum == 1);
+
+   // out-of-bounds above is not the same as out-of-bounds to the side
+   memo.beginRow(0);
+   REQUIRE_FALSE(memo.next(match));
+   REQUIRE_FALSE(memo.next(match));
+
+   // begin forgets everything
+   memo.begin(cells, 3);
+   memo.beginRow(1);
+   REQUIRE_FALSE(memo.next(match));
+   REQUIRE(memo.getEntryCount() == 0);
+}
+
+TEST_CASE("Match memo stops remembering when full", "[Match Memo]")
+{
+   IntGrid cells(4, 1, { 1, 2, 3, 4 });
+
+   MatchMemo memo(2);
+   memo.begin(cells, 1);
+   memo.beginRow(0);
+
+   MatchMemo::Match match;
+   for (int cellX = 0; cellX < cells.getWidth(); ++cellX)
+   {
+      REQUIRE_FALSE(memo.next(match));
+      memo.remember(MatchMemo::Match{ static_cast<uint16_t>(cellX), TileFlags::NoFlags });
+   }
+   REQUIRE(memo.getEntryCount() == 2);
+}
+
+static Rule makeRule(ldtkimport::uid_t uid, int patternSize, std::vector<pattern_t> &&pattern, std::vector<tileid_t> &&tileIds)
+{
+   Rule rule;
+   rule.uid = uid;
+   rule.patternSize = patternSize;
+   rule.pattern = std::move(pattern);
+   rule.tileIds = std::move(tileIds);
+   return rule;
+}
+
+TEST_CASE("Running a Layer with remembered matches gives the same result", "[Match Memo]")
+{
+   // mostly solid, with a few holes and a second IntGridValue, so some windows repeat and some don't
+   Level level;
+   level.setIntGrid(12, 9, {
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1,
+      1, 1, 2, 1, 1, 1, 0, 0, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 2, 2, 1, 1, 1, 0, 1, 1,
+      1, 1, 1, 1, 2, 2, 1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      });
+
+   LdtkDefFile def;
+   def.addLayer(Layer());
+   Layer &layer1 = *def.layerBegin();
+   layer1.initialRandomSeed = 4321;
+
+   RuleGroup ruleGroup;
+
+   // 5x5, so the NeighbourhoodTable can't be used
+   std::vector<pattern_t> farFromHole(25, 0);
+   farFromHole[12] = 1;
+   farFromHole[2] = RULE_PATTERN_NOTHING;
+   Rule holeAbove = makeRule(1, 5, std::move(farFromHole), { 10 });
+   holeAbove.flipY = true;
+   holeAbove.verticalOutOfBoundsValue = 0;
+   ruleGroup.rules.push_back(holeAbove);
+
+   Rule nextToTwo = makeRule(2, 3, {
+      0, 0, 0,
+      2, 1, 0,
+      0, 0, 0,
+      }, { 20 });
+   nextToTwo.flipX = true;
+   ruleGroup.rules.push_back(nextToTwo);
+
+   ruleGroup.rules.push_back(makeRule(3, 3, {
+      1, 1, 1,
+      1, -2, 1,
+      1, 1, 1,
+      }, { 30, 31, 32 }));
+
+   ruleGroup.rules.push_back(makeRule(4, 1, { RULE_PATTERN_ANYTHING }, { 40 }));
+
+   layer1.ruleGroups.push_back(ruleGroup);
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   def.preProcess(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog
+#endif
+   );
+   REQUIRE_FALSE(layer1.compiledRules.neighbourhoodTable.isBuilt());
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+
+   const std::string withoutMemo = level.getTileGridByIdx(0).getTileIdDebugString();
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level, RunSettings::MemoizeMatches);
+
+   REQUIRE(level.getTileGridByIdx(0).getTileIdDebugString() == withoutMemo);
+}
@@ -0,0 +1,243 @@
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "ldtkimport/IntGrid.h"
+#include "ldtkimport/LdtkDefFile.h"
+#include "ldtkimport/Level.h"
+#include "ldtkimport/NeighbourhoodTable.h"
+#include "ldtkimport/Rule.h"
+#include "ldtkimport/RuleGroup.h"
+#include "ldtkimport/TileFlags.h"
+
+using namespace ldtkimport;
+
+
+static Rule makeBlobRule(ldtkimport::uid_t uid, std::vector<pattern_t> &&pattern, tileid_t tileId)
+{
+   Rule rule;
+   rule.uid = uid;
+   rule.patternSize = 3;
+   rule.pattern = std::move(pattern);
+   rule.tileIds = { tileId };
+   return rule;
+}
+
+/**
+ *  @brief A few classic autotile Rules: edges (flipped for the other side), then a fill.
+ */
+static RuleGroup makeBlobRuleGroup()
+{
+   RuleGroup ruleGroup;
+
+   Rule leftEdge = makeBlobRule(1, {
+      0, 0, 0,
+      -1, 1, 0,
+      0, 0, 0,
+      }, 10);
+   leftEdge.flipX = true;
+   ruleGroup.rules.push_back(leftEdge);
+
+   Rule topEdge = makeBlobRule(2, {
+      0, RULE_PATTERN_NOTHING, 0,
+      0, 1, 0,
+      0, 0, 0,
+      }, 20);
+   topEdge.flipY = true;
+   ruleGroup.rules.push_back(topEdge);
+
+   ruleGroup.rules.push_back(makeBlobRule(3, {
+      0, 0, 0,
+      0, 1, 0,
+      0, 0, 0,
+      }, 30));
+
+   return ruleGroup;
+}
+
+TEST_CASE("Neighbourhood table has the first Rule that matches each neighbourhood", "[Neighbourhood Table]")
+{
+   std::vector<RuleGroup> ruleGroups;
+   ruleGroups.push_back(makeBlobRuleGroup());
+
+   NeighbourhoodTable table;
+   REQUIRE(table.build(ruleGroups));
+   REQUIRE(table.isBuilt());
+   REQUIRE(table.getRuleIdxs() == std::vector<uint32_t>{ 0, 1, 2 });
+
+   // only the center is set: empty on the left, so the left edge matches first
+   IntGrid single(3, 3, {
+      0, 0, 0,
+      0, 1, 0,
+      0, 0, 0,
+      });
+
+   std::vector<NeighbourhoodTable::Match> matches;
+   table.lookUp(single, matches);
+   REQUIRE(matches.size() == 9);
+   REQUIRE(matches[4].ruleNum == 0);
+   REQUIRE(matches[4].flags == TileFlags::NoFlags);
+
+   // cells next to the edge of the IntGrid depend on each Rule's out-of-bounds values
+   REQUIRE(matches[0].ruleNum == NeighbourhoodTable::CHECK_CELL);
+   REQUIRE(matches[5].ruleNum == NeighbourhoodTable::CHECK_CELL);
+
+   // filled on the left, empty on the right: the flipped left edge matches
+   IntGrid rightEdge(3, 3, {
+      1, 1, 0,
+      1, 1, 0,
+      1, 1, 0,
+      });
+   table.lookUp(rightEdge, matches);
+   REQUIRE(matches[4].ruleNum == 0);
+   REQUIRE(matches[4].flags == TileFlags::FlippedX);
+
+   // filled on both sides, empty below: the flipped top edge matches
+   IntGrid bottomEdge(3, 3, {
+      1, 1, 1,
+      1, 1, 1,
+      0, 0, 0,
+      });
+   table.lookUp(bottomEdge, matches);
+   REQUIRE(matches[4].ruleNum == 1);
+   REQUIRE(matches[4].flags == TileFlags::FlippedY);
+
+   // filled on all sides: only the fill matches
+   IntGrid filled(3, 3, {
+      1, 1, 1,
+      1, 1, 1,
+      1, 1, 1,
+      });
+   table.lookUp(filled, matches);
+   REQUIRE(matches[4].ruleNum == 2);
+
+   // empty center: nothing matches
+   IntGrid empty(3, 3, {
+      1, 1, 1,
+      1, 0, 1,
+      1, 1, 1,
+      });
+   table.lookUp(empty, matches);
+   REQUIRE(matches[4].ruleNum == NeighbourhoodTable::NO_MATCH);
+
+   // a value that is neither empty nor 1, next to a cell checked with RULE_PATTERN_NOTHING
+   IntGrid otherValue(3, 3, {
+      1, 2, 1,
+      1, 1, 1,
+      1, 1, 1,
+      });
+   table.lookUp(otherValue, matches);
+   REQUIRE(matches[4].ruleNum == NeighbourhoodTable::CHECK_CELL);
+}
+
+TEST_CASE("Neighbourhood table is only built for Rules that fit", "[Neighbourhood Table]")
+{
+   std::vector<RuleGroup> ruleGroups;
+   ruleGroups.push_back(makeBlobRuleGroup());
+
+   NeighbourhoodTable table;
+
+   SECTION("Random chance")
+   {
+      ruleGroups[0].rules[1].chance = 0.5f;
+      REQUIRE_FALSE(table.build(ruleGroups));
+      REQUIRE_FALSE(table.isBuilt());
+   }
+
+   SECTION("More than one IntGridValue")
+   {
+      ruleGroups[0].rules[2].pattern[0] = 2;
+      REQUIRE_FALSE(table.build(ruleGroups));
+   }
+
+   SECTION("Pattern bigger than 3x3")
+   {
+      Rule bigRule = makeBlobRule(4, std::vector<pattern_t>(25, 0), 40);
+      bigRule.patternSize = 5;
+      bigRule.pattern[12] = 1;
+      ruleGroups[0].rules.push_back(bigRule);
+      REQUIRE_FALSE(table.build(ruleGroups));
+   }
+
+   SECTION("No break on match")
+   {
+      ruleGroups[0].rules[0].breakOnMatch = false;
+      REQUIRE_FALSE(table.build(ruleGroups));
+   }
+
+   SECTION("Inactive Rules are left out, even if they don't fit")
+   {
+      ruleGroups[0].rules[1].chance = 0.5f;
+      ruleGroups[0].rules[1].active = false;
+      REQUIRE(table.build(ruleGroups));
+      REQUIRE(table.getRuleIdxs() == std::vector<uint32_t>{ 0, 2 });
+   }
+}
+
+TEST_CASE("Running a Layer with a neighbourhood table gives the same result", "[Neighbourhood Table]")
+{
+   Level level;
+   level.setIntGrid(9, 7, {
+      0, 1, 1, 1, 0, 0, 1, 1, 0,
+      1, 1, 1, 1, 1, 0, 1, 2, 1,
+      1, 1, 0, 1, 1, 0, 1, 1, 1,
+      0, 1, 1, 1, 0, 0, 0, 1, 0,
+      0, 0, 1, 0, 0, 1, 1, 1, 1,
+      1, 1, 1, 1, 0, 1, 2, 1, 1,
+      1, 0, 1, 1, 0, 1, 1, 1, 0,
+      });
+
+   LdtkDefFile def;
+   def.addLayer(Layer());
+   Layer &layer1 = *def.layerBegin();
+   layer1.initialRandomSeed = 777;
+   layer1.ruleGroups.push_back(makeBlobRuleGroup());
+   layer1.ruleGroups[0].rules[0].verticalOutOfBoundsValue = 1;
+   layer1.ruleGroups[0].rules[1].horizontalOutOfBoundsValue = 0;
+   layer1.ruleGroups[0].rules[2].tileIds = { 30, 31, 32 };
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   def.preProcess(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog
+#endif
+   );
+   REQUIRE(layer1.compiledRules.neighbourhoodTable.isBuilt());
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+
+   const std::string withTable = level.getTileGridByIdx(0).getTileIdDebugString();
+
+   // A Rule that never matches, but has random chance, so the table can't be built anymore.
+   // Added last, so that it doesn't change the priority of the other Rules.
+   Rule neverMatches = makeBlobRule(4, {
+      0, 0, 0,
+      0, 5, 0,
+      0, 0, 0,
+      }, 40);
+   neverMatches.chance = 0.5f;
+   layer1.ruleGroups[0].rules.push_back(neverMatches);
+
+   def.preProcess(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog
+#endif
+   );
+   REQUIRE_FALSE(layer1.compiledRules.neighbourhoodTable.isBuilt());
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+
+   REQUIRE(level.getTileGridByIdx(0).getTileIdDebugString() == withTable);
+}
@@ -0,0 +1,51 @@
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_exception.hpp>
+#include <catch2/matchers/catch_matchers_string.hpp>
+
+#include "ldtkimport/ParallelUtility.h"
+
+using Catch::Matchers::ContainsSubstring;
+using namespace ldtkimport;
+
+
+TEST_CASE("Parallel for calls each index once", "[Parallel Utility]")
+{
+   for (unsigned int threadCount = 0; threadCount <= 8; ++threadCount)
+   {
+      std::vector<int> callCount(1000, 0);
+      ParallelUtility::parallelFor(callCount.size(), threadCount, [&](const size_t idx)
+      {
+         ++callCount[idx];
+      });
+
+      for (size_t idx = 0; idx < callCount.size(); ++idx)
+      {
+         REQUIRE(callCount[idx] == 1);
+      }
+   }
+
+   std::atomic<int> total(0);
+   ParallelUtility::parallelFor(0, 4, [&](const size_t)
+   {
+      ++total;
+   });
+   REQUIRE(total == 0);
+}
+
+TEST_CASE("Parallel for passes exceptions to the caller", "[Parallel Utility]")
+{
+   REQUIRE_THROWS_MATCHES(
+      ParallelUtility::parallelFor(100, 4, [](const size_t idx)
+      {
+         if (idx == 42)
+         {
+            throw std::runtime_error("index 42");
+         }
+      }),
+      std::runtime_error,
+      MessageMatches(ContainsSubstring("index 42")));
+}
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 #include <vector>
 
 #include <catch2/catch_test_macros.hpp>
@@ -5,11 +8,265 @@
 #include <catch2/matchers/catch_matchers_string.hpp>
 
 #include "ldtkimport/LdtkDefFile.h"
+#include "ldtkimport/RuleRunner.h"
 
 using Catch::Matchers::ContainsSubstring;
 using namespace ldtkimport;
 
 
+/**
+ *  @brief Kinds of Rules that RulesFixture::addLayer can put in a layer, as bitwise flags.
+ *  They're added in this order, and each one's uid is its number here (counting from 1) plus 10 times the layer's index.
+ */
+namespace FixtureRules
+{
+
+/**
+ *  @brief 3x3, on cells with an empty cell above. Picks one of 3 tiles at random, and can be flipped on X.
+ */
+static const uint8_t Edge = 1 << 0;
+
+/**
+ *  @brief 3x3, on cells with empty cells to the left and below.
+ */
+static const uint8_t Corner = 1 << 1;
+
+/**
+ *  @brief 3x3 stamp of 2x2 tiles on every third row, that lets the Rules after it place tiles on the same cells.
+ */
+static const uint8_t Stamp = 1 << 2;
+
+/**
+ *  @brief 1x1, picks one of 2 tiles at random and moves it down a random amount.
+ */
+static const uint8_t Fill = 1 << 3;
+
+/**
+ *  @brief 1x1 on empty cells, in a checker pattern.
+ */
+static const uint8_t Empty = 1 << 4;
+
+/**
+ *  @brief 1x1 on a value the IntGrid never has.
+ */
+static const uint8_t MissingValue = 1 << 5;
+
+} // namespace FixtureRules
+
+/**
+ *  @brief An LdtkDefFile with a tileset, and the IntGrid cells of a Level to run it on,
+ *  for the tests that check different ways of running the same Rules give the same tiles.
+ */
+struct RulesFixture
+{
+   /**
+    *  @param[in] seed Picks the IntGrid cells: mostly 1s and 0s, with a few 2s.
+    */
+   RulesFixture(const uint32_t seed, const int gridWidth, const int gridHeight) :
+      width(gridWidth),
+      height(gridHeight),
+      cells(gridWidth * gridHeight)
+   {
+      uint32_t state = seed;
+      for (auto cell = cells.begin(), end = cells.end(); cell != end; ++cell)
+      {
+         state = (state * 1664525u) + 1013904223u;
+         const uint32_t roll = (state >> 16) % 9;
+         *cell = roll < 5 ? 1 : (roll == 8 ? 2 : 0);
+      }
+
+      TileSet tileSet;
+      tileSet.uid = 50;
+      tileSet.tileCountWidth = 4;
+      tileSet.tileCountHeight = 4;
+      def.addTileset(std::move(tileSet));
+   }
+
+   /**
+    *  @brief Add a layer with the Rules in ruleMix (flags from FixtureRules). Layers with an even index
+    *  have their Rules match on 1s, and the others on 2s.
+    */
+   Layer &addLayer(const uint8_t ruleMix)
+   {
+      const int layerIdx = static_cast<int>(def.getLayerCount());
+      const pattern_t value = (layerIdx % 2) + 1;
+
+      Layer layer;
+      layer.uid = 10 + layerIdx;
+      layer.cellPixelSize = 8;
+      layer.tilesetDefUid = 50;
+      layer.initialRandomSeed = 1234 * (layerIdx + 1);
+      layer.ruleGroups.push_back(RuleGroup());
+      std::vector<Rule> &rules = layer.ruleGroups[0].rules;
+
+      if (ruleMix & FixtureRules::Edge)
+      {
+         Rule edgeRule;
+         edgeRule.uid = 1 + (layerIdx * 10);
+         edgeRule.patternSize = 3;
+         edgeRule.pattern = {
+            0, -1, 0,
+            0, value, 0,
+            0, 0, 0,
+            };
+         edgeRule.tileIds = { 1, 2, 3 };
+         edgeRule.chance = 0.8f;
+         edgeRule.flipX = true;
+         rules.push_back(edgeRule);
+      }
+
+      if (ruleMix & FixtureRules::Corner)
+      {
+         Rule cornerRule;
+         cornerRule.uid = 2 + (layerIdx * 10);
+         cornerRule.patternSize = 3;
+         cornerRule.pattern = {
+            0, 0, 0,
+            -1, value, 0,
+            0, -1, 0,
+            };
+         cornerRule.tileIds = { 6 };
+         rules.push_back(cornerRule);
+      }
+
+      if (ruleMix & FixtureRules::Stamp)
+      {
+         Rule stampRule;
+         stampRule.uid = 3 + (layerIdx * 10);
+         stampRule.patternSize = 3;
+         stampRule.pattern = {
+            0, value, 0,
+            0, value, value,
+            0, 0, 0,
+            };
+         stampRule.tileMode = Rule::TileMode::Stamp;
+         stampRule.tileIds = { 0, 1, 4, 5 };
+         stampRule.stampPivotX = 0.5f;
+         stampRule.stampPivotY = 0.5f;
+         stampRule.chance = 0.6f;
+         stampRule.yModulo = 3;
+         stampRule.yModuloOffset = 1;
+         stampRule.breakOnMatch = false;
+         rules.push_back(stampRule);
+      }
+
+      if (ruleMix & FixtureRules::Fill)
+      {
+         Rule fillRule;
+         fillRule.uid = 4 + (layerIdx * 10);
+         fillRule.patternSize = 1;
+         fillRule.pattern = { value };
+         fillRule.tileIds = { 4, 5 };
+         fillRule.chance = 0.7f;
+         fillRule.randomPosYOffsetMax = 3;
+         rules.push_back(fillRule);
+      }
+
+      if (ruleMix & FixtureRules::Empty)
+      {
+         Rule emptyRule;
+         emptyRule.uid = 5 + (layerIdx * 10);
+         emptyRule.patternSize = 1;
+         emptyRule.pattern = { -1 };
+         emptyRule.tileIds = { 9 };
+         emptyRule.checker = Rule::CheckerMode::Horizontal;
+         rules.push_back(emptyRule);
+      }
+
+      if (ruleMix & FixtureRules::MissingValue)
+      {
+         Rule missingValueRule;
+         missingValueRule.uid = 6 + (layerIdx * 10);
+         missingValueRule.patternSize = 1;
+         missingValueRule.pattern = { 3 };
+         missingValueRule.tileIds = { 10 };
+         rules.push_back(missingValueRule);
+      }
+
+      def.addLayer(std::move(layer));
+      return *(def.layerBegin() + layerIdx);
+   }
+
+   /**
+    *  @brief Get one of the Rules added by addLayer, to change it.
+    */
+   Rule &getRule(const ldtkimport::uid_t ruleUid)
+   {
+      Rule *found = nullptr;
+      for (auto layer = def.layerBegin(), layerEnd = def.layerEnd(); layer != layerEnd; ++layer)
+      {
+         for (auto ruleGroup = layer->ruleGroups.begin(), ruleGroupEnd = layer->ruleGroups.end(); ruleGroup != ruleGroupEnd; ++ruleGroup)
+         {
+            for (auto rule = ruleGroup->rules.begin(), ruleEnd = ruleGroup->rules.end(); rule != ruleEnd; ++rule)
+            {
+               if (rule->uid == ruleUid)
+               {
+                  found = &(*rule);
+               }
+            }
+         }
+      }
+      REQUIRE(found != nullptr);
+      return *found;
+   }
+
+   void preProcess()
+   {
+      def.preProcess(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog
+#endif
+      );
+   }
+
+   /**
+    *  @brief A Level with the fixture's IntGrid cells, and no tiles yet.
+    */
+   Level makeLevel() const
+   {
+      Level level;
+      level.setIntGrid(width, height, std::vector<intgridvalue_t>(cells));
+      return level;
+   }
+
+   void runRules(Level &level, const uint8_t runSettings = RunSettings::None)
+   {
+      def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level, runSettings);
+   }
+
+   const int width;
+   const int height;
+   std::vector<intgridvalue_t> cells;
+
+   LdtkDefFile def;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+};
+
+static void requireSameTiles(const TileGrid &tileGrid, const TileGrid &expected)
+{
+   REQUIRE(tileGrid.getLayerUid() == expected.getLayerUid());
+   REQUIRE(tileGrid.getRandomSeed() == expected.getRandomSeed());
+   REQUIRE(tileGrid.getTileIdDebugString() == expected.getTileIdDebugString());
+   REQUIRE(tileGrid.getRulePriorityDebugString() == expected.getRulePriorityDebugString());
+}
+
+static void requireSameTiles(const Level &level, const Level &expected)
+{
+   REQUIRE(level.getTileGridCount() == expected.getTileGridCount());
+   for (size_t layerIdx = 0; layerIdx < expected.getTileGridCount(); ++layerIdx)
+   {
+      requireSameTiles(level.getTileGridByIdx(layerIdx), expected.getTileGridByIdx(layerIdx));
+   }
+}
+
+
 TEST_CASE("Rule Test", "[Rule]")
 {
    Level level;
@@ -430,6 +687,37 @@ TEST_CASE("Rule with modulo", "[Rule]")
       }
    }
 
+   WHEN("Modulo is 2,2 with offset 1,1")
+   {
+      rule1.xModulo = 2;
+      rule1.yModulo = 2;
+      rule1.xModuloOffset = 1;
+      rule1.yModuloOffset = 1;
+
+      THEN("DefFile should report as valid")
+      {
+         REQUIRE(def.isValid());
+      }
+
+      def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level);
+
+      THEN("Result should only start at the offset")
+      {
+         REQUIRE(level.getTileGridCount() == 1);
+         const TileGrid &tileGrid = level.getTileGridByIdx(0);
+
+         REQUIRE(tileGrid.getTileIdDebugString() == R"(
+[], [], []
+[], [9], []
+[], [], []
+)");
+      }
+   }
+
    WHEN("Modulo is 0,1")
    {
       rule1.xModulo = 0;
@@ -511,3 +799,1382 @@ TEST_CASE("Rule with modulo", "[Rule]")
 
    }
 }
+
+TEST_CASE("Rule pattern compiled into checks", "[Rule]")
+{
+   Rule rule1;
+   rule1.patternSize = 3;
+   rule1.pattern = {
+      0, 2,                     0,
+      0, RULE_PATTERN_NOTHING,  -7,
+      0, 0,                     0,
+      };
+   rule1.verticalOutOfBoundsValue = 2;
+   rule1.horizontalOutOfBoundsValue = 2;
+
+   std::vector<Rule::PlaneCheck> checks;
+   uint16_t checkCount = rule1.compileChecks({ 7, 2 }, checks);
+
+   THEN("Zeroes in the pattern are left out")
+   {
+      REQUIRE(checkCount == 3);
+      REQUIRE(checks.size() == checkCount * Rule::ORIENTATION_COUNT);
+   }
+
+   THEN("Each value checks the right bitplane")
+   {
+      // 2 is second in the plane values
+      REQUIRE(checks[0].x == 0); REQUIRE(checks[0].y == -1);
+      REQUIRE(checks[0].planeIdx == IntGridPlanes::PLANE_FIRST_VALUE + 1);
+      REQUIRE(checks[0].negate == false);
+      REQUIRE(checks[0].passesVerticalOutOfBounds == true);
+
+      REQUIRE(checks[1].x == 0); REQUIRE(checks[1].y == 0);
+      REQUIRE(checks[1].planeIdx == IntGridPlanes::PLANE_NON_ZERO);
+      REQUIRE(checks[1].negate == true);
+      REQUIRE(checks[1].passesVerticalOutOfBounds == false);
+
+      REQUIRE(checks[2].x == 1); REQUIRE(checks[2].y == 0);
+      REQUIRE(checks[2].planeIdx == IntGridPlanes::PLANE_FIRST_VALUE);
+      REQUIRE(checks[2].negate == true);
+      REQUIRE(checks[2].passesHorizontalOutOfBounds == true);
+   }
+
+   THEN("Flipped versions have mirrored offsets")
+   {
+      // flipped both ways
+      REQUIRE(checks[checkCount + 0].y == 1);
+      REQUIRE(checks[checkCount + 2].x == -1);
+
+      // flipped horizontally
+      REQUIRE(checks[(checkCount * 2) + 0].y == -1);
+      REQUIRE(checks[(checkCount * 2) + 2].x == -1);
+
+      // flipped vertically
+      REQUIRE(checks[(checkCount * 3) + 0].y == 1);
+      REQUIRE(checks[(checkCount * 3) + 2].x == 1);
+   }
+}
+
+TEST_CASE("Running layers on multiple threads gives the same result", "[Rule]")
+{
+   RulesFixture fixture(1, 12, 8);
+   for (int layerIdx = 0; layerIdx < 4; ++layerIdx)
+   {
+      fixture.addLayer(FixtureRules::Edge | FixtureRules::Fill);
+   }
+
+   Level serial = fixture.makeLevel();
+   fixture.runRules(serial);
+
+   Level parallel = fixture.makeLevel();
+   fixture.def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      fixture.rulesLog,
+#endif
+      parallel, RunSettings::None, 4);
+
+   REQUIRE(parallel.getTileGridCount() == 4);
+   for (size_t layerIdx = 0; layerIdx < parallel.getTileGridCount(); ++layerIdx)
+   {
+      REQUIRE(parallel.getTileGridByIdx(layerIdx).getLayerUid() == 10 + layerIdx);
+   }
+   requireSameTiles(parallel, serial);
+}
+
+TEST_CASE("Batch of levels gives the same result on any number of threads", "[Rule]")
+{
+   RulesFixture fixture(2, 8, 3);
+   fixture.addLayer(FixtureRules::Fill);
+   fixture.addLayer(FixtureRules::Fill);
+
+   REQUIRE(fixture.def.isValid());
+
+   const size_t jobCount = 12;
+
+   auto runBatch = [&](std::vector<Level> &levels, const unsigned int threadCount)
+   {
+      levels.resize(jobCount);
+      std::vector<RunRulesJob> jobs(jobCount);
+      for (size_t jobIdx = 0; jobIdx < jobCount; ++jobIdx)
+      {
+         levels[jobIdx] = fixture.makeLevel();
+         jobs[jobIdx].level = &levels[jobIdx];
+         jobs[jobIdx].seed = LdtkDefFile::getJobSeed(777, jobIdx);
+      }
+
+      fixture.def.runRulesBatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         fixture.rulesLog,
+#endif
+         jobs, RunSettings::RandomizeSeeds, threadCount);
+   };
+
+   std::vector<Level> serialLevels;
+   runBatch(serialLevels, 1);
+
+   std::vector<Level> parallelLevels;
+   runBatch(parallelLevels, 4);
+
+   for (size_t jobIdx = 0; jobIdx < jobCount; ++jobIdx)
+   {
+      REQUIRE(parallelLevels[jobIdx].getTileGridCount() == 2);
+      requireSameTiles(parallelLevels[jobIdx], serialLevels[jobIdx]);
+   }
+
+   // jobs with different seeds should end up with different variations
+   REQUIRE(LdtkDefFile::getJobSeed(777, 0) != LdtkDefFile::getJobSeed(777, 1));
+   REQUIRE(serialLevels[0].getTileGridByIdx(0).getTileIdDebugString() != serialLevels[1].getTileGridByIdx(0).getTileIdDebugString());
+}
+
+TEST_CASE("Variants of a level are the same as running a batch with their seeds", "[Rule]")
+{
+   RulesFixture fixture(3, 24, 16);
+   fixture.addLayer(FixtureRules::Stamp | FixtureRules::Edge | FixtureRules::Fill);
+   fixture.addLayer(FixtureRules::Stamp | FixtureRules::Edge | FixtureRules::Fill);
+   fixture.getRule(1).randomPosXOffsetMin = -2;
+   fixture.getRule(1).randomPosXOffsetMax = 2;
+   fixture.preProcess();
+
+   REQUIRE(fixture.def.isValid());
+
+   const std::vector<uint32_t> variantSeeds = { 1, 2, 3, 9000, 123456 };
+
+   std::vector<Level> batchLevels(variantSeeds.size());
+   std::vector<RunRulesJob> jobs(variantSeeds.size());
+   for (size_t variantIdx = 0; variantIdx < variantSeeds.size(); ++variantIdx)
+   {
+      batchLevels[variantIdx] = fixture.makeLevel();
+      jobs[variantIdx].level = &batchLevels[variantIdx];
+      jobs[variantIdx].seed = variantSeeds[variantIdx];
+   }
+
+   fixture.def.runRulesBatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      fixture.rulesLog,
+#endif
+      jobs, RunSettings::RandomizeSeeds, 1);
+
+   for (const unsigned int threadCount : { 1u, 4u })
+   {
+      Level level = fixture.makeLevel();
+
+      std::vector<std::vector<TileGrid>> variants;
+      fixture.def.runRulesVariants(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         fixture.rulesLog,
+#endif
+         level, variantSeeds, variants, RunSettings::None, threadCount);
+
+      REQUIRE(variants.size() == variantSeeds.size());
+      for (size_t variantIdx = 0; variantIdx < variantSeeds.size(); ++variantIdx)
+      {
+         REQUIRE(variants[variantIdx].size() == 2);
+         for (size_t layerIdx = 0; layerIdx < 2; ++layerIdx)
+         {
+            requireSameTiles(variants[variantIdx][layerIdx], batchLevels[variantIdx].getTileGridByIdx(layerIdx));
+         }
+      }
+
+      // the level is left with the last variant
+      requireSameTiles(level.getTileGridByIdx(1), variants.back()[1]);
+   }
+
+   // and the seeds did give different variations
+   REQUIRE(batchLevels[0].getTileGridByIdx(0).getTileIdDebugString() != batchLevels[1].getTileGridByIdx(0).getTileIdDebugString());
+}
+
+TEST_CASE("Rerolling a level that keeps its matches gives the same result as matching again", "[Rule]")
+{
+   RulesFixture fixture(4, 20, 12);
+   fixture.addLayer(FixtureRules::Edge | FixtureRules::Fill);
+   fixture.getRule(1).chance = 0.5f;
+   fixture.preProcess();
+
+   Level keeping = fixture.makeLevel();
+   keeping.setKeepMatches(true);
+   REQUIRE(keeping.isKeepingMatches());
+
+   Level matching = fixture.makeLevel();
+
+   auto reroll = [&](const uint32_t seed)
+   {
+      std::vector<RunRulesJob> jobs(2);
+      jobs[0].level = &keeping;
+      jobs[0].seed = seed;
+      jobs[1].level = &matching;
+      jobs[1].seed = seed;
+
+      fixture.def.runRulesBatch(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         fixture.rulesLog,
+#endif
+         jobs, RunSettings::RandomizeSeeds, 1);
+
+      requireSameTiles(keeping, matching);
+   };
+
+   reroll(11);
+
+   // the first run fills in the matches of both Rules
+   REQUIRE(keeping.getMatchCache(0) != nullptr);
+   REQUIRE(keeping.getMatchCache(0)->matches.size() == 2);
+   REQUIRE(matching.getMatchCache(0) == nullptr);
+
+   reroll(12);
+   reroll(13);
+
+   // a Rule replaced since gets matched again
+   Rule fillRule = fixture.getRule(4);
+   fillRule.pattern = { 2 };
+   REQUIRE(fixture.def.replaceRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      fixture.rulesLog,
+#endif
+      fillRule.uid, fillRule));
+   const std::vector<uint64_t> oldRevisions = keeping.getMatchCache(0)->ruleRevisions;
+   reroll(13);
+   REQUIRE(keeping.getMatchCache(0)->ruleRevisions[0] == oldRevisions[0]);
+   REQUIRE(keeping.getMatchCache(0)->ruleRevisions[1] != oldRevisions[1]);
+
+   // changing the IntGrid forgets the matches, so the next run sees the new cell
+   const intgridvalue_t newValue = keeping.getIntGrid()(3, 4) == 0 ? 1 : 0;
+   keeping.setIntGrid(3, 4, newValue);
+   matching.setIntGrid(3, 4, newValue);
+   REQUIRE(keeping.getMatchCache(0)->matches.empty());
+
+   reroll(14);
+   REQUIRE(keeping.getMatchCache(0)->matches.size() == 2);
+
+   keeping.setKeepMatches(false);
+   REQUIRE(keeping.getMatchCache(0) == nullptr);
+   reroll(15);
+}
+
+TEST_CASE("Running the rules incrementally after editing cells gives the same result as running them again", "[Rule]")
+{
+   RulesFixture fixture(5, 30, 20);
+   Layer &layer1 = fixture.addLayer(FixtureRules::Edge | FixtureRules::Fill);
+
+   // places its tile one cell to the right, finalizing a cell that the next Rule could have matched
+   fixture.getRule(1).posXOffset = 8;
+   fixture.getRule(1).flipX = false;
+   fixture.preProcess();
+
+   Level incremental = fixture.makeLevel();
+   Level full = fixture.makeLevel();
+
+   auto update = [&]()
+   {
+      fixture.def.runRulesIncremental(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         fixture.rulesLog,
+#endif
+         incremental);
+
+      fixture.runRules(full);
+
+      REQUIRE(incremental.getDirtyAreas().empty());
+      requireSameTiles(incremental, full);
+   };
+
+   // the first run goes through the whole Level, and notes down where both Rules placed tiles
+   update();
+   REQUIRE(incremental.getPlacementHistory(0) != nullptr);
+   REQUIRE(incremental.getPlacementHistory(0)->ruleIdxs.size() == 2);
+
+   auto edit = [&](const int x, const int y, const intgridvalue_t value)
+   {
+      incremental.setIntGrid(x, y, value);
+      full.setIntGrid(x, y, value);
+   };
+
+   // setting a cell to the value it already has doesn't make it dirty
+   edit(0, 0, fixture.cells[0]);
+   REQUIRE(incremental.getDirtyAreas().empty());
+
+   auto flip = [&](const int x, const int y)
+   {
+      edit(x, y, incremental.getIntGrid()(x, y) == 0 ? 1 : 0);
+   };
+
+   // cells next to each other end up in the same area
+   flip(10, 10);
+   flip(11, 10);
+   REQUIRE(incremental.getDirtyAreas().size() == 1);
+   REQUIRE(incremental.getDirtyAreas()[0] == CellArea(10, 10, 11, 10));
+   update();
+
+   // areas far apart are done separately
+   flip(2, 3);
+   flip(27, 17);
+   REQUIRE(incremental.getDirtyAreas().size() == 2);
+   update();
+
+   // on the edge of the Level
+   flip(29, 0);
+   flip(0, 19);
+   update();
+
+   // digging a tunnel, one cell at a time
+   for (int x = 5; x < 25; ++x)
+   {
+      edit(x, 8, 0);
+      update();
+   }
+
+   // replacing a Rule runs them on the whole Level again, even if it's still the same Rules being run
+   const std::vector<uint64_t> oldRevisions = incremental.getPlacementHistory(0)->ruleRevisions;
+   Rule edgeRule = fixture.getRule(1);
+   edgeRule.tileIds = { 7 };
+   edgeRule.posXOffset = 0;
+   REQUIRE(fixture.def.replaceRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      fixture.rulesLog,
+#endif
+      edgeRule.uid, edgeRule));
+   flip(20, 5);
+   update();
+   REQUIRE(incremental.getPlacementHistory(0)->ruleRevisions[0] != oldRevisions[0]);
+   REQUIRE(incremental.getPlacementHistory(0)->ruleRevisions[1] == oldRevisions[1]);
+
+   // changing the Rules makes it run the whole Level again
+   layer1.ruleGroups[0].rules[1].active = false;
+   flip(15, 15);
+   update();
+   REQUIRE(incremental.getPlacementHistory(0)->ruleIdxs.size() == 1);
+}
+
+TEST_CASE("Replacing a Rule in a level that keeps checkpoints gives the same result as running them again", "[Rule]")
+{
+   RulesFixture fixture(6, 24, 16);
+   Layer &layer1 = fixture.addLayer(FixtureRules::Edge | FixtureRules::Corner | FixtureRules::Fill);
+   fixture.preProcess();
+
+   Level keeping = fixture.makeLevel();
+   keeping.setKeepCheckpoints(true);
+   REQUIRE(keeping.isKeepingCheckpoints());
+
+   Level full = fixture.makeLevel();
+
+   auto run = [&]()
+   {
+      fixture.runRules(keeping);
+      fixture.runRules(full);
+      requireSameTiles(keeping, full);
+   };
+
+   auto replace = [&](const Rule &newRule)
+   {
+      return fixture.def.replaceRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         fixture.rulesLog,
+#endif
+         newRule.uid, newRule);
+   };
+
+   // the first run keeps the tiles of all three Rules
+   run();
+   REQUIRE(keeping.getRuleCheckpoints(0) != nullptr);
+   REQUIRE(keeping.getRuleCheckpoints(0)->tileStarts.size() == 4);
+   REQUIRE(full.getRuleCheckpoints(0) == nullptr);
+
+   const std::vector<uint64_t> oldRevisions = layer1.compiledRules.ruleRevisions;
+   REQUIRE(oldRevisions.size() == 3);
+
+   // only the replaced Rule gets a new revision, so only it and the Rules after it have to be run again
+   Rule cornerRule = fixture.getRule(2);
+   cornerRule.tileIds = { 7, 8 };
+   REQUIRE(replace(cornerRule));
+   REQUIRE(layer1.ruleGroups[0].rules[1].tileIds.size() == 2);
+   REQUIRE(layer1.compiledRules.ruleRevisions[0] == oldRevisions[0]);
+   REQUIRE(layer1.compiledRules.ruleRevisions[1] != oldRevisions[1]);
+   REQUIRE(layer1.compiledRules.ruleRevisions[2] == oldRevisions[2]);
+   run();
+
+   // a pattern with a different size, and a value no other Rule checks for
+   cornerRule.patternSize = 5;
+   cornerRule.pattern = {
+      0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0,
+      0, 0, 1, 0, 0,
+      0, 0, 0, 0, 0,
+      0, 0, 2, 0, 0,
+      };
+   REQUIRE(replace(cornerRule));
+   REQUIRE(layer1.compiledRules.haloSize == 2);
+   REQUIRE(std::find(layer1.compiledRules.planeValues.cbegin(), layer1.compiledRules.planeValues.cend(), 2) != layer1.compiledRules.planeValues.cend());
+   keeping.setIntGrid(4, 6, keeping.getIntGrid()(4, 6) == 2 ? 1 : 2);
+   full.setIntGrid(4, 6, keeping.getIntGrid()(4, 6));
+   REQUIRE(keeping.getRuleCheckpoints(0)->tileStarts.empty());
+   run();
+
+   // the first Rule turned into a stamp gets its offsets computed
+   Rule edgeRule = fixture.getRule(1);
+   edgeRule.tileMode = Rule::TileMode::Stamp;
+   edgeRule.tileIds = { 0, 1, 4, 5 };
+   edgeRule.stampPivotX = 0.5f;
+   edgeRule.stampPivotY = 1.0f;
+   REQUIRE(replace(edgeRule));
+   REQUIRE(layer1.ruleGroups[0].rules[0].stampTileOffsets.size() == 4);
+   run();
+
+   // turning off a Rule leaves it out of the Rules being run
+   Rule fillRule = fixture.getRule(4);
+   fillRule.active = false;
+   REQUIRE(replace(fillRule));
+   run();
+   REQUIRE(keeping.getRuleCheckpoints(0)->ruleIdxs.size() == 2);
+
+   // and the lists of all Rules are made again, since they depend on every Rule
+   REQUIRE(layer1.compiledRules.ruleCheckStarts.size() == 4);
+   REQUIRE(layer1.compiledRules.deadRules.size() == 3);
+
+   // there's no Rule with this uid
+   Rule unknownRule;
+   unknownRule.uid = 99;
+   REQUIRE_FALSE(replace(unknownRule));
+
+   keeping.setKeepCheckpoints(false);
+   REQUIRE(keeping.getRuleCheckpoints(0) == nullptr);
+   run();
+}
+
+TEST_CASE("Rules edited after preProcess are compiled again", "[Rule]")
+{
+   RulesFixture fixture(7, 12, 10);
+   Layer &layer1 = fixture.addLayer(FixtureRules::Edge | FixtureRules::Fill);
+   fixture.preProcess();
+   REQUIRE(layer1.compiledRules.isCompiledFrom(layer1.ruleGroups));
+
+   auto requireSameAsPreProcessed = [&]()
+   {
+      Level level = fixture.makeLevel();
+      fixture.runRules(level);
+
+      RulesFixture preProcessed(7, 12, 10);
+      preProcessed.def = fixture.def;
+      preProcessed.preProcess();
+      Level expected = preProcessed.makeLevel();
+      preProcessed.runRules(expected);
+
+      requireSameTiles(level, expected);
+   };
+
+   // same number of Rules, but the pattern now looks for a different value
+   layer1.ruleGroups[0].rules[1].pattern = { 2 };
+   REQUIRE_FALSE(layer1.compiledRules.isCompiledFrom(layer1.ruleGroups));
+   requireSameAsPreProcessed();
+
+   // turning a Rule off doesn't need compiling again
+   layer1.ruleGroups[0].rules[1].active = false;
+   fixture.preProcess();
+   layer1.ruleGroups[0].rules[1].active = true;
+   REQUIRE(layer1.compiledRules.isCompiledFrom(layer1.ruleGroups));
+
+   // replacing one Rule after another one was edited directly compiles all of them
+   layer1.ruleGroups[0].rules[0].pattern[1] = 2;
+   Rule fillRule = fixture.getRule(4);
+   fillRule.tileIds = { 3 };
+   REQUIRE(fixture.def.replaceRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      fixture.rulesLog,
+#endif
+      fillRule.uid, fillRule));
+   REQUIRE(layer1.compiledRules.isCompiledFrom(layer1.ruleGroups));
+   requireSameAsPreProcessed();
+}
+
+TEST_CASE("Running the Rules a little at a time gives the same result as running them all at once", "[Rule]")
+{
+   RulesFixture fixture(8, 20, 13);
+   fixture.addLayer(FixtureRules::Edge | FixtureRules::Stamp | FixtureRules::Fill);
+   fixture.addLayer(FixtureRules::Empty | FixtureRules::MissingValue);
+   fixture.getRule(4).chance = 0.6f;
+   fixture.preProcess();
+
+   Level full = fixture.makeLevel();
+
+   auto runInSteps = [&](Level &level, const uint8_t runSettings, const size_t maxCells)
+   {
+      RuleRunner runner;
+      runner.start(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         fixture.rulesLog,
+#endif
+         fixture.def, level, runSettings);
+      REQUIRE_FALSE(runner.isFinished());
+
+      int stepCount = 1;
+      while (!runner.step(maxCells))
+      {
+         ++stepCount;
+         REQUIRE(stepCount < 10000);
+      }
+      REQUIRE(runner.isFinished());
+      return stepCount;
+   };
+
+   for (const uint8_t runSettings : { RunSettings::None, RunSettings::RandomizeSeeds })
+   {
+      srand(42);
+      fixture.runRules(full, runSettings);
+
+      for (const size_t maxCells : { size_t(1), size_t(7), size_t(50), size_t(100000) })
+      {
+         Level level = fixture.makeLevel();
+
+         srand(42);
+         const int stepCount = runInSteps(level, runSettings, maxCells);
+
+         if (maxCells == 1)
+         {
+            // at least one row of each Rule at a time
+            REQUIRE(stepCount > fixture.height);
+         }
+
+         requireSameTiles(level, full);
+      }
+   }
+
+   // running it with a time budget instead, on a Level that already has tiles
+   Level level = fixture.makeLevel();
+   fixture.runRules(level, RunSettings::RandomizeSeeds);
+   fixture.runRules(full);
+
+   RuleRunner runner;
+   runner.start(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      fixture.rulesLog,
+#endif
+      fixture.def, level);
+   while (!runner.stepFor(50))
+   {
+   }
+   requireSameTiles(level, full);
+
+   // a RuleRunner moved while it's running carries on, even with Rules that had to be compiled just for it
+   fixture.getRule(1).pattern[1] = 0;
+   fixture.runRules(full);
+   Level movedLevel = fixture.makeLevel();
+   RuleRunner startedRunner;
+   startedRunner.start(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      fixture.rulesLog,
+#endif
+      fixture.def, movedLevel);
+   REQUIRE_FALSE(startedRunner.step(fixture.width * 2));
+   RuleRunner movedRunner = std::move(startedRunner);
+   while (!movedRunner.step(fixture.width * 2))
+   {
+   }
+   requireSameTiles(movedLevel, full);
+
+   // nothing to do on an empty Level
+   Level emptyLevel;
+   runner.start(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      fixture.rulesLog,
+#endif
+      fixture.def, emptyLevel);
+   REQUIRE(runner.isFinished());
+   REQUIRE(runner.step(1));
+   REQUIRE(emptyLevel.getTileGridCount() == 0);
+}
+
+TEST_CASE("Matching rules on multiple threads gives the same result", "[Rule]")
+{
+   Level level;
+   level.setIntGrid(7, 5, {
+      0, 1, 1, 0, 2, 2, 1,
+      1, 1, 1, 0, 2, 0, 1,
+      0, 1, 2, 2, 0, 1, 1,
+      1, 0, 2, 1, 1, 1, 0,
+      1, 1, 1, 1, 2, 0, 0
+      });
+
+   LdtkDefFile def;
+   def.addLayer(Layer());
+   Layer &layer1 = *def.layerBegin();
+   layer1.initialRandomSeed = 4321;
+   layer1.ruleGroups.push_back(RuleGroup());
+
+   // rules that overlap each other, so that the earlier ones
+   // finalize cells that the later ones would have matched
+   for (int ruleIdx = 0; ruleIdx < 20; ++ruleIdx)
+   {
+      Rule rule;
+      rule.uid = 200 + ruleIdx;
+      rule.patternSize = 3;
+      rule.pattern = {
+         0, 0, 0,
+         ((ruleIdx % 3) == 0) ? RULE_PATTERN_ANYTHING : 0, (ruleIdx % 2) + 1, 0,
+         0, ((ruleIdx % 4) == 0) ? -1 : 0, 0,
+         };
+      rule.tileIds = { static_cast<tileid_t>(ruleIdx) };
+      rule.breakOnMatch = (ruleIdx % 3) != 2;
+      rule.chance = ((ruleIdx % 5) == 0) ? 0.5f : 1.0f;
+      rule.flipX = (ruleIdx % 2) == 0;
+      layer1.ruleGroups[0].rules.push_back(rule);
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+
+   const std::string expected = level.getTileGridByIdx(0).getTileIdDebugString();
+
+   for (unsigned int threadCount = 2; threadCount <= 8; threadCount *= 2)
+   {
+      level.cleanUpTileGrids();
+      def.runRulesOnLayer(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level, 0, layer1.initialRandomSeed, RunSettings::None, threadCount);
+
+      REQUIRE(level.getTileGridByIdx(0).getTileIdDebugString() == expected);
+   }
+}
+
+TEST_CASE("Matching one rule's rows on multiple threads gives the same result", "[Rule]")
+{
+   // big enough to be split into several bands of rows
+   const int width = 70;
+   const int height = 60;
+   std::vector<intgridvalue_t> cells(width * height);
+   for (int n = 0; n < width * height; ++n)
+   {
+      cells[n] = ((n * 7) + ((n / width) * 3)) % 5 < 3 ? 1 : 0;
+   }
+
+   Level level;
+   level.setIntGrid(width, height, std::move(cells));
+
+   LdtkDefFile def;
+   def.addLayer(Layer());
+   Layer &layer1 = *def.layerBegin();
+   layer1.ruleGroups.push_back(RuleGroup());
+   layer1.tilesetDefUid = 3224;
+
+   def.addTileset(TileSet());
+   TileSet &tileSet = *def.tilesetBegin();
+   tileSet.uid = 3224;
+   tileSet.tileCountWidth = 3;
+   tileSet.tileCountHeight = 3;
+
+   // a stamp that finalizes the cells it lands on, which affects the rows below it
+   Rule stampRule;
+   stampRule.uid = 1;
+   stampRule.patternSize = 3;
+   stampRule.pattern = {
+      0, 1, 0,
+      0, 1, 1,
+      0, 0, 0,
+      };
+   stampRule.tileIds = { 0, 1, 3, 4 };
+   stampRule.tileMode = Rule::TileMode::Stamp;
+   stampRule.stampPivotX = 0.5f;
+   stampRule.stampPivotY = 0.5f;
+   stampRule.breakOnMatch = true;
+   stampRule.chance = 0.8f;
+   stampRule.yModulo = 2;
+   layer1.ruleGroups[0].rules.push_back(stampRule);
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   def.preProcess(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog
+#endif
+   );
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+
+   const std::string expected = level.getTileGridByIdx(0).getTileIdDebugString();
+   REQUIRE(expected.find("[0") != std::string::npos);
+
+   level.cleanUpTileGrids();
+   def.runRulesOnLayer(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level, 0, layer1.initialRandomSeed, RunSettings::None, 8);
+
+   REQUIRE(level.getTileGridByIdx(0).getTileIdDebugString() == expected);
+}
+
+TEST_CASE("Skipping empty blocks doesn't leave out any match", "[Rule]")
+{
+   // mostly one IntGridValue, with a few cells of others far apart,
+   // so most blocks of cells can be skipped by the Rules below
+   const int width = 150;
+   const int height = 50;
+   std::vector<intgridvalue_t> cells(width * height, 1);
+   cells[(3 * width) + 70] = 2;
+   cells[(20 * width) + 0] = 2;
+   cells[(33 * width) + 129] = 2;
+   cells[(34 * width) + 129] = 0;
+   cells[(49 * width) + 149] = 0;
+   for (int x = 60; x < 100; ++x)
+   {
+      cells[(45 * width) + x] = 0;
+   }
+
+   Level level;
+   level.setIntGrid(width, height, std::vector<intgridvalue_t>(cells));
+   const IntGrid grid(width, height, std::move(cells));
+
+   LdtkDefFile def;
+   def.addLayer(Layer());
+   Layer &layer1 = *def.layerBegin();
+   layer1.ruleGroups.push_back(RuleGroup());
+
+   auto addRule = [&](ldtkimport::uid_t uid, std::vector<pattern_t> &&pattern) -> Rule &
+   {
+      Rule rule;
+      rule.uid = uid;
+      rule.patternSize = static_cast<uint8_t>(std::sqrt(pattern.size()));
+      rule.pattern = std::move(pattern);
+      rule.tileIds = { static_cast<tileid_t>(uid) };
+      rule.breakOnMatch = false;
+      layer1.ruleGroups[0].rules.push_back(rule);
+      return layer1.ruleGroups[0].rules.back();
+   };
+
+   // needs a 2 at the corner
+   Rule &nextToTwo = addRule(1, {
+      2, 0, 0,
+      0, 1, 0,
+      0, 0, 0,
+      });
+   nextToTwo.flipX = true;
+   nextToTwo.flipY = true;
+
+   // needs a row of empty cells, 5x5
+   std::vector<pattern_t> belowEmpty(25, 0);
+   belowEmpty[0] = RULE_PATTERN_NOTHING;
+   belowEmpty[2] = RULE_PATTERN_NOTHING;
+   belowEmpty[4] = RULE_PATTERN_NOTHING;
+   addRule(2, std::move(belowEmpty));
+
+   // needs anything but 1, which can also be out-of-bounds
+   Rule &notOne = addRule(3, {
+      0, 0, 0,
+      0, 1, -1,
+      0, 0, 0,
+      });
+   notOne.horizontalOutOfBoundsValue = 0;
+
+   // needs a 2, which can also be out-of-bounds above or below
+   Rule &twoOrEdge = addRule(4, {
+      0, 2, 0,
+      0, 0, 0,
+      0, 0, 0,
+      });
+   twoOrEdge.verticalOutOfBoundsValue = 2;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+
+   const TileGrid &tileGrid = level.getTileGridByIdx(0);
+
+   for (const Rule &rule : layer1.ruleGroups[0].rules)
+   {
+      int matchCount = 0;
+      for (int y = 0; y < height; ++y)
+      {
+         for (int x = 0; x < width; ++x)
+         {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+            RuleLog ruleLog;
+#endif
+            const bool expected = rule.passesRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+               ruleLog,
+#endif
+               grid, x, y, layer1.initialRandomSeed) != RuleResult::Fail;
+
+            auto tiles = tileGrid(x, y);
+            const bool placed = std::find_if(tiles.begin(), tiles.end(), [&](const TileInCell &tile)
+            {
+               return tile.tileId == static_cast<tileid_t>(rule.uid);
+            }) != tiles.end();
+
+            REQUIRE(placed == expected);
+            matchCount += expected ? 1 : 0;
+         }
+      }
+
+      // each Rule matches somewhere
+      REQUIRE(matchCount > 0);
+   }
+}
+
+TEST_CASE("Rules that need values the IntGrid doesn't have can't match", "[Rule]")
+{
+   // 4 cells: two 1s, one 2, one empty, and nothing else
+   const std::vector<uint32_t> valueCounts = { 1, 2, 1 };
+   const size_t cellCount = 4;
+
+   Rule rule;
+   rule.patternSize = 3;
+   rule.pattern = {
+      0, 0, 0,
+      0, 1, 0,
+      0, 0, 0,
+      };
+   REQUIRE(rule.canMatchValueCounts(valueCounts, cellCount));
+
+   rule.pattern[1] = 3;
+   REQUIRE_FALSE(rule.canMatchValueCounts(valueCounts, cellCount));
+
+   // unless the out-of-bounds value can stand in for it
+   rule.verticalOutOfBoundsValue = 3;
+   REQUIRE(rule.canMatchValueCounts(valueCounts, cellCount));
+   rule.verticalOutOfBoundsValue = -1;
+
+   rule.pattern[1] = -3;
+   REQUIRE(rule.canMatchValueCounts(valueCounts, cellCount));
+
+   // anything but 1, when every cell is 1
+   rule.pattern[1] = 0;
+   rule.pattern[4] = -1;
+   REQUIRE_FALSE(rule.canMatchValueCounts({ 0, 4 }, cellCount));
+   rule.horizontalOutOfBoundsValue = 0;
+   REQUIRE(rule.canMatchValueCounts({ 0, 4 }, cellCount));
+   rule.horizontalOutOfBoundsValue = -1;
+
+   rule.pattern[4] = RULE_PATTERN_NOTHING;
+   REQUIRE(rule.canMatchValueCounts(valueCounts, cellCount));
+   REQUIRE_FALSE(rule.canMatchValueCounts({ 0, 4 }, cellCount));
+
+   rule.pattern[4] = RULE_PATTERN_ANYTHING;
+   REQUIRE(rule.canMatchValueCounts(valueCounts, cellCount));
+   REQUIRE_FALSE(rule.canMatchValueCounts({ 4 }, cellCount));
+}
+
+TEST_CASE("Layers with no Rule that can match are skipped", "[Rule]")
+{
+   Level level;
+   level.setIntGrid(3, 2, {
+      1, 1, 0,
+      0, 1, 1,
+      });
+
+   LdtkDefFile def;
+   for (int layerIdx = 0; layerIdx < 2; ++layerIdx)
+   {
+      Layer layer;
+      layer.uid = 10 + layerIdx;
+      layer.ruleGroups.push_back(RuleGroup());
+
+      // the first layer only has Rules for values that aren't in the IntGrid
+      for (int ruleNum = 0; ruleNum < 3; ++ruleNum)
+      {
+         Rule rule;
+         rule.uid = 100 + (layerIdx * 10) + ruleNum;
+         rule.patternSize = 1;
+         rule.pattern = { (layerIdx == 0) ? ruleNum + 2 : 1 };
+         rule.tileIds = { static_cast<tileid_t>(ruleNum) };
+         rule.breakOnMatch = false;
+         layer.ruleGroups[0].rules.push_back(rule);
+      }
+
+      def.addLayer(std::move(layer));
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+
+   const TileGrid &skipped = level.getTileGridByIdx(0);
+   REQUIRE(skipped.getLayerUid() == 10);
+   for (size_t n = 0; n < skipped.size(); ++n)
+   {
+      REQUIRE(skipped(n).empty());
+   }
+
+   // the other layer still ran, and the values are counted again when the IntGrid changes
+   const TileGrid &ran = level.getTileGridByIdx(1);
+   REQUIRE(ran(0, 0).size() == 3);
+   REQUIRE(ran(2, 0).empty());
+
+   level.setIntGrid(2, 0, 2);
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+   REQUIRE(level.getTileGridByIdx(0)(2, 0).size() == 1);
+}
+
+TEST_CASE("Rules are listed by the IntGridValue their pattern's center can match", "[Rule]")
+{
+   LdtkDefFile def;
+   def.addLayer(Layer());
+   Layer &layer1 = *def.layerBegin();
+   layer1.initialRandomSeed = 321;
+   layer1.ruleGroups.push_back(RuleGroup());
+   layer1.ruleGroups.push_back(RuleGroup());
+
+   // center of each Rule's pattern, split across two RuleGroups
+   const std::vector<pattern_t> centers = { 1, RULE_PATTERN_ANYTHING, 0, -2, RULE_PATTERN_NOTHING, 2 };
+   for (size_t ruleNum = 0; ruleNum < centers.size(); ++ruleNum)
+   {
+      Rule rule;
+      rule.uid = static_cast<int>(200 + ruleNum);
+      rule.patternSize = 3;
+      rule.pattern = {
+         0, 0,                0,
+         0, centers[ruleNum], 0,
+         0, 1,                0,
+         };
+      rule.tileIds = { static_cast<tileid_t>(ruleNum) };
+      rule.breakOnMatch = true;
+      layer1.ruleGroups[ruleNum / 3].rules.push_back(rule);
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   def.preProcess(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog
+#endif
+   );
+
+   auto getCandidates = [&layer1](intgridvalue_t value)
+   {
+      const uint32_t *candidate;
+      const uint32_t *candidateEnd;
+      layer1.compiledRules.getCenterCandidates(value, candidate, candidateEnd);
+      return std::vector<uint32_t>(candidate, candidateEnd);
+   };
+
+   REQUIRE(getCandidates(0) == std::vector<uint32_t>{ 2, 3, 4 });
+   REQUIRE(getCandidates(1) == std::vector<uint32_t>{ 0, 1, 2, 3 });
+   REQUIRE(getCandidates(2) == std::vector<uint32_t>{ 1, 2, 5 });
+
+   // values no center checks for share the same list
+   REQUIRE(getCandidates(3) == std::vector<uint32_t>{ 1, 2, 3 });
+   REQUIRE(getCandidates(900) == std::vector<uint32_t>{ 1, 2, 3 });
+
+   SECTION("Checking only those Rules on each cell gives the same result")
+   {
+      Level level;
+      level.setIntGrid(6, 4, {
+         0, 1, 2, 3, 0, 1,
+         1, 1, 2, 2, 3, 1,
+         2, 0, 1, 1, 1, 0,
+         1, 3, 1, 2, 0, 2,
+         });
+
+      // the memo goes through the cells one by one, and the other way goes through each Rule in full
+      std::string results[2];
+      for (int memoize = 0; memoize < 2; ++memoize)
+      {
+         def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+            rulesLog,
+#endif
+            level, (memoize == 1) ? RunSettings::MemoizeMatches : 0);
+         results[memoize] = level.getTileGridByIdx(0).getTileIdDebugString();
+      }
+      REQUIRE(results[0] == results[1]);
+   }
+}
+
+TEST_CASE("Rules after every cell is finalized are skipped", "[Rule]")
+{
+   Level level;
+   level.setIntGrid(70, 3, std::vector<intgridvalue_t>(70 * 3, 1));
+
+   LdtkDefFile def;
+   def.addLayer(Layer());
+   Layer &layer1 = *def.layerBegin();
+   layer1.ruleGroups.push_back(RuleGroup());
+
+   // the first Rule finalizes every cell, so the ones after it never get to place anything
+   for (int ruleNum = 0; ruleNum < 3; ++ruleNum)
+   {
+      Rule rule;
+      rule.uid = 300 + ruleNum;
+      rule.patternSize = 1;
+      rule.pattern = { 1 };
+      rule.tileIds = { static_cast<tileid_t>(ruleNum) };
+      rule.breakOnMatch = true;
+
+      // so that the Rules are checked through the bitplanes instead of a lookup table
+      rule.posXOffset = (ruleNum > 0) ? 1 : 0;
+
+      layer1.ruleGroups[0].rules.push_back(rule);
+   }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   for (const unsigned int threadCount : { 1u, 4u })
+   {
+      def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level, RunSettings::None, threadCount);
+
+      const TileGrid &tileGrid = level.getTileGridByIdx(0);
+      REQUIRE(tileGrid.getOpenCellCount() == 0);
+      for (size_t n = 0; n < tileGrid.size(); ++n)
+      {
+         REQUIRE(tileGrid(n).size() == 1);
+         REQUIRE(tileGrid(n)[0].tileId == 0);
+      }
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      REQUIRE(rulesLog.rule[301].matchedCells.empty());
+      REQUIRE(rulesLog.rule[302].matchedCells.empty());
+#endif
+   }
+}
+
+TEST_CASE("Patterns of every size match the same cells as checking them one by one", "[Rule]")
+{
+   uint32_t randomState = 12345;
+   auto nextRandom = [&randomState](const uint32_t max) -> uint32_t
+   {
+      randomState = (randomState * 1664525u) + 1013904223u;
+      return (randomState >> 8) % max;
+   };
+
+   // a few IntGridValues scattered around, so that all kinds of pattern values pass and fail somewhere
+   const int width = 23;
+   const int height = 17;
+   std::vector<intgridvalue_t> values(width * height);
+   for (size_t n = 0; n < values.size(); ++n)
+   {
+      values[n] = static_cast<intgridvalue_t>(nextRandom(4));
+   }
+   const IntGrid grid(width, height, std::vector<intgridvalue_t>(values));
+
+   auto getValue = [&](const Rule &rule, const int x, const int y, int &outValue) -> bool
+   {
+      const bool withinHorizontal = x >= 0 && x < width;
+      const bool withinVertical = y >= 0 && y < height;
+      if (withinHorizontal && withinVertical)
+      {
+         outValue = values[GridUtility::getIndex(x, y, width)];
+      }
+      else
+      {
+         outValue = (withinVertical) ? rule.horizontalOutOfBoundsValue : rule.verticalOutOfBoundsValue;
+      }
+      return outValue != -1;
+   };
+
+   // what passesRule should give, without any of its shortcuts
+   auto expectedResult = [&](const Rule &rule, const int cellX, const int cellY) -> int8_t
+   {
+      const int radius = rule.patternSize / 2;
+      const int8_t directions[4][3] = {
+         { 1, 1, RuleResult::Success },
+         { -1, -1, TileFlags::FlippedX | TileFlags::FlippedY },
+         { -1, 1, TileFlags::FlippedX },
+         { 1, -1, TileFlags::FlippedY },
+         };
+      for (int orientation = 0; orientation < 4; ++orientation)
+      {
+         if ((orientation == 1 && !(rule.flipX && rule.flipY)) || (orientation == 2 && !rule.flipX) || (orientation == 3 && !rule.flipY))
+         {
+            continue;
+         }
+
+         bool matches = true;
+         for (int py = 0; matches && py < rule.patternSize; ++py)
+         {
+            for (int px = 0; matches && px < rule.patternSize; ++px)
+            {
+               const pattern_t patternValue = rule.pattern[px + (py * rule.patternSize)];
+               if (patternValue == 0)
+               {
+                  continue;
+               }
+
+               int value;
+               if (!getValue(rule, cellX + ((px - radius) * directions[orientation][0]), cellY + ((py - radius) * directions[orientation][1]), value))
+               {
+                  matches = false;
+               }
+               else if (patternValue == RULE_PATTERN_ANYTHING)
+               {
+                  matches = value != 0;
+               }
+               else if (patternValue == RULE_PATTERN_NOTHING)
+               {
+                  matches = value == 0;
+               }
+               else
+               {
+                  matches = (patternValue > 0) ? (value == patternValue) : (value != -patternValue);
+               }
+            }
+         }
+
+         if (matches)
+         {
+            return directions[orientation][2];
+         }
+      }
+      return RuleResult::Fail;
+   };
+
+   const pattern_t patternValues[] = { 0, 0, 0, 1, 2, -1, -3, RULE_PATTERN_ANYTHING, RULE_PATTERN_NOTHING };
+
+   // 11 is larger than any of the sizes that get their own version of the check
+   for (uint8_t patternSize : { 1, 3, 5, 7, 9, 11 })
+   {
+      for (int variation = 0; variation < 6; ++variation)
+      {
+         Rule rule;
+         rule.uid = (patternSize * 10) + variation;
+         rule.patternSize = patternSize;
+         rule.pattern.resize(patternSize * patternSize);
+
+         // sparse enough that the larger patterns still match now and then
+         for (size_t n = 0; n < rule.pattern.size(); ++n)
+         {
+            const pattern_t value = patternValues[nextRandom(sizeof(patternValues) / sizeof(patternValues[0]))];
+            const bool keep = n == rule.pattern.size() / 2 || nextRandom(patternSize) == 0;
+            rule.pattern[n] = keep ? value : 0;
+         }
+
+         rule.flipX = (variation % 2) == 1;
+         rule.flipY = (variation % 3) != 0;
+         rule.horizontalOutOfBoundsValue = (variation < 2) ? -1 : variation - 2;
+         rule.verticalOutOfBoundsValue = (variation < 4) ? 0 : -1;
+
+         for (int y = 0; y < height; ++y)
+         {
+            for (int x = 0; x < width; ++x)
+            {
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+               RuleLog ruleLog;
+#endif
+               const int8_t result = rule.passesRule(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 1
+                  ruleLog,
+#endif
+                  grid, x, y, 0);
+
+               REQUIRE(result == expectedResult(rule, x, y));
+            }
+         }
+      }
+   }
+}
+
+TEST_CASE("Rule shadowed by an earlier one", "[Rule]")
+{
+   Rule earlier;
+   earlier.patternSize = 3;
+   earlier.pattern = {
+      0, 1,                     0,
+      0, RULE_PATTERN_ANYTHING, 0,
+      0, 0,                     0,
+      };
+   earlier.tileIds = { 1 };
+   earlier.breakOnMatch = true;
+
+   Rule later;
+   later.patternSize = 5;
+   later.pattern = {
+      0, 0, 0, 0, 0,
+      0, 0, 1, 0, 0,
+      0, 0, 2, -1, 0,
+      0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0,
+      };
+   later.tileIds = { 2 };
+
+   REQUIRE(earlier.shadows(later));
+
+   // needs to finalize the cell it matched, with all the cells the later Rule could match
+   earlier.breakOnMatch = false;
+   REQUIRE_FALSE(earlier.shadows(later));
+   earlier.breakOnMatch = true;
+
+   earlier.chance = 0.5f;
+   REQUIRE_FALSE(earlier.shadows(later));
+   earlier.chance = 1.0f;
+
+   // the later Rule could match a flipped version
+   later.flipX = true;
+   REQUIRE_FALSE(earlier.shadows(later));
+   earlier.flipX = true;
+   REQUIRE(earlier.shadows(later));
+
+   // anything but 1 allows 0, which RULE_PATTERN_ANYTHING doesn't
+   later.pattern[12] = -1;
+   REQUIRE_FALSE(earlier.shadows(later));
+   later.pattern[12] = 2;
+
+   // the earlier Rule checks a cell that the later Rule doesn't care about
+   earlier.pattern[0] = RULE_PATTERN_NOTHING;
+   REQUIRE_FALSE(earlier.shadows(later));
+   later.pattern[6] = RULE_PATTERN_NOTHING;
+   REQUIRE(earlier.shadows(later));
+
+   // The later Rule could match with the cell above being out-of-bounds (since it counts as 1),
+   // but the earlier one couldn't, so it's not always shadowed anymore.
+   later.verticalOutOfBoundsValue = 1;
+   REQUIRE_FALSE(earlier.shadows(later));
+   earlier.verticalOutOfBoundsValue = 0;
+   REQUIRE_FALSE(earlier.shadows(later));
+   earlier.verticalOutOfBoundsValue = 1;
+   REQUIRE(earlier.shadows(later)); // the top-left cell needs to be empty, so the later Rule fails there anyway
+}
+
+TEST_CASE("Rules that can never place a tile are found in preProcess", "[Rule]")
+{
+   Level level;
+   level.setIntGrid(5, 4, {
+      0, 1, 1, 2, 0,
+      2, 1, 1, 1, 0,
+      0, 1, 2, 1, 1,
+      1, 2, 1, 0, 1,
+      });
+
+   LdtkDefFile def;
+   def.addLayer(Layer());
+   Layer &layer1 = *def.layerBegin();
+   layer1.name = "Walls";
+   layer1.intGridValues.resize(2);
+   layer1.intGridValues[0].id = 1;
+   layer1.intGridValues[1].id = 2;
+   layer1.ruleGroups.push_back(RuleGroup());
+   layer1.ruleGroups[0].name = "Edges";
+   layer1.ruleGroups.push_back(RuleGroup());
+   layer1.ruleGroups[1].name = "Details";
+
+   auto addRule = [&](const size_t ruleGroupIdx, const ldtkimport::uid_t uid, std::vector<pattern_t> &&pattern) -> Rule &
+   {
+      Rule rule;
+      rule.uid = uid;
+      rule.patternSize = 3;
+      rule.pattern = std::move(pattern);
+      rule.tileIds = { static_cast<tileid_t>(uid) };
+      rule.breakOnMatch = true;
+      layer1.ruleGroups[ruleGroupIdx].rules.push_back(rule);
+      return layer1.ruleGroups[ruleGroupIdx].rules.back();
+   };
+
+   addRule(0, 10, {
+      0, 1, 0,
+      0, 1, 0,
+      0, 0, 0,
+      });
+   // shadowed by the first Rule, even if it's in another RuleGroup
+   addRule(1, 11, {
+      0, 1, 0,
+      2, 1, 0,
+      0, 0, 0,
+      });
+   // there's no IntGridValue 3
+   addRule(1, 12, {
+      0, 0, 0,
+      0, 3, 0,
+      0, 0, 0,
+      });
+   // can still match where the first Rule doesn't
+   addRule(1, 13, {
+      0, -1, 0,
+      0, 1,  0,
+      0, 0,  0,
+      });
+   // could match a flipped version that the first Rule doesn't check
+   addRule(1, 14, {
+      0, 1, 0,
+      0, 1, 0,
+      0, 0, 0,
+      }).flipY = true;
+
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+   RulesLog rulesLog;
+#endif
+
+   def.preProcess(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog
+#endif
+   );
+
+   REQUIRE(layer1.compiledRules.deadRules == std::vector<uint8_t>{ DeadRule::None, DeadRule::Shadowed, DeadRule::NeedsMissingValue, DeadRule::None, DeadRule::None });
+   REQUIRE(layer1.compiledRules.shadowingRules[1] == 0);
+
+   std::ostringstream report;
+   REQUIRE(def.debugPrintDeadRules(report) == 2);
+   REQUIRE_THAT(report.str(), ContainsSubstring("Layer \"Walls\", RuleGroup \"Details\", Rule 11: always shadowed by Rule 10"));
+   REQUIRE_THAT(report.str(), ContainsSubstring("Rule 12: needs an IntGridValue"));
+
+   def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+      rulesLog,
+#endif
+      level);
+
+   auto countTiles = [&level](const tileid_t tileId)
+   {
+      const TileGrid &tileGrid = level.getTileGridByIdx(0);
+      int count = 0;
+      for (size_t n = 0; n < tileGrid.size(); ++n)
+      {
+         for (const TileInCell &tile : tileGrid(n))
+         {
+            count += (tile.tileId == tileId) ? 1 : 0;
+         }
+      }
+      return count;
+   };
+   REQUIRE(countTiles(10) > 0);
+   REQUIRE(countTiles(11) == 0);
+   REQUIRE(countTiles(13) > 0);
+
+   SECTION("A shadowed Rule runs again once the Rule shadowing it is turned off")
+   {
+      layer1.ruleGroups[0].rules[0].active = false;
+      def.runRules(
+#if !defined(NDEBUG) && LDTK_IMPORT_DEBUG_RULE > 0
+         rulesLog,
+#endif
+         level);
+
+      REQUIRE(countTiles(10) == 0);
+      REQUIRE(countTiles(11) > 0);
+   }
+}
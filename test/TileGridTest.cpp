@@ -0,0 +1,271 @@
+#include <stdexcept>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "ldtkimport/TileGrid.h"
+#include "ldtkimport/TileFlags.h"
+
+using namespace ldtkimport;
+
+
+TEST_CASE("Tile Grid marks cells with final tiles", "[Tile Grid]")
+{
+   TileGrid tileGrid(130, 2);
+
+   tileGrid.putTile(1, 3, 0, 0, 0, 100, TileFlags::NoFlags, 0);
+   tileGrid.putTile(2, 5, 0, 0, 0, 100, TileFlags::Final, 0);
+   tileGrid.putTile(3, 70, 1, 0, 0, 100, TileFlags::Final | TileFlags::FlippedX, 0);
+   tileGrid.putTile(4, 129, 1, 0, 0, 100, TileFlags::Final, 0);
+
+   REQUIRE(tileGrid.canStillPlaceTiles(3, 0));
+   REQUIRE_FALSE(tileGrid.canStillPlaceTiles(5, 0));
+   REQUIRE_FALSE(tileGrid.canStillPlaceTiles(70, 1));
+   REQUIRE_FALSE(tileGrid.canStillPlaceTiles(129, 1));
+   REQUIRE(tileGrid.canStillPlaceTiles(70, 0));
+   REQUIRE(tileGrid.canStillPlaceTiles(5, 1));
+
+   REQUIRE(tileGrid.getFinalWord(0, 0) == (TileGrid::finalword_t(1) << 5));
+   REQUIRE(tileGrid.getFinalWord(1, 0) == 0);
+   REQUIRE(tileGrid.getFinalWord(2, 0) == 0);
+   REQUIRE(tileGrid.getFinalWord(0, 1) == 0);
+   REQUIRE(tileGrid.getFinalWord(1, 1) == (TileGrid::finalword_t(1) << (70 - 64)));
+   REQUIRE(tileGrid.getFinalWord(2, 1) == (TileGrid::finalword_t(1) << (129 - 128)));
+
+   REQUIRE(tileGrid.getOpenCellCount() == 260 - 3);
+   REQUIRE(tileGrid.getOpenCellCountInRow(0) == 129);
+   REQUIRE(tileGrid.getOpenCellCountInRow(1) == 128);
+
+   // a cell that's already finalized isn't counted twice
+   tileGrid.putTile(5, 5, 0, 0, 0, 100, TileFlags::Final, 0);
+   REQUIRE(tileGrid.getOpenCellCount() == 260 - 3);
+   REQUIRE(tileGrid.getOpenCellCountInRow(0) == 129);
+
+   SECTION("Clean up removes the final marks")
+   {
+      tileGrid.cleanUp();
+
+      REQUIRE(tileGrid.canStillPlaceTiles(5, 0));
+      REQUIRE(tileGrid.canStillPlaceTiles(70, 1));
+      REQUIRE(tileGrid.getFinalWord(0, 0) == 0);
+      REQUIRE(tileGrid.getFinalWord(1, 1) == 0);
+      REQUIRE(tileGrid.getOpenCellCount() == 260);
+      REQUIRE(tileGrid.getOpenCellCountInRow(1) == 130);
+   }
+
+   SECTION("Resizing keeps the final marks in line with the tiles")
+   {
+      tileGrid.setSize(65, 4);
+
+      // the tiles stay at the same index, but since the width changed, they're at a different location now
+      size_t openCellCount = 0;
+      for (int y = 0; y < 4; ++y)
+      {
+         uint32_t openCellsInRow = 0;
+         for (int x = 0; x < 65; ++x)
+         {
+            const tiles_t &tiles = tileGrid(x, y);
+            bool hasFinal = !tiles.empty() && tiles[0].isFinal();
+            REQUIRE(tileGrid.canStillPlaceTiles(x, y) == !hasFinal);
+            if (!hasFinal)
+            {
+               ++openCellsInRow;
+            }
+         }
+         REQUIRE(tileGrid.getOpenCellCountInRow(y) == openCellsInRow);
+         openCellCount += openCellsInRow;
+      }
+      REQUIRE(tileGrid.getOpenCellCount() == openCellCount);
+   }
+}
+
+TEST_CASE("Tile Grid keeps track of the highest priority per cell", "[Tile Grid]")
+{
+   TileGrid tileGrid(4, 3);
+
+   REQUIRE(tileGrid.getHighestPriority(1, 1) == UINT8_MAX);
+
+   tileGrid.putTile(1, 1, 1, 0, 0, 100, TileFlags::NoFlags, 7);
+   REQUIRE(tileGrid.getHighestPriority(1, 1) == 7);
+
+   tileGrid.putTile(2, 1, 1, 0, 0, 100, TileFlags::NoFlags, 3);
+   REQUIRE(tileGrid.getHighestPriority(1, 1) == 3);
+
+   // a lower priority tile placed later doesn't change it
+   tileGrid.putTile(3, 1, 1, 0, 0, 100, TileFlags::NoFlags, 12);
+   REQUIRE(tileGrid.getHighestPriority(1, 1) == 3);
+
+   REQUIRE(tileGrid.getHighestPriority(2, 1) == UINT8_MAX);
+   REQUIRE(tileGrid.getHighestPriority(1, 2) == UINT8_MAX);
+
+   SECTION("Clean up resets the priorities")
+   {
+      tileGrid.cleanUp();
+      REQUIRE(tileGrid.getHighestPriority(1, 1) == UINT8_MAX);
+   }
+
+   SECTION("Resizing keeps the priorities in line with the tiles")
+   {
+      // cell (1, 1) is at index 5, which is (2, 1) in a 3-wide grid
+      tileGrid.setSize(3, 4);
+      REQUIRE(tileGrid.getHighestPriority(2, 1) == 3);
+      REQUIRE(tileGrid.getHighestPriority(1, 1) == UINT8_MAX);
+   }
+}
+
+TEST_CASE("Tile Grid stores placed tiles per cell after compacting", "[Tile Grid]")
+{
+   for (const TileGrid::Storage storage : { TileGrid::Storage::PerCell, TileGrid::Storage::Flat })
+   {
+      TileGrid tileGrid(3, 2, storage);
+
+      tileGrid.putTile(10, 2, 1, 0, 0, 100, TileFlags::NoFlags, 0);
+      tileGrid.putTile(11, 0, 0, 0, 0, 100, TileFlags::NoFlags, 0);
+      tileGrid.putTile(12, 2, 1, 0, 0, 100, TileFlags::NoFlags, 1);
+
+      REQUIRE(tileGrid.hasPendingTiles());
+      tileGrid.compact();
+      REQUIRE_FALSE(tileGrid.hasPendingTiles());
+
+      REQUIRE(tileGrid.getTiles(0, 0).size() == 1);
+      REQUIRE(tileGrid.getTiles(0, 0)[0].tileId == 11);
+      REQUIRE(tileGrid.getTiles(1, 0).empty());
+      REQUIRE(tileGrid.getTiles(2, 1).size() == 2);
+      REQUIRE(tileGrid.getTiles(2, 1)[0].tileId == 10);
+      REQUIRE(tileGrid.getTiles(2, 1)[1].tileId == 12);
+
+      // tiles placed after compacting go after the ones already in the cell
+      tileGrid.putTile(13, 2, 1, 0, 0, 100, TileFlags::NoFlags, 2);
+      tileGrid.putTile(14, 1, 0, 0, 0, 100, TileFlags::NoFlags, 2);
+      tileGrid.compact();
+
+      std::vector<tileid_t> tileIds;
+      for (const TileInCell &tile : tileGrid.getTiles(2, 1))
+      {
+         tileIds.push_back(tile.tileId);
+      }
+      REQUIRE(tileIds == std::vector<tileid_t>{ 10, 12, 13 });
+      REQUIRE(tileGrid.getTiles(1, 0).size() == 1);
+      REQUIRE(tileGrid.getTiles(1, 0)[0].tileId == 14);
+      REQUIRE(tileGrid.getTiles(0, 0)[0].tileId == 11);
+
+      REQUIRE(tileGrid.getTileIdDebugString() == R"(
+[11], [14], []
+[], [], [10, 12, 13]
+)");
+      REQUIRE(tileGrid.getStorage() == storage);
+
+      tileGrid.cleanUp();
+      REQUIRE(tileGrid.getTiles(2, 1).empty());
+   }
+}
+
+TEST_CASE("Tile Grid moves placed tiles to their cells when they're read", "[Tile Grid]")
+{
+   for (const TileGrid::Storage storage : { TileGrid::Storage::PerCell, TileGrid::Storage::Flat })
+   {
+      TileGrid tileGrid(3, 2, storage);
+      const TileGrid &constTileGrid = tileGrid;
+
+      tileGrid.putTile(10, 1, 1, 0, 0, 100, TileFlags::NoFlags, 0);
+      REQUIRE(constTileGrid.getTiles(1, 1).size() == 1);
+      REQUIRE_FALSE(tileGrid.hasPendingTiles());
+
+      tileGrid.putTile(11, 1, 1, 0, 0, 100, TileFlags::NoFlags, 0);
+      REQUIRE(constTileGrid.getTiles(4).size() == 2);
+      REQUIRE(constTileGrid.getTiles(4)[1].tileId == 11);
+
+      // reading them doesn't change how they're kept
+      REQUIRE(constTileGrid.getStorage() == storage);
+
+      tileGrid.putTile(12, 1, 1, 0, 0, 100, TileFlags::NoFlags, 0);
+      REQUIRE(tileGrid(1, 1).size() == 3);
+      REQUIRE(tileGrid(1, 1)[2].tileId == 12);
+
+      // getting the tiles as tiles_t to edit them needs each cell to have its own
+      REQUIRE(tileGrid.getStorage() == TileGrid::Storage::PerCell);
+   }
+}
+
+TEST_CASE("Tile Grid cells can be edited through operator()", "[Tile Grid]")
+{
+   TileGrid tileGrid(3, 2, TileGrid::Storage::Flat);
+   tileGrid.putTile(10, 0, 1, 0, 0, 100, TileFlags::NoFlags, 0);
+   tileGrid.putTile(11, 2, 0, 0, 0, 100, TileFlags::NoFlags, 0);
+
+   tiles_t &tiles = tileGrid(0, 1);
+   REQUIRE(tileGrid.getStorage() == TileGrid::Storage::PerCell);
+   REQUIRE(tiles.size() == 1);
+   tiles.push_back(TileInCell(20, 0, 0, 100, TileFlags::NoFlags, 0));
+   tileGrid(2).clear();
+
+   REQUIRE(tileGrid.getTileIdDebugString() == R"(
+[], [], []
+[10, 20], [], []
+)");
+
+   // switching back keeps the edits
+   tileGrid.setStorage(TileGrid::Storage::Flat);
+   REQUIRE(tileGrid.getStorage() == TileGrid::Storage::Flat);
+   REQUIRE(tileGrid.getTiles(0, 1).size() == 2);
+   REQUIRE(tileGrid.getTiles(0, 1)[1].tileId == 20);
+   REQUIRE(tileGrid.getTiles(2, 0).empty());
+
+   // reading through a const TileGrid doesn't change how the tiles are kept
+   const TileGrid &constTileGrid = tileGrid;
+   const TileSpan tilesBefore = constTileGrid.getTiles(0, 1);
+#if !defined(NDEBUG) && defined(LDTK_IMPORT_ASSERTS)
+   REQUIRE_THROWS_AS(constTileGrid(0, 1), std::logic_error);
+#else
+   REQUIRE(constTileGrid(0, 1).empty());
+#endif
+   REQUIRE(constTileGrid.getStorage() == TileGrid::Storage::Flat);
+   REQUIRE(constTileGrid.getTiles(0, 1).data() == tilesBefore.data());
+}
+
+TEST_CASE("Tile Grid removes tiles in an area only", "[Tile Grid]")
+{
+   for (const TileGrid::Storage storage : { TileGrid::Storage::PerCell, TileGrid::Storage::Flat })
+   {
+      TileGrid tileGrid(4, 3, storage);
+
+      for (int y = 0; y < 3; ++y)
+      {
+         for (int x = 0; x < 4; ++x)
+         {
+            tileGrid.putTile(static_cast<tileid_t>((y * 4) + x), x, y, 0, 0, 100, TileFlags::Final, 1);
+         }
+      }
+      tileGrid.putTile(20, 3, 1, 0, 0, 100, TileFlags::NoFlags, 0);
+      tileGrid.compact();
+      REQUIRE(tileGrid.getOpenCellCount() == 0);
+
+      tileGrid.cleanUpArea(CellArea(1, 0, 2, 1));
+
+      REQUIRE(tileGrid.getTileIdDebugString() == R"(
+[0], [], [], [3]
+[4], [], [], [7, 20]
+[8], [9], [10], [11]
+)");
+      REQUIRE(tileGrid.getOpenCellCount() == 4);
+      REQUIRE(tileGrid.canStillPlaceTiles(1, 0));
+      REQUIRE_FALSE(tileGrid.canStillPlaceTiles(3, 0));
+      REQUIRE(tileGrid.getHighestPriority(2, 1) == UINT8_MAX);
+      REQUIRE(tileGrid.getHighestPriority(3, 1) == 0);
+
+      // only the pending tiles in the kept areas are added
+      tileGrid.putTile(21, 2, 1, 0, 0, 100, TileFlags::Final, 2);
+      tileGrid.putTile(22, 0, 2, 0, 0, 100, TileFlags::NoFlags, 2);
+      tileGrid.putTile(23, 1, 0, 0, 0, 100, TileFlags::NoFlags, 2);
+      tileGrid.discardPendingTiles({ CellArea(1, 0, 2, 1) });
+      tileGrid.compact();
+
+      REQUIRE(tileGrid.getTileIdDebugString() == R"(
+[0], [23], [], [3]
+[4], [], [21], [7, 20]
+[8], [9], [10], [11]
+)");
+      REQUIRE(tileGrid.getOpenCellCount() == 3);
+      REQUIRE(tileGrid.getStorage() == storage);
+   }
+}